@@ -0,0 +1,251 @@
+// End-to-end latency and throughput of canonical requests.
+//
+// Every request shape is run at concurrency 1, 2, 4 ... 2*nproc;
+// reports p50/p99/p999 latency (ms) and tasks/sec.
+//
+// Environment:
+//   SANDALS_BENCH_REQUESTS    requests per (shape, concurrency), 200
+//   SANDALS_BENCH_SHAPES      comma separated shape names, all by default
+//   SANDALS_BENCH_CGROUP_ROOT cgroupRoot for the 'cgroup' shape
+//   SANDALS_BENCH_MAX_P50     fail if 'true' p50 at concurrency 1
+//                             exceeds this value (ms)
+//   SANDALS_BENCH_REFLINK_DIR directory on a filesystem supporting
+//                             reflinks (ex: btrfs, xfs) for the
+//                             'copyFilesReflink' shape
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+const { spawn } = require('child_process');
+
+const SANDALS = path.dirname(__dirname) + '/sandals';
+const REQUESTS = +process.env.SANDALS_BENCH_REQUESTS || 200;
+const CGROUP_ROOT = process.env.SANDALS_BENCH_CGROUP_ROOT;
+const MAX_P50 = +process.env.SANDALS_BENCH_MAX_P50 || 0;
+const REFLINK_DIR = process.env.SANDALS_BENCH_REFLINK_DIR;
+
+const tmpDir = fs.mkdtempSync(os.tmpdir() + '/sandals-bench-');
+const reflinkDir = REFLINK_DIR &&
+    fs.mkdtempSync(REFLINK_DIR + '/sandals-bench-');
+process.on('exit', ()=>{
+    for (const dir of [tmpDir, reflinkDir])
+        if (dir) fs.rmSync(dir, {recursive: true, force: true});
+});
+fs.chmodSync(tmpDir, 0o777);
+if (reflinkDir) fs.chmodSync(reflinkDir, 0o777);
+
+// Syscalls nobody in the benchmark needs, to get a sizable policy.
+const DENIED_SYSCALLS = [
+    'ptrace', 'kexec_load', 'init_module', 'finit_module', 'delete_module',
+    'reboot', 'swapon', 'swapoff', 'pivot_root', 'acct', 'settimeofday',
+    'adjtimex', 'clock_settime', 'sethostname', 'setdomainname', 'iopl',
+    'ioperm', 'create_module', 'quotactl', 'nfsservctl', 'lookup_dcookie',
+    'perf_event_open', 'bpf', 'userfaultfd', 'keyctl', 'add_key',
+    'request_key', 'process_vm_readv', 'process_vm_writev', 'kcmp',
+    'name_to_handle_at', 'open_by_handle_at', 'syslog', 'vhangup', 'uselib'
+];
+const SECCOMP_POLICY = [
+    'POLICY bench {',
+    '  ERRNO(1) {',
+    '    ' + DENIED_SYSCALLS.join(', ') + ',',
+    // a long chain of argument checks
+    '    socket(domain, type, protocol) { ' + Array.from(
+        {length: 40}, (_, i)=>`domain == ${i + 3}`).join(' || ') + ' }',
+    '  }',
+    '}',
+    'USE bench DEFAULT ALLOW'
+].join('\n');
+
+const CPU_LOOP = 'i=0; while [ $i -lt 20000 ]; do i=$((i+1)); done';
+
+const STREAM_SIZE = '16M';
+
+function pipeStream(ioUring) {
+    const produce = `head -c ${STREAM_SIZE} /dev/zero`;
+    return {
+        ioUring,
+        mounts: [{type: 'tmpfs', dest: '/tmp'}],
+        pipes: [
+            {stdout: true, dest: '/dev/null'},
+            {stderr: true, dest: '/dev/null'},
+            {src: '/tmp/fifo', dest: '/dev/null'}
+        ],
+        cmd: ['sh', '-c',
+            `${produce} & ${produce} >&2 & ${produce} > /tmp/fifo; wait`]
+    };
+}
+
+const COPY_SIZE = '16M';
+let copySeq = 0;
+
+// copyFiles with src in dir bind mounted at /tmp (a tmpfs if omitted),
+// i.e. on the same filesystem as dest. The task unlinks src once
+// written, the spawner's fd keeps it alive.
+function copyFile(i, dir, cmd, dest) {
+    const src = `/tmp/src${copySeq++}`;
+    return {
+        mounts: [dir ? {type: 'bind', src: dir, dest: '/tmp'}
+            : {type: 'tmpfs', dest: '/tmp'}],
+        copyFiles: [{src, dest: dest || `${dir || tmpDir}/copy${i}`}],
+        cmd: ['sh', '-c', `${cmd(src)}; rm ${src}`]
+    };
+}
+
+const DENSE = src=>`head -c ${COPY_SIZE} /dev/zero > ${src}`;
+// 1GiB, mostly a hole
+const SPARSE = src=>`echo x > ${src}; truncate -s 1G ${src}`;
+
+const shapes = {
+    true: ()=>({cmd: ['true']}),
+    mounts: ()=>({
+        mounts: [
+            {type: 'tmpfs', dest: '/tmp'},
+            ...['/bin', '/etc', '/lib', '/usr', '/var', '/opt', '/srv', '/home']
+                .filter(dir=>fs.existsSync(dir))
+                .map(dir=>({type: 'bind', src: dir, dest: dir, ro: true})),
+            {type: 'tmpfs', dest: '/mnt'},
+            {type: 'proc', dest: '/proc'}
+        ],
+        cmd: ['true']
+    }),
+    cgroup: ()=>({
+        cgroupConfig: {'cgroup.max.depth': '1'},
+        ...(CGROUP_ROOT ? {cgroupRoot: CGROUP_ROOT} : {}),
+        cmd: ['true']
+    }),
+    seccomp: ()=>({seccompPolicy: SECCOMP_POLICY, cmd: ['true']}),
+    stdStreams: ()=>({
+        stdStreams: {dest: '/dev/null'},
+        cmd: ['sh', '-c', 'echo out; echo err >&2']
+    }),
+    // CPU-bound task under a filter, with Speculative Store Bypass
+    // mitigation as kernels in spec_store_bypass_disable=seccomp mode
+    // impose, vs. opted out via SECCOMP_FILTER_FLAG_SPEC_ALLOW
+    cpu: ()=>({
+        seccompPolicy: SECCOMP_POLICY, specStoreBypass: 'disable',
+        cmd: ['sh', '-c', CPU_LOOP]
+    }),
+    cpuSpecAllow: ()=>({
+        seccompPolicy: SECCOMP_POLICY, seccompSpecAllow: true,
+        specStoreBypass: 'enable', cmd: ['sh', '-c', CPU_LOOP]
+    }),
+    // supervisor event loop backends streaming to several sinks
+    pipeStream: ()=>pipeStream(false),
+    pipeStreamUring: ()=>pipeStream(true),
+    copyFiles: i=>({
+        mounts: [{type: 'tmpfs', dest: '/tmp'}],
+        copyFiles: [{src: '/tmp/out', dest: `${tmpDir}/out${i}`}],
+        cmd: ['sh', '-c', 'head -c 65536 /dev/zero > /tmp/out']
+    }),
+    // copyFiles paths: reflink, copy_file_range() within a filesystem,
+    // sendfile() across filesystems, and read/write into a non-regular
+    // dest; the sparse shapes copy data extents only
+    ...(reflinkDir ? {
+        copyFilesReflink: i=>copyFile(i, reflinkDir, DENSE)
+    } : {}),
+    copyFilesRange: i=>copyFile(i, tmpDir, DENSE),
+    copyFilesSendfile: i=>copyFile(i, null, DENSE),
+    copyFilesReadWrite: i=>copyFile(i, null, DENSE, '/dev/null'),
+    copyFilesSparseRange: i=>copyFile(i, tmpDir, SPARSE),
+    copyFilesSparseSendfile: i=>copyFile(i, null, SPARSE)
+};
+
+// Failures meaning a feature is unavailable on this host (ex: no
+// delegated cgroup v2 hierarchy) rather than a broken sandals.
+const UNAVAILABLE = /cgroup|seccomp|PR_SET_SPECULATION_CTRL/i;
+
+function unavailable(response) {
+    return response.status === 'internalError'
+        && UNAVAILABLE.test(response.description);
+}
+
+function runOne(request) {
+    return new Promise(resolve=>{
+        const start = process.hrtime.bigint();
+        const output = [];
+        const p = spawn(SANDALS, [], {stdio: ['pipe', 'pipe', 'inherit']});
+        p.stdout.on('data', data=>output.push(data));
+        p.on('close', ()=>{
+            const ms = Number(process.hrtime.bigint() - start) / 1e6;
+            let response;
+            try {
+                response = JSON.parse(Buffer.concat(output).toString('utf8'));
+            } catch (e) {
+                response = {status: 'noResponse'};
+            }
+            resolve({ms, response});
+        });
+        p.stdin.end(JSON.stringify(request));
+    });
+}
+
+async function runBatch(shape, concurrency) {
+    const latencies = [];
+    let next = 0, failure = null;
+    const start = process.hrtime.bigint();
+    async function worker() {
+        while (!failure && next < REQUESTS) {
+            const {ms, response} = await runOne(shapes[shape](next++));
+            if (response.status !== 'exited' || response.code !== 0)
+                failure = failure || response;
+            latencies.push(ms);
+        }
+    }
+    await Promise.all(Array.from({length: concurrency}, worker));
+    const elapsed = Number(process.hrtime.bigint() - start) / 1e9;
+    latencies.sort((a, b)=>a - b);
+    const pct = p=>latencies[Math.min(
+        latencies.length - 1, Math.floor(latencies.length * p))];
+    return {
+        failure,
+        p50: pct(0.5), p99: pct(0.99), p999: pct(0.999),
+        rate: latencies.length / elapsed
+    };
+}
+
+function concurrencyLevels() {
+    const max = 2 * os.cpus().length, levels = [];
+    for (let c = 1; c < max; c *= 2) levels.push(c);
+    levels.push(max);
+    return levels;
+}
+
+async function main() {
+    const selected = process.env.SANDALS_BENCH_SHAPES
+        ? process.env.SANDALS_BENCH_SHAPES.split(',') : Object.keys(shapes);
+    let ok = true;
+
+    console.log(['shape', 'conc', 'p50ms', 'p99ms', 'p999ms', 'tasks/s']
+        .map(s=>s.padStart(10)).join(''));
+    for (const shape of selected) {
+        if (!shapes[shape]) {
+            console.error(shape === 'copyFilesReflink'
+                ? 'copyFilesReflink needs SANDALS_BENCH_REFLINK_DIR'
+                : `Unknown shape: ${shape}`);
+            process.exit(1);
+        }
+        for (const concurrency of concurrencyLevels()) {
+            const r = await runBatch(shape, concurrency);
+            if (r.failure) {
+                const skip = unavailable(r.failure);
+                console.log(`${shape.padStart(10)}  ${
+                    skip ? 'skipped' : 'FAILED'}: ${
+                    JSON.stringify(r.failure)}`);
+                ok = ok && skip;
+                break;
+            }
+            console.log([
+                shape, concurrency, r.p50.toFixed(2), r.p99.toFixed(2),
+                r.p999.toFixed(2), r.rate.toFixed(1)
+            ].map(s=>String(s).padStart(10)).join(''));
+            if (MAX_P50 && shape === 'true' && concurrency === 1
+                && r.p50 > MAX_P50
+            ) {
+                console.error(`p50 ${r.p50.toFixed(2)}ms exceeds ${MAX_P50}ms`);
+                ok = false;
+            }
+        }
+    }
+    process.exit(ok ? 0 : 1);
+}
+
+main();
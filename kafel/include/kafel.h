@@ -29,6 +29,10 @@
 extern "C" {
 #endif
 
+// Bumped whenever the generated code or relocations may change for the same
+// policy; useful for keying caches of compiled programs.
+#define KAFEL_BPF_VERSION 6
+
 typedef struct kafel_ctxt* kafel_ctxt_t;
 
 /*
@@ -41,6 +45,16 @@ kafel_ctxt_t kafel_ctxt_create(void);
  */
 void kafel_ctxt_destroy(kafel_ctxt_t* ctxt);
 
+/*
+ * Releases state of the last compilation using ctxt (parameters, relocations,
+ *   error message); settings such as input, target architecture, profile and
+ *   include search paths are kept
+ * Memory is retained for reuse, so once a context has warmed up, compiling
+ *   with it only allocates scanner buffers and the resulting program
+ * kafel_compile resets ctxt implicitly
+ */
+void kafel_ctxt_reset(kafel_ctxt_t ctxt);
+
 /*
  * Sets input source for ctxt to file
  * Caller is responsible for closing the file stream after compilation
@@ -58,6 +72,45 @@ void kafel_set_input_string(kafel_ctxt_t ctxt, const char* string);
  */
 void kafel_set_target_arch(kafel_ctxt_t ctxt, uint32_t target_arch);
 
+/*
+ * Relative frequency of a syscall, see kafel_set_syscall_profile
+ */
+struct kafel_syscall_weight {
+  uint32_t nr;
+  uint32_t weight;
+};
+
+/*
+ * Sets syscall frequency profile for ctxt (ex: counts from a recorded run)
+ * Syscall dispatch code is arranged so that frequent syscalls are resolved
+ *   in fewer instructions; syscalls missing from profile are assumed rare
+ * profile must stay valid until compilation; NULL restores the default
+ *   balanced dispatch
+ */
+void kafel_set_syscall_profile(kafel_ctxt_t ctxt,
+                               const struct kafel_syscall_weight* profile,
+                               size_t len);
+
+/*
+ * Reads a syscall profile from file: one 'NR COUNT' pair per line, ex:
+ *   counts from 'strace -c' of a representative run mapped to numbers
+ * Stores a newly allocated array in *profile and its length in *len,
+ *   caller is responsible for freeing *profile
+ *
+ * Returns 0 on success, -1 on malformed input, read error or out of memory
+ */
+int kafel_read_syscall_profile(FILE* file,
+                               struct kafel_syscall_weight** profile,
+                               size_t* len);
+
+/*
+ * Enables (default) or disables the peephole pass run over generated code:
+ *   redundant load elimination, jump threading, merging of identical return
+ *   instructions and dead code removal
+ * Disabling it is only useful to inspect what the code generator emits
+ */
+void kafel_set_peephole(kafel_ctxt_t ctxt, int enabled);
+
 /*
  * Adds path to list of include search paths for ctxt
  */
@@ -78,6 +131,7 @@ int kafel_compile(kafel_ctxt_t ctxt, struct sock_fprog* prog);
 /*
  * Convenience function to compile a policy from a file
  * Does not preserve detailed error information
+ * Fails if the policy has parameters
  * Same as for kafel_compile caller is repsonsible for freeing prog->filter
  * Caller is also responsible for closing the file stream
  *
@@ -88,12 +142,56 @@ int kafel_compile_file(FILE* file, struct sock_fprog* prog);
 /*
  * Convenience function to compile a policy from a NULL-terminated string
  * Does not preserve detailed error information
+ * Fails if the policy has parameters
  * Same as for kafel_compile caller is repsonsible for freeing prog->filter
  *
  * Returns 0 on success
  */
 int kafel_compile_string(const char* source, struct sock_fprog* prog);
 
+/*
+ * Slot for a parameter value in compiled code: k of instruction insn
+ *   receives bits [shift, shift + 32) of the value of parameter param
+ * width is the number of bits of the value the comparison covers: 32 when
+ *   the parameter is compared with a 32-bit argument (its high word is never
+ *   checked), 64 otherwise; callers should reject values that do not fit
+ */
+struct kafel_reloc {
+  uint32_t insn;
+  uint32_t param;
+  uint32_t shift;
+  uint32_t width;
+};
+
+/*
+ * Returns the number of distinct parameters ($NAME placeholders) in the
+ *   policy compiled last using ctxt; parameters are numbered in order of
+ *   first appearance
+ * Until their values are patched in with kafel_apply_relocs, the program
+ *   behaves as if all parameters were 0
+ */
+size_t kafel_param_count(const kafel_ctxt_t ctxt);
+
+/*
+ * Returns the name (without '$') of parameter param
+ */
+const char* kafel_param_name(const kafel_ctxt_t ctxt, size_t param);
+
+/*
+ * Returns relocations for the program compiled last using ctxt and stores
+ *   their count in len
+ * Valid until the next compilation or until ctxt is reset or destroyed
+ */
+const struct kafel_reloc* kafel_relocs(const kafel_ctxt_t ctxt, size_t* len);
+
+/*
+ * Patches parameter values into prog; values are indexed by parameter
+ *   number and must cover all parameters referenced by relocs
+ */
+void kafel_apply_relocs(struct sock_fprog* prog,
+                        const struct kafel_reloc* relocs, size_t len,
+                        const uint64_t* values);
+
 /*
  * Returns textual description of the error, if compilation using ctxt failed
  */
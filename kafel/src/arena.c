@@ -0,0 +1,142 @@
+/*
+   Kafel - arena allocator
+   -----------------------------------------
+
+   Copyright 2026 The sandals authors.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+#include "arena.h"
+
+#include <stdalign.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+
+#ifndef ARENA_BLOCK_SIZE
+#define ARENA_BLOCK_SIZE (32 * 1024)
+#endif
+
+#define ARENA_ALIGN alignof(max_align_t)
+
+struct arena_block {
+  struct arena_block* next;
+  size_t size;
+  size_t used;
+  max_align_t data[];
+};
+
+static size_t align_size(size_t size) {
+  size_t aligned = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+  if (aligned < size) {
+    ASSERT(0);  // overflow
+  }
+  return aligned;
+}
+
+static char* block_end(struct arena_block* block) {
+  return (char*)block->data + block->used;
+}
+
+void arena_init(struct arena* arena) {
+  ASSERT(arena != NULL);
+
+  arena->first = NULL;
+  arena->current = NULL;
+}
+
+void* arena_alloc(struct arena* arena, size_t size) {
+  ASSERT(arena != NULL);
+
+  size = align_size(size);
+
+  // blocks past current are free, left over from a reset
+  struct arena_block** link = arena->current ? &arena->current : &arena->first;
+  while (*link != NULL && (*link)->size - (*link)->used < size) {
+    link = &(*link)->next;
+  }
+  if (*link == NULL) {
+    size_t block_size = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+    if (block_size > SIZE_MAX - sizeof(**link)) {
+      ASSERT(0);  // overflow
+    }
+    *link = malloc(sizeof(**link) + block_size);
+    if (*link == NULL) {
+      ASSERT(0);  // OOM
+    }
+    (*link)->next = NULL;
+    (*link)->size = block_size;
+    (*link)->used = 0;
+  }
+  arena->current = *link;
+
+  void* rv = block_end(arena->current);
+  arena->current->used += size;
+  memset(rv, 0, size);
+  return rv;
+}
+
+void* arena_grow(struct arena* arena, void* ptr, size_t oldsize,
+                 size_t newsize) {
+  ASSERT(arena != NULL);
+  ASSERT(newsize >= oldsize);
+
+  if (ptr == NULL) {
+    return arena_alloc(arena, newsize);
+  }
+
+  struct arena_block* block = arena->current;
+  size_t aligned_old = align_size(oldsize);
+  size_t aligned_new = align_size(newsize);
+  if ((char*)ptr + aligned_old == block_end(block) &&
+      block->used - aligned_old + aligned_new <= block->size) {
+    block->used += aligned_new - aligned_old;
+    memset((char*)ptr + oldsize, 0, newsize - oldsize);
+    return ptr;
+  }
+
+  void* rv = arena_alloc(arena, newsize);
+  memcpy(rv, ptr, oldsize);
+  return rv;
+}
+
+char* arena_strdup(struct arena* arena, const char* str) {
+  ASSERT(str != NULL);
+
+  size_t size = strlen(str) + 1;
+  return memcpy(arena_alloc(arena, size), str, size);
+}
+
+void arena_reset(struct arena* arena) {
+  ASSERT(arena != NULL);
+
+  for (struct arena_block* block = arena->first; block != NULL;
+       block = block->next) {
+    block->used = 0;
+  }
+  arena->current = NULL;
+}
+
+void arena_clean(struct arena* arena) {
+  ASSERT(arena != NULL);
+
+  while (arena->first != NULL) {
+    struct arena_block* next = arena->first->next;
+    free(arena->first);
+    arena->first = next;
+  }
+  arena->current = NULL;
+}
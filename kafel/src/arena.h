@@ -0,0 +1,46 @@
+/*
+   Kafel - arena allocator
+   -----------------------------------------
+
+   Copyright 2026 The sandals authors.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+#ifndef KAFEL_ARENA_H
+#define KAFEL_ARENA_H
+
+#include <stddef.h>
+
+struct arena_block;
+
+// Bump allocator backing everything a compilation creates; nothing is
+// freed individually. Reset keeps the blocks, so repeated compilations on
+// one context stop hitting malloc once the high-water mark is reached.
+struct arena {
+  struct arena_block* first;
+  struct arena_block* current;
+};
+
+void arena_init(struct arena* arena);
+// Returns zeroed memory, aligned for any type
+void* arena_alloc(struct arena* arena, size_t size);
+// Resizes an allocation of oldsize bytes (in place if it is the last one),
+// new bytes are zeroed
+void* arena_grow(struct arena* arena, void* ptr, size_t oldsize,
+                 size_t newsize);
+char* arena_strdup(struct arena* arena, const char* str);
+void arena_reset(struct arena* arena);
+void arena_clean(struct arena* arena);
+
+#endif /* KAFEL_ARENA_H */
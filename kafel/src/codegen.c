@@ -26,9 +26,11 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/queue.h>
 
 #include "common.h"
+#include "peephole.h"
 #include "range_rules.h"
 #include "syscall.h"
 
@@ -97,6 +99,7 @@ static __u32 ACTION_TO_BPF(int action) {
 }
 
 struct codegen_ctxt {
+  struct arena *arena;
   struct {
     struct sock_filter *data;
     size_t len;
@@ -110,27 +113,26 @@ struct codegen_ctxt {
     } cache[MAX_JUMP];
     size_t cache_size;
   } locations;
+  struct {
+    struct kafel_reloc *data;
+    size_t len;
+    size_t capacity;
+  } relocs;
 };
 
-static struct codegen_ctxt *context_create(void) {
-  struct codegen_ctxt *ctxt = calloc(1, sizeof(*ctxt));
+// All codegen memory comes from arena, only the final program is copied out
+static struct codegen_ctxt *context_create(struct arena *arena) {
+  struct codegen_ctxt *ctxt = arena_alloc(arena, sizeof(*ctxt));
+  ctxt->arena = arena;
   ctxt->buffer.capacity = CODEGEN_INITAL_BUFFER_SIZE;
-  ctxt->buffer.data = calloc(ctxt->buffer.capacity, sizeof(*ctxt->buffer.data));
+  ctxt->buffer.data =
+      arena_alloc(arena, ctxt->buffer.capacity * sizeof(*ctxt->buffer.data));
   for (int i = 0; i <= ACTION_BASIC_MAX; ++i) {
     ctxt->locations.basic_actions[i] = INVALID_LOCATION;
   }
   return ctxt;
 }
 
-static void context_destroy(struct codegen_ctxt **ctxt) {
-  ASSERT(ctxt != NULL);
-  ASSERT((*ctxt) != NULL);
-
-  free((*ctxt)->buffer.data);
-  free(*ctxt);
-  *ctxt = NULL;
-}
-
 static int add_instruction(struct codegen_ctxt *ctxt, struct sock_filter inst) {
   ASSERT(ctxt != NULL);
 
@@ -144,7 +146,8 @@ static int add_instruction(struct codegen_ctxt *ctxt, struct sock_filter inst) {
     if (newcapacity < ctxt->buffer.capacity || newbytes < oldbytes) {
       ASSERT(0);  // overflow
     }
-    ctxt->buffer.data = realloc(ctxt->buffer.data, newbytes);
+    ctxt->buffer.data =
+        arena_grow(ctxt->arena, ctxt->buffer.data, oldbytes, newbytes);
     ctxt->buffer.capacity = newcapacity;
   }
   ctxt->buffer.data[ctxt->buffer.len++] = inst;
@@ -237,6 +240,25 @@ static int add_jump(struct codegen_ctxt *ctxt, __u16 type, __u32 k, int tloc,
   return ADD_INSTR(BPF_JUMP(BPF_JMP | type, k, tpos, fpos));
 }
 
+// Parameter word is patched into k of instruction at loc later;
+// insn holds the location until the buffer is reversed
+static void add_reloc(struct codegen_ctxt *ctxt, int loc, int param,
+                      int shift) {
+  ASSERT(ctxt != NULL);
+  ASSERT(loc >= 0);
+
+  if (ctxt->relocs.capacity <= ctxt->relocs.len) {
+    size_t capacity = ctxt->relocs.capacity ? ctxt->relocs.capacity * 2 : 8;
+    ctxt->relocs.data = arena_grow(
+        ctxt->arena, ctxt->relocs.data,
+        ctxt->relocs.capacity * sizeof(*ctxt->relocs.data),
+        capacity * sizeof(*ctxt->relocs.data));
+    ctxt->relocs.capacity = capacity;
+  }
+  ctxt->relocs.data[ctxt->relocs.len++] = ((struct kafel_reloc){
+      .insn = loc, .param = param, .shift = shift});
+}
+
 static int add_jump_ge(struct codegen_ctxt *ctxt, __u32 than, int tloc,
                        int floc) {
   ASSERT(ctxt != NULL);
@@ -282,6 +304,7 @@ static int add_jump_set(struct codegen_ctxt *ctxt, __u32 what, int tloc,
 
 #define ARG_WORD(arg, word) ((word == HIGH_WORD) ? ARG_HIGH(arg) : ARG_LOW(arg))
 #define NUM_WORD(num, word) ((word == HIGH_WORD) ? NUM_HIGH(num) : NUM_LOW(num))
+#define WORD_SHIFT(word) ((word == HIGH_WORD) ? 32 : 0)
 
 #define BPF_LOAD_ARCH \
   BPF_STMT(BPF_LD + BPF_W + BPF_ABS, offsetof(struct seccomp_data, arch))
@@ -296,6 +319,7 @@ static bool is_const_value(struct expr_tree *expr, int word) {
   switch (expr->type) {
     case EXPR_NUMBER:
       return true;
+    case EXPR_PARAM:
     case EXPR_VAR:
       return false;
     case EXPR_BIT_AND:
@@ -340,7 +364,12 @@ static int generate_load(struct codegen_ctxt *ctxt, struct expr_tree *expr,
     return ADD_INSTR(BPF_STMT(BPF_LD | BPF_IMM, value_of(expr, word)));
   }
 
+  int loc;
   switch (expr->type) {
+    case EXPR_PARAM:
+      loc = ADD_INSTR(BPF_STMT(BPF_LD | BPF_IMM, 0));
+      add_reloc(ctxt, loc, expr->param, WORD_SHIFT(word));
+      return loc;
     case EXPR_VAR:
       return ADD_INSTR(BPF_LOAD_ARG_WORD(expr->var, word));
     case EXPR_BIT_AND:
@@ -366,6 +395,8 @@ static bool is_64bit(struct expr_tree *expr) {
   switch (expr->type) {
     case EXPR_NUMBER:
       return expr->number > UINT32_MAX;
+    case EXPR_PARAM:
+      return false;
     case EXPR_VAR:
       return expr->size == 8;
     default:
@@ -373,6 +404,23 @@ static bool is_64bit(struct expr_tree *expr) {
   }
 }
 
+static bool has_var(struct expr_tree *expr) {
+  switch (expr->type) {
+    case EXPR_VAR:
+      return true;
+    case EXPR_BIT_AND:
+      return has_var(expr->left) || has_var(expr->right);
+    default:
+      return false;
+  }
+}
+
+// Parameters are as wide as the argument they are compared with,
+// full 64-bit if there is none
+static bool is_wide(struct expr_tree *expr) {
+  return is_64bit(expr) || !(has_var(expr->left) || has_var(expr->right));
+}
+
 enum {
   NEVER,
   NORMAL,
@@ -401,6 +449,7 @@ static int generate_cmp32(struct codegen_ctxt *ctxt, __u32 type,
   ASSERT(expr != NULL);
 
   int next, begin = CURRENT_LOC;
+  size_t relocs_begin = ctxt->relocs.len;
 
   struct expr_tree *left = expr->left;
   struct expr_tree *right = expr->right;
@@ -437,7 +486,16 @@ static int generate_cmp32(struct codegen_ctxt *ctxt, __u32 type,
     type = BPF_JSET;
   }
 
-  if (is_const_value(right, word)) {
+  if (right->type == EXPR_PARAM) {
+    // value unknown, no shortcuts
+    next = add_jump(ctxt, type | BPF_K, 0, tloc, floc);
+    if (tloc != floc) {
+      add_reloc(ctxt, next, right->param, WORD_SHIFT(word));
+    }
+    if (load == ALWAYS || (load != NEVER && next > begin)) {
+      begin = next = generate_load(ctxt, left, word);
+    }
+  } else if (is_const_value(right, word)) {
     next = ADD_JUMP_K(type, value_of(right, word), tloc, floc);
     if (load == ALWAYS || (load != NEVER && next > begin)) {
       begin = next = generate_load(ctxt, left, word);
@@ -451,6 +509,9 @@ static int generate_cmp32(struct codegen_ctxt *ctxt, __u32 type,
     }
   }
 
+  for (size_t i = relocs_begin; i < ctxt->relocs.len; ++i) {
+    ctxt->relocs.data[i].width = is_wide(expr) ? 64 : 32;
+  }
   return next;
 }
 
@@ -458,7 +519,7 @@ static int generate_inequality(struct codegen_ctxt *ctxt, __u32 type,
                                struct expr_tree *expr, int tloc, int floc) {
   int next = generate_cmp32(ctxt, type, expr, tloc, floc, LOW_WORD, NORMAL);
   int begin = CURRENT_LOC;
-  if (is_64bit(expr)) {
+  if (is_wide(expr)) {
     next = generate_cmp32(ctxt, BPF_JGE, expr, next, floc, HIGH_WORD, NEVER);
     next = generate_cmp32(ctxt, BPF_JGT, expr, tloc, next, HIGH_WORD,
                           next > begin ? ALWAYS : NORMAL);
@@ -470,22 +531,237 @@ static int generate_equality(struct codegen_ctxt *ctxt, struct expr_tree *expr,
                              int tloc, int floc) {
   // TODO maybe compare low words first as they're more likely to differ
   int next = generate_cmp32(ctxt, BPF_JEQ, expr, tloc, floc, LOW_WORD, NORMAL);
-  if (is_64bit(expr)) {
+  if (is_wide(expr)) {
     next = generate_cmp32(ctxt, BPF_JEQ, expr, next, floc, HIGH_WORD, NORMAL);
   }
   return next;
 }
 
+#ifndef VALUE_SET_MIN
+#define VALUE_SET_MIN 4
+#endif
+
+struct value_range {
+  uint32_t first;
+  uint32_t last;
+  int loc;
+};
+
+// Jump tree dispatching the accumulator, known to be in [lo, hi], over
+// sorted disjoint ranges; values outside of all ranges go to floc
+static int generate_switch(struct codegen_ctxt *ctxt,
+                           const struct value_range *ranges, size_t len,
+                           uint32_t lo, uint32_t hi, int floc) {
+  ASSERT(ctxt != NULL);
+  ASSERT(len > 0);
+
+  if (len == 1) {
+    if (ranges->first == ranges->last && ranges->first > lo &&
+        ranges->last < hi) {
+      return add_jump(ctxt, BPF_K | BPF_JEQ, ranges->first, ranges->loc, floc);
+    }
+    int next = ranges->loc;
+    if (ranges->last < hi) {
+      next = add_jump_gt(ctxt, ranges->last, floc, next);
+    }
+    if (ranges->first > lo) {
+      next = add_jump_ge(ctxt, ranges->first, next, floc);
+    }
+    return next;
+  }
+
+  const struct value_range *mid = &ranges[len / 2];
+  int lower = generate_switch(ctxt, ranges, len / 2, lo, mid->first - 1, floc);
+  int upper = generate_switch(ctxt, mid, (len + 1) / 2, mid->first, hi, floc);
+  return add_jump_ge(ctxt, mid->first, upper, lower);
+}
+
+// Adjacent values are merged into ranges; returns number of ranges
+static size_t values_to_ranges(const uint64_t *values, size_t len, int loc,
+                               struct value_range *ranges) {
+  size_t count = 0;
+  for (size_t i = 0; i < len; ++i) {
+    uint32_t value = NUM_LOW(values[i]);
+    if (count > 0 && ranges[count - 1].last != UINT32_MAX &&
+        ranges[count - 1].last + 1 == value) {
+      ranges[count - 1].last = value;
+    } else {
+      ranges[count++] = (struct value_range){value, value, loc};
+    }
+  }
+  return count;
+}
+
+static int generate_word_switch(struct codegen_ctxt *ctxt, int var, int word,
+                                struct value_range *ranges, size_t len,
+                                int floc) {
+  int begin = CURRENT_LOC;
+  int next = generate_switch(ctxt, ranges, len, 0, UINT32_MAX, floc);
+  if (next > begin) {
+    next = ADD_INSTR(BPF_LOAD_ARG_WORD(var, word));
+  }
+  return next;
+}
+
+// Tests whether var equals any of sorted distinct values
+static int generate_value_set(struct codegen_ctxt *ctxt, int var, int size,
+                              const uint64_t *values, size_t len, int tloc,
+                              int floc) {
+  ASSERT(ctxt != NULL);
+  ASSERT(len > 0);
+
+  struct value_range *ranges = arena_alloc(ctxt->arena, len * sizeof(*ranges));
+  int next;
+  if (size != 8) {
+    size_t count = values_to_ranges(values, len, tloc, ranges);
+    next = generate_word_switch(ctxt, var, LOW_WORD, ranges, count, floc);
+  } else {
+    // one low word tree per distinct high word
+    struct value_range *groups =
+        arena_alloc(ctxt->arena, len * sizeof(*groups));
+    size_t groups_len = 0;
+    for (size_t i = 0; i < len;) {
+      size_t j = i + 1;
+      while (j < len && NUM_HIGH(values[j]) == NUM_HIGH(values[i])) {
+        ++j;
+      }
+      size_t count = values_to_ranges(&values[i], j - i, tloc, ranges);
+      int loc = generate_word_switch(ctxt, var, LOW_WORD, ranges, count, floc);
+      groups[groups_len++] = (struct value_range){
+          NUM_HIGH(values[i]), NUM_HIGH(values[i]), loc};
+      i = j;
+    }
+    next = generate_word_switch(ctxt, var, HIGH_WORD, groups, groups_len,
+                                floc);
+  }
+  return next;
+}
+
+static bool is_value_test(struct expr_tree *expr, int type) {
+  return expr->type == type && expr->left->type == EXPR_VAR &&
+         expr->right->type == EXPR_NUMBER &&
+         (expr->left->size == 8 || expr->right->number <= UINT32_MAX);
+}
+
+static size_t count_terms(struct expr_tree *expr, int type) {
+  if (expr->type != type) {
+    return 1;
+  }
+  return count_terms(expr->left, type) + count_terms(expr->right, type);
+}
+
+static void collect_terms(struct expr_tree *expr, int type,
+                          struct expr_tree ***terms) {
+  if (expr->type != type) {
+    *(*terms)++ = expr;
+    return;
+  }
+  collect_terms(expr->left, type, terms);
+  collect_terms(expr->right, type, terms);
+}
+
+static int compare_values(const void *lhs, const void *rhs) {
+  uint64_t a = *(const uint64_t *)lhs, b = *(const uint64_t *)rhs;
+  return a < b ? -1 : a > b;
+}
+
+static int generate_expr(struct codegen_ctxt *ctxt, struct expr_tree *expr,
+                         int tloc, int floc);
+
+// Disjunction of equality tests (conjunction of inequality tests) of the
+// same argument against constants is lowered to a jump tree over the
+// sorted constants rather than a linear chain; returns INVALID_LOCATION
+// if there are not enough such tests.
+static int generate_junction(struct codegen_ctxt *ctxt,
+                             struct expr_tree *expr, int tloc, int floc) {
+  ASSERT(ctxt != NULL);
+  ASSERT(expr != NULL);
+
+  int value_test = expr->type == EXPR_OR ? EXPR_EQ : EXPR_NEQ;
+  size_t len = count_terms(expr, expr->type);
+  if (len < VALUE_SET_MIN) {
+    return INVALID_LOCATION;
+  }
+
+  struct expr_tree **terms = arena_alloc(ctxt->arena, len * sizeof(*terms));
+  struct expr_tree **end = terms;
+  collect_terms(expr, expr->type, &end);
+
+  size_t tests[SYSCALL_MAX_ARGS] = {0};
+  bool lowered = false;
+  for (size_t i = 0; i < len; ++i) {
+    if (is_value_test(terms[i], value_test)) {
+      ASSERT(terms[i]->left->var < SYSCALL_MAX_ARGS);
+      lowered |= ++tests[terms[i]->left->var] >= VALUE_SET_MIN;
+    }
+  }
+  if (!lowered) {
+    return INVALID_LOCATION;
+  }
+
+  // the remaining terms are tested after value sets, in original order
+  int next = expr->type == EXPR_OR ? floc : tloc;
+  for (size_t i = len; i-- > 0;) {
+    struct expr_tree *term = terms[i];
+    if (is_value_test(term, value_test) &&
+        tests[term->left->var] >= VALUE_SET_MIN) {
+      continue;
+    }
+    if (expr->type == EXPR_OR) {
+      next = generate_expr(ctxt, term, tloc, next);
+    } else {
+      next = generate_expr(ctxt, term, next, floc);
+    }
+  }
+
+  uint64_t *values = arena_alloc(ctxt->arena, len * sizeof(*values));
+  for (int var = SYSCALL_MAX_ARGS - 1; var >= 0; --var) {
+    if (tests[var] < VALUE_SET_MIN) {
+      continue;
+    }
+    size_t count = 0;
+    int size = 0;
+    for (size_t i = 0; i < len; ++i) {
+      if (is_value_test(terms[i], value_test) && terms[i]->left->var == var) {
+        values[count++] = terms[i]->right->number;
+        size = terms[i]->left->size;
+      }
+    }
+    qsort(values, count, sizeof(*values), compare_values);
+    size_t unique = 1;
+    for (size_t i = 1; i < count; ++i) {
+      if (values[i] != values[unique - 1]) {
+        values[unique++] = values[i];
+      }
+    }
+    if (expr->type == EXPR_OR) {
+      next = generate_value_set(ctxt, var, size, values, unique, tloc, next);
+    } else {
+      next = generate_value_set(ctxt, var, size, values, unique, floc, next);
+    }
+  }
+  return next;
+}
+
 static int generate_expr(struct codegen_ctxt *ctxt, struct expr_tree *expr,
                          int tloc, int floc) {
   ASSERT(ctxt != NULL);
   ASSERT(expr != NULL);
 
+  int next;
   switch (expr->type) {
     case EXPR_AND:
+      next = generate_junction(ctxt, expr, tloc, floc);
+      if (next != INVALID_LOCATION) {
+        return next;
+      }
       tloc = generate_expr(ctxt, expr->right, tloc, floc);
       return generate_expr(ctxt, expr->left, tloc, floc);
     case EXPR_OR:
+      next = generate_junction(ctxt, expr, tloc, floc);
+      if (next != INVALID_LOCATION) {
+        return next;
+      }
       floc = generate_expr(ctxt, expr->right, tloc, floc);
       return generate_expr(ctxt, expr->left, tloc, floc);
     case EXPR_LE:
@@ -517,7 +793,18 @@ static int generate_action(struct codegen_ctxt *ctxt,
     return -rule->action;
   }
 
+  // Same action whatever the arguments: no argument loads, so that the
+  // kernel can tell the result is constant (seccomp action cache)
   struct expression_to_action *mapping;
+  int action = TAILQ_FIRST(&rule->expr_list)->action;
+  bool constant = true;
+  TAILQ_FOREACH(mapping, &rule->expr_list, list) {
+    constant &= mapping->action == action;
+  }
+  if (constant) {
+    return -action;
+  }
+
   int last_loc = INVALID_LOCATION;
   TAILQ_FOREACH_REVERSE(mapping, &rule->expr_list, expression_to_action_list,
                         list) {
@@ -532,19 +819,84 @@ static int generate_action(struct codegen_ctxt *ctxt,
   return last_loc;
 }
 
+struct weighted_rule {
+  struct syscall_range_rule *rule;
+  uint64_t weight;
+};
+
+// Each rule weighs 1 plus its profile weight scaled by the number of rules,
+// i.e. a rule seen in the profile outweighs all unseen rules together.
+// Without a profile all weights are equal and the tree is balanced.
+static struct weighted_rule *weigh_rules(struct kafel_ctxt *kafel_ctxt,
+                                         struct syscall_range_rules *rules) {
+  struct weighted_rule *weighted =
+      arena_alloc(&kafel_ctxt->arena, rules->len * sizeof(*weighted));
+  for (size_t i = 0; i < rules->len; ++i) {
+    struct syscall_range_rule *rule = &rules->data[i];
+    uint64_t weight = 0;
+    for (size_t j = 0; j < kafel_ctxt->profile.len; ++j) {
+      uint32_t nr = kafel_ctxt->profile.data[j].nr;
+      if (nr >= rule->first && nr <= rule->last) {
+        weight += kafel_ctxt->profile.data[j].weight;
+      }
+    }
+    weighted[i].rule = rule;
+    weighted[i].weight = weight * rules->len + 1;
+  }
+  return weighted;
+}
+
+// Builds the syscall dispatch tree. A single syscall carrying at least half
+// of the weight is checked first with JEQ (and dropped from the rest of the
+// tree); otherwise the rules are split with JGE so that both halves weigh
+// about the same, preferring the middle among equally good splits.
+// Reorders rules.
 static int generate_rules(struct codegen_ctxt *ctxt,
-                          struct syscall_range_rule *rules, size_t len) {
+                          struct weighted_rule *rules, size_t len) {
   ASSERT(ctxt != NULL);
   ASSERT(len > 0);
 
   if (len == 1) {
-    return generate_action(ctxt, rules);
+    return generate_action(ctxt, rules->rule);
+  }
+
+  uint64_t total = 0;
+  size_t hottest = 0;
+  for (size_t i = 0; i < len; ++i) {
+    total += rules[i].weight;
+    if (rules[i].weight > rules[hottest].weight) {
+      hottest = i;
+    }
+  }
+
+  struct syscall_range_rule *hot = rules[hottest].rule;
+  if (len > 2 && hot->first == hot->last &&
+      rules[hottest].weight * 2 >= total) {
+    memmove(&rules[hottest], &rules[hottest + 1],
+            (len - hottest - 1) * sizeof(*rules));
+    int rest = generate_rules(ctxt, rules, len - 1);
+    int action = generate_action(ctxt, hot);
+    return add_jump(ctxt, BPF_JEQ, hot->first, action, rest);
+  }
+
+  size_t split = len / 2;
+  uint64_t best = UINT64_MAX, prefix = 0;
+  for (size_t i = 1; i < len; ++i) {
+    prefix += rules[i - 1].weight;
+    uint64_t imbalance =
+        prefix * 2 > total ? prefix * 2 - total : total - prefix * 2;
+    size_t distance = i > len / 2 ? i - len / 2 : len / 2 - i;
+    size_t best_distance = split > len / 2 ? split - len / 2 : len / 2 - split;
+    if (imbalance < best || (imbalance == best && distance < best_distance)) {
+      best = imbalance;
+      split = i;
+    }
   }
 
-  struct syscall_range_rule *mid = &rules[len / 2];
-  int lower = generate_rules(ctxt, rules, len / 2);
-  int upper = generate_rules(ctxt, mid, (len + 1) / 2);
-  return add_jump(ctxt, BPF_JGE, mid->first, upper, lower);
+  uint32_t first = rules[split].rule->first;
+  int lower = generate_rules(ctxt, rules, split);
+  int upper = generate_rules(ctxt, &rules[split], len - split);
+  return add_jump(ctxt, BPF_JGE, first, upper, lower);
 }
 
 static void reverse_instruction_buffer(struct codegen_ctxt *ctxt) {
@@ -561,19 +913,20 @@ int compile_policy(struct kafel_ctxt *kafel_ctxt, struct sock_fprog *prog) {
   ASSERT(prog != NULL);
 
   if (kafel_ctxt->main_policy == NULL) {
-    kafel_ctxt->main_policy = policy_create("@main", NULL);
+    kafel_ctxt->main_policy =
+        policy_create(&kafel_ctxt->arena, "@main", NULL);
   }
   if (kafel_ctxt->default_action == 0) {
     kafel_ctxt->default_action = ACTION_KILL;
   }
 
-  struct codegen_ctxt *ctxt = context_create();
-  struct syscall_range_rules *rules = range_rules_create();
+  struct codegen_ctxt *ctxt = context_create(&kafel_ctxt->arena);
+  struct syscall_range_rules *rules = range_rules_create(&kafel_ctxt->arena);
   add_policy_rules(rules, kafel_ctxt->main_policy);
   normalize_rules(rules, kafel_ctxt->default_action);
+  struct weighted_rule *weighted = weigh_rules(kafel_ctxt, rules);
   int begin = CURRENT_LOC;
-  int next = generate_rules(ctxt, rules->data, rules->len);
-  range_rules_destroy(&rules);
+  int next = generate_rules(ctxt, weighted, rules->len);
   if (next > begin) {
     begin = next = ADD_INSTR(BPF_LOAD_SYSCALL);
   } else {
@@ -587,9 +940,23 @@ int compile_policy(struct kafel_ctxt *kafel_ctxt, struct sock_fprog *prog) {
     resolve_location(ctxt, next);
   }
   reverse_instruction_buffer(ctxt);
-  *prog = ((struct sock_fprog){.filter = ctxt->buffer.data,
-                               .len = ctxt->buffer.len});
-  ctxt->buffer.data = NULL;
-  context_destroy(&ctxt);
+  for (size_t i = 0; i < ctxt->relocs.len; ++i) {
+    struct kafel_reloc *reloc = &ctxt->relocs.data[i];
+    reloc->insn = ctxt->buffer.len - 1 - reloc->insn;
+  }
+  if (kafel_ctxt->peephole) {
+    peephole_optimize(ctxt->arena, ctxt->buffer.data, &ctxt->buffer.len,
+                      ctxt->relocs.data, &ctxt->relocs.len);
+  }
+  size_t bytes = ctxt->buffer.len * sizeof(*ctxt->buffer.data);
+  struct sock_filter *filter = malloc(bytes);
+  if (filter == NULL) {
+    append_error(kafel_ctxt, "Out of memory");
+    return -1;
+  }
+  memcpy(filter, ctxt->buffer.data, bytes);
+  *prog = ((struct sock_fprog){.filter = filter, .len = ctxt->buffer.len});
+  kafel_ctxt->relocs.data = ctxt->relocs.data;
+  kafel_ctxt->relocs.len = ctxt->relocs.len;
   return 0;
 }
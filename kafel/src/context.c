@@ -31,51 +31,46 @@
 
 KAFEL_API kafel_ctxt_t kafel_ctxt_create(void) {
   struct kafel_ctxt* ctxt = calloc(1, sizeof(*ctxt));
+  arena_init(&ctxt->arena);
   includes_ctxt_init(&ctxt->includes_ctxt);
   TAILQ_INIT(&ctxt->policies);
   TAILQ_INIT(&ctxt->constants);
   ctxt->target_arch = KAFEL_DEFAULT_TARGET_ARCH;
+  ctxt->peephole = true;
   return ctxt;
 }
 
-static void clean_policies(kafel_ctxt_t ctxt) {
-  while (!TAILQ_EMPTY(&ctxt->policies)) {
-    struct policy* policy = TAILQ_FIRST(&ctxt->policies);
-    TAILQ_REMOVE(&ctxt->policies, policy, policies);
-    policy_destroy(&policy);
-  }
-}
-
-static void clean_constants(kafel_ctxt_t ctxt) {
-  while (!TAILQ_EMPTY(&ctxt->constants)) {
-    struct kafel_constant* constant = TAILQ_FIRST(&ctxt->constants);
-    TAILQ_REMOVE(&ctxt->constants, constant, constants);
-    free(constant->name);
-    free(constant);
-  }
-}
-
-void kafel_ctxt_reset(kafel_ctxt_t ctxt) {
+KAFEL_API void kafel_ctxt_reset(kafel_ctxt_t ctxt) {
   ASSERT(ctxt != NULL);
 
+  // Everything below lives in the arena, dropping the references is enough
   clean_args(ctxt);
-  clean_policies(ctxt);
-  clean_constants(ctxt);
-  free(ctxt->errors.data);
-  ctxt->errors.capacity = 0;
-  ctxt->errors.len = 0;
-  ctxt->errors.data = NULL;
-  if (ctxt->main_policy) {
-    policy_destroy(&ctxt->main_policy);
-  }
+  TAILQ_INIT(&ctxt->policies);
+  TAILQ_INIT(&ctxt->constants);
+  ctxt->params.names = NULL;
+  ctxt->params.len = 0;
+  ctxt->params.capacity = 0;
+  ctxt->relocs.data = NULL;
+  ctxt->relocs.len = 0;
+  ctxt->main_policy = NULL;
   ctxt->default_action = 0;
   ctxt->lexical_error = false;
+  arena_reset(&ctxt->arena);
+  // The error buffer is kept for reuse
+  ctxt->errors.len = 0;
+  if (ctxt->errors.data != NULL) {
+    ctxt->errors.data[0] = '\0';
+  }
 }
 
 void kafel_ctxt_clean(kafel_ctxt_t ctxt) {
   ASSERT(ctxt != NULL);
 
   kafel_ctxt_reset(ctxt);
+  arena_clean(&ctxt->arena);
+  free(ctxt->errors.data);
+  ctxt->errors.capacity = 0;
+  ctxt->errors.data = NULL;
   includes_ctxt_clean(&ctxt->includes_ctxt);
 }
 
@@ -100,7 +95,6 @@ void register_policy(struct kafel_ctxt* ctxt, struct policy* policy) {
 
 void clean_args(struct kafel_ctxt* ctxt) {
   for (int i = 0; i < ctxt->syscall.args_num; ++i) {
-    free((char*)ctxt->syscall.args[i].name);
     ctxt->syscall.args[i].name = NULL;
   }
   ctxt->syscall.args_num = 0;
@@ -116,7 +110,8 @@ int register_arg(struct kafel_ctxt* ctxt, const char* name, int size) {
     return -1;
   }
   ctxt->syscall.args[ctxt->syscall.args_num++] =
-      ((struct syscall_arg){.name = strdup(name), .size = size});
+      ((struct syscall_arg){.name = arena_strdup(&ctxt->arena, name),
+                            .size = size});
   return 0;
 }
 
@@ -216,8 +211,9 @@ int append_error(struct kafel_ctxt* ctxt, const char* fmt, ...) {
 }
 
 void register_const(struct kafel_ctxt* ctxt, const char* name, uint64_t value) {
-  struct kafel_constant* constant = calloc(1, sizeof(*constant));
-  constant->name = strdup(name);
+  struct kafel_constant* constant =
+      arena_alloc(&ctxt->arena, sizeof(*constant));
+  constant->name = arena_strdup(&ctxt->arena, name);
   constant->value = value;
   TAILQ_INSERT_TAIL(&ctxt->constants, constant, constants);
 }
@@ -234,3 +230,22 @@ int lookup_const(struct kafel_ctxt* ctxt, const char* name, uint64_t* value) {
   }
   return -1;
 }
+
+int register_param(struct kafel_ctxt* ctxt, const char* name) {
+  for (size_t i = 0; i < ctxt->params.len; ++i) {
+    if (strcmp(name, ctxt->params.names[i]) == 0) {
+      return i;
+    }
+  }
+  if (ctxt->params.len == ctxt->params.capacity) {
+    size_t oldcapacity = ctxt->params.capacity;
+    size_t newcapacity = oldcapacity ? oldcapacity * 2 : 4;
+    ctxt->params.names = arena_grow(
+        &ctxt->arena, ctxt->params.names,
+        oldcapacity * sizeof(*ctxt->params.names),
+        newcapacity * sizeof(*ctxt->params.names));
+    ctxt->params.capacity = newcapacity;
+  }
+  ctxt->params.names[ctxt->params.len] = arena_strdup(&ctxt->arena, name);
+  return ctxt->params.len++;
+}
@@ -26,7 +26,9 @@
 #include <stdint.h>
 #include <stdio.h>
 
+#include "arena.h"
 #include "includes.h"
+#include "kafel.h"
 #include "policy.h"
 #include "syscall.h"
 
@@ -37,6 +39,7 @@ struct kafel_constant {
 };
 
 struct kafel_ctxt {
+  struct arena arena;
   struct {
     int args_num;
     struct syscall_arg args[SYSCALL_MAX_ARGS];
@@ -47,6 +50,11 @@ struct kafel_ctxt {
   int default_action;
   uint32_t target_arch;
   uint32_t target_arch_mask;
+  bool peephole;
+  struct {
+    const struct kafel_syscall_weight* data;
+    size_t len;
+  } profile;
   struct {
     enum {
       INPUT_NONE,
@@ -58,6 +66,15 @@ struct kafel_ctxt {
       const char* string;
     };
   } input;
+  struct {
+    char** names;
+    size_t len;
+    size_t capacity;
+  } params;
+  struct {
+    struct kafel_reloc* data;
+    size_t len;
+  } relocs;
   bool lexical_error;
   struct {
     char* data;
@@ -68,7 +85,6 @@ struct kafel_ctxt {
 };
 
 void kafel_ctxt_clean(struct kafel_ctxt* ctxt);
-void kafel_ctxt_reset(struct kafel_ctxt* ctxt);
 
 void register_policy(struct kafel_ctxt* ctxt, struct policy* policy);
 void clean_args(struct kafel_ctxt* ctxt);
@@ -79,6 +95,7 @@ void register_ftrace_args(struct kafel_ctxt* ctxt,
 int lookup_var(struct kafel_ctxt* ctxt, const char* name);
 void register_const(struct kafel_ctxt* ctxt, const char* name, uint64_t value);
 int lookup_const(struct kafel_ctxt* ctxt, const char* name, uint64_t* value);
+int register_param(struct kafel_ctxt* ctxt, const char* name);
 struct policy* lookup_policy(struct kafel_ctxt* ctxt, const char* name);
 
 int append_error(struct kafel_ctxt* ctxt, const char* fmt, ...);
@@ -24,43 +24,52 @@
 
 #include "common.h"
 
-struct expr_tree *expr_create_number(uint64_t value) {
-  struct expr_tree *rv = calloc(1, sizeof(*rv));
+struct expr_tree *expr_create_number(struct arena *arena, uint64_t value) {
+  struct expr_tree *rv = arena_alloc(arena, sizeof(*rv));
   rv->type = EXPR_NUMBER;
   rv->number = value;
   return rv;
 }
 
-struct expr_tree *expr_create_var(int var, int size) {
+struct expr_tree *expr_create_param(struct arena *arena, int param) {
+  struct expr_tree *rv = arena_alloc(arena, sizeof(*rv));
+  rv->type = EXPR_PARAM;
+  rv->param = param;
+  return rv;
+}
+
+struct expr_tree *expr_create_var(struct arena *arena, int var, int size) {
   if (size == 2) {  // TODO fully support 16-bit arguments
     size = 4;
   }
   ASSERT(size == 4 || size == 8);  // 32- or 64-bit
 
-  struct expr_tree *rv = calloc(1, sizeof(*rv));
+  struct expr_tree *rv = arena_alloc(arena, sizeof(*rv));
   rv->type = EXPR_VAR;
   rv->var = var;
   rv->size = size;
   return rv;
 }
 
-struct expr_tree *expr_create_unary(int op, struct expr_tree *child) {
+struct expr_tree *expr_create_unary(struct arena *arena, int op,
+                                    struct expr_tree *child) {
   ASSERT(op >= EXPR_UNARY_MIN && op <= EXPR_UNARY_MAX);
   ASSERT(child != NULL);
 
-  struct expr_tree *rv = calloc(1, sizeof(*rv));
+  struct expr_tree *rv = arena_alloc(arena, sizeof(*rv));
   rv->type = op;
   rv->child = child;
   return rv;
 }
 
-struct expr_tree *expr_create_binary(int op, struct expr_tree *left,
+struct expr_tree *expr_create_binary(struct arena *arena, int op,
+                                     struct expr_tree *left,
                                      struct expr_tree *right) {
   ASSERT(op >= EXPR_BINARY_MIN && op <= EXPR_BINARY_MAX);
   ASSERT(left != NULL);
   ASSERT(right != NULL);
 
-  struct expr_tree *rv = calloc(1, sizeof(*rv));
+  struct expr_tree *rv = arena_alloc(arena, sizeof(*rv));
   rv->type = op;
   rv->left = left;
   rv->right = right;
@@ -79,13 +88,10 @@ void expr_eliminate_negation(struct expr_tree **expr, bool neg) {
       [EXPR_EQ] = EXPR_NEQ,    [EXPR_NEQ] = EXPR_EQ, [EXPR_TRUE] = EXPR_FALSE,
       [EXPR_FALSE] = EXPR_TRUE};
   switch ((*expr)->type) {
-    case EXPR_NOT: {
-      struct expr_tree *tmp = *expr;
+    case EXPR_NOT:
       *expr = (*expr)->child;
-      free(tmp);
       expr_eliminate_negation(expr, !neg);
       return;
-    }
     case EXPR_AND:
     case EXPR_OR:
       expr_eliminate_negation(&(*expr)->left, neg);
@@ -159,20 +165,14 @@ static void expr_precompute_eliminate(struct expr_tree **expr) {
     expr_precompute_eliminate(&(*expr)->right);
   }
 
-  struct expr_tree *original_expr = *expr;
-
   if ((*expr)->left->type == EXPR_NUMBER &&
       (*expr)->right->type == EXPR_NUMBER) {
     if ((*expr)->type == EXPR_BIT_AND) {
       (*expr)->left->number &= (*expr)->right->number;
-      expr_destroy(&(*expr)->right);
       *expr = (*expr)->left;
-      free(original_expr);
     } else {
       (*expr)->type = expr_eval((*expr)->type, (*expr)->left->number,
                                 (*expr)->right->number);
-      expr_destroy(&(*expr)->left);
-      expr_destroy(&(*expr)->right);
     }
   }
 
@@ -185,17 +185,11 @@ static void expr_precompute_eliminate(struct expr_tree **expr) {
     // fall-through
     case EXPR_OR:
       if ((*expr)->left->type == dominant || (*expr)->right->type == dominant) {
-        expr_destroy(&(*expr)->left);
-        expr_destroy(&(*expr)->right);
         (*expr)->type = dominant;
       } else if ((*expr)->left->type == recessive) {
-        expr_destroy(&(*expr)->left);
         *expr = (*expr)->right;
-        free(original_expr);
       } else if ((*expr)->right->type == recessive) {
-        expr_destroy(&(*expr)->right);
         *expr = (*expr)->left;
-        free(original_expr);
       }
       break;
     case EXPR_GT:
@@ -209,21 +203,15 @@ static void expr_precompute_eliminate(struct expr_tree **expr) {
       if ((*expr)->left->type == EXPR_VAR && (*expr)->right->type == EXPR_VAR &&
           (*expr)->left->var == (*expr)->right->var) {
         (*expr)->type = eq_vars_result;
-        expr_destroy(&(*expr)->left);
-        expr_destroy(&(*expr)->right);
       }
       break;
     case EXPR_BIT_AND:
       if ((*expr)->right->type == EXPR_NUMBER) {
         if ((*expr)->right->number == 0) {
-          expr_destroy(&(*expr)->left);
-          expr_destroy(&(*expr)->right);
           (*expr)->type = EXPR_NUMBER;
           (*expr)->number = 0;
         } else if ((*expr)->right->number == UINT64_MAX) {
-          expr_destroy(&(*expr)->right);
           *expr = (*expr)->left;
-          free(original_expr);
         }
       }
       break;
@@ -235,18 +223,3 @@ void expr_simplify(struct expr_tree **expr) {
   expr_sort_operands(*expr);
   expr_precompute_eliminate(expr);
 }
-
-void expr_destroy(struct expr_tree **expr) {
-  ASSERT(expr != NULL);
-  ASSERT((*expr) != NULL);
-
-  if ((*expr)->type >= EXPR_BINARY_MIN && (*expr)->type <= EXPR_BINARY_MAX) {
-    expr_destroy(&(*expr)->left);
-    expr_destroy(&(*expr)->right);
-  } else if ((*expr)->type >= EXPR_UNARY_MIN &&
-             (*expr)->type <= EXPR_UNARY_MAX) {
-    expr_destroy(&(*expr)->child);
-  }
-  free(*expr);
-  *expr = NULL;
-}
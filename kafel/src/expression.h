@@ -24,9 +24,12 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "arena.h"
+
 enum {
   EXPR_LEAF_MIN,
   EXPR_NUMBER = EXPR_LEAF_MIN,
+  EXPR_PARAM,
   EXPR_VAR,
   EXPR_TRUE,
   EXPR_FALSE,
@@ -56,6 +59,7 @@ struct expr_tree {
       int size;
     };
     uint64_t number;
+    int param;
     struct expr_tree *child;
     struct {
       struct expr_tree *left;
@@ -64,14 +68,16 @@ struct expr_tree {
   };
 };
 
-struct expr_tree *expr_create_number(uint64_t value);
-struct expr_tree *expr_create_var(int var, int size);
-struct expr_tree *expr_create_unary(int op, struct expr_tree *child);
-struct expr_tree *expr_create_binary(int op, struct expr_tree *left,
+struct expr_tree *expr_create_number(struct arena *arena, uint64_t value);
+struct expr_tree *expr_create_param(struct arena *arena, int param);
+struct expr_tree *expr_create_var(struct arena *arena, int var, int size);
+struct expr_tree *expr_create_unary(struct arena *arena, int op,
+                                    struct expr_tree *child);
+struct expr_tree *expr_create_binary(struct arena *arena, int op,
+                                     struct expr_tree *left,
                                      struct expr_tree *right);
 void expr_negate(struct expr_tree **expr);
 void expr_eliminate_negation(struct expr_tree **expr, bool neg);
 void expr_simplify(struct expr_tree **expr);
-void expr_destroy(struct expr_tree **expr);
 
 #endif /* KAFEL_EXPRESSION_H */
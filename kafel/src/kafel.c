@@ -20,6 +20,8 @@
 
 #include "kafel.h"
 
+#include <stdlib.h>
+
 #include "codegen.h"
 #include "common.h"
 #include "context.h"
@@ -101,6 +103,54 @@ KAFEL_API void kafel_set_target_arch(kafel_ctxt_t ctxt, uint32_t target_arch) {
   ctxt->target_arch = target_arch;
 }
 
+KAFEL_API void kafel_set_syscall_profile(
+    kafel_ctxt_t ctxt, const struct kafel_syscall_weight* profile, size_t len) {
+  ASSERT(ctxt != NULL);
+  ASSERT(profile != NULL || len == 0);
+
+  ctxt->profile.data = profile;
+  ctxt->profile.len = profile ? len : 0;
+}
+
+KAFEL_API int kafel_read_syscall_profile(FILE* file,
+                                         struct kafel_syscall_weight** profile,
+                                         size_t* len) {
+  ASSERT(file != NULL);
+  ASSERT(profile != NULL);
+  ASSERT(len != NULL);
+
+  struct kafel_syscall_weight* data = NULL;
+  size_t count = 0, capacity = 0;
+  unsigned nr, weight;
+  int rv;
+  while ((rv = fscanf(file, "%u %u", &nr, &weight)) == 2) {
+    if (count == capacity) {
+      capacity = capacity ? capacity * 2 : 64;
+      struct kafel_syscall_weight* grown =
+          realloc(data, capacity * sizeof(*data));
+      if (grown == NULL) {
+        free(data);
+        return -1;
+      }
+      data = grown;
+    }
+    data[count++] = (struct kafel_syscall_weight){nr, weight};
+  }
+  if (rv != EOF || ferror(file)) {
+    free(data);
+    return -1;
+  }
+  *profile = data;
+  *len = count;
+  return 0;
+}
+
+KAFEL_API void kafel_set_peephole(kafel_ctxt_t ctxt, int enabled) {
+  ASSERT(ctxt != NULL);
+
+  ctxt->peephole = enabled;
+}
+
 KAFEL_API void kafel_add_include_search_path(kafel_ctxt_t ctxt,
                                              const char* path) {
   ASSERT(ctxt != NULL);
@@ -124,6 +174,18 @@ KAFEL_API int kafel_compile(kafel_ctxt_t ctxt, struct sock_fprog* prog) {
   return compile_policy(ctxt, prog);
 }
 
+// Parameters can't be patched in once the context is gone
+static int compile_unparameterized(kafel_ctxt_t ctxt, struct sock_fprog* prog) {
+  int rv = kafel_compile(ctxt, prog);
+  if (rv == 0 && ctxt->params.len > 0) {
+    free(prog->filter);
+    prog->filter = NULL;
+    prog->len = 0;
+    return -1;
+  }
+  return rv;
+}
+
 KAFEL_API int kafel_compile_file(FILE* file, struct sock_fprog* prog) {
   if (file == NULL || prog == NULL) {
     errno = EINVAL;
@@ -133,7 +195,7 @@ KAFEL_API int kafel_compile_file(FILE* file, struct sock_fprog* prog) {
   kafel_ctxt_t ctxt = kafel_ctxt_create();
   kafel_set_input_file(ctxt, file);
 
-  int rv = kafel_compile(ctxt, prog);
+  int rv = compile_unparameterized(ctxt, prog);
   kafel_ctxt_destroy(&ctxt);
   return rv;
 }
@@ -148,7 +210,41 @@ KAFEL_API int kafel_compile_string(const char* source,
   kafel_ctxt_t ctxt = kafel_ctxt_create();
   kafel_set_input_string(ctxt, source);
 
-  int rv = kafel_compile(ctxt, prog);
+  int rv = compile_unparameterized(ctxt, prog);
   kafel_ctxt_destroy(&ctxt);
   return rv;
 }
+
+KAFEL_API size_t kafel_param_count(const kafel_ctxt_t ctxt) {
+  ASSERT(ctxt != NULL);
+
+  return ctxt->params.len;
+}
+
+KAFEL_API const char* kafel_param_name(const kafel_ctxt_t ctxt, size_t param) {
+  ASSERT(ctxt != NULL);
+  ASSERT(param < ctxt->params.len);
+
+  return ctxt->params.names[param];
+}
+
+KAFEL_API const struct kafel_reloc* kafel_relocs(const kafel_ctxt_t ctxt,
+                                                 size_t* len) {
+  ASSERT(ctxt != NULL);
+  ASSERT(len != NULL);
+
+  *len = ctxt->relocs.len;
+  return ctxt->relocs.data;
+}
+
+KAFEL_API void kafel_apply_relocs(struct sock_fprog* prog,
+                                  const struct kafel_reloc* relocs, size_t len,
+                                  const uint64_t* values) {
+  ASSERT(prog != NULL);
+  ASSERT(relocs != NULL || len == 0);
+
+  for (size_t i = 0; i < len; ++i) {
+    ASSERT(relocs[i].insn < prog->len);
+    prog->filter[relocs[i].insn].k = values[relocs[i].param] >> relocs[i].shift;
+  }
+}
@@ -122,14 +122,14 @@ YY_DECL;
 }
 
 %token BIT_AND BIT_OR LOGIC_OR LOGIC_AND
-%token IDENTIFIER NUMBER
+%token IDENTIFIER NUMBER PARAM
 
 %token POLICY USE DEFAULT SYSCALL DEFINE
 %token ALLOW LOG KILL KILL_PROCESS DENY ERRNO TRAP TRACE USER_NOTIF
 
 %token GT LT GE LE EQ NEQ
 
-%type <id> IDENTIFIER
+%type <id> IDENTIFIER PARAM
 %type <number> NUMBER
 
 %type <policy> policy
@@ -144,15 +144,6 @@ YY_DECL;
 %type <expr> bool_expr or_bool_expr and_bool_expr primary_bool_expr masked_op
 %type <expr> operand
 
-%destructor { policy_destroy(&$$); } <policy>
-%destructor { policy_entry_destroy(&$$); } <entry>
-%destructor { policy_entries_destroy(&$$); } <entries>
-%destructor { syscall_filter_destroy(&$$); } <filter>
-%destructor { syscall_filters_destroy(&$$); } <filters>
-%destructor { syscall_descriptor_destroy(&$$); } <syscall_desc>
-%destructor { expr_destroy(&$$); } <expr>
-%destructor { free($$); } <id>
-
 %initial-action
 {
     @$.filename = NULL;
@@ -175,7 +166,6 @@ program_stmt
         {
           if (lookup_policy(ctxt, $1->name) != NULL) {
               emit_error(@1, "Redefinition of policy `%s'", $1->name);
-              policy_destroy(&$1);
               YYERROR;
           }
           register_policy(ctxt, $1);
@@ -183,7 +173,7 @@ program_stmt
     | policy_statements
         {
           if (ctxt->main_policy == NULL) {
-            ctxt->main_policy = policy_create("@main", &$1);
+            ctxt->main_policy = policy_create(&ctxt->arena, "@main", &$1);
           } else {
             TAILQ_CONCAT(&ctxt->main_policy->entries, &$1, entries);
           }
@@ -199,11 +189,10 @@ program_stmt
     ;
 
 policy
-    : POLICY IDENTIFIER '{' '}' { $$ = policy_create($2, NULL); free($2); }
+    : POLICY IDENTIFIER '{' '}' { $$ = policy_create(&ctxt->arena, $2, NULL); }
     | POLICY IDENTIFIER '{' policy_statements '}'
         {
-          $$ = policy_create($2, &$4);
-          free($2);
+          $$ = policy_create(&ctxt->arena, $2, &$4);
         }
     ;
 
@@ -228,17 +217,16 @@ use_statement
             struct policy* used = lookup_policy(ctxt, $2);
             if (used == NULL) {
                 emit_error(@2, "Undefined policy `%s'", $2);
-                free($2); $2 = NULL;
                 YYERROR;
             }
-            $$ = policy_use_create(used);
-            free($2);
+            $$ = policy_use_create(&ctxt->arena, used);
         }
     ;
 
 action_block
-    : action '{' '}' { $$ = policy_action_create($1, NULL); }
-    | action '{' syscall_filters '}' { $$ = policy_action_create($1, &$3); }
+    : action '{' '}' { $$ = policy_action_create(&ctxt->arena, $1, NULL); }
+    | action '{' syscall_filters '}'
+        { $$ = policy_action_create(&ctxt->arena, $1, &$3); }
     ;
 
 action
@@ -285,9 +273,10 @@ syscall_filters
     ;
 
 syscall_filter
-    : syscall { $$ = syscall_filter_create($1, NULL); }
-    | syscall '{' '}' { $$ = syscall_filter_create($1, NULL); }
-    | syscall '{' bool_expr '}' { $$ = syscall_filter_create($1, $3); }
+    : syscall { $$ = syscall_filter_create(&ctxt->arena, $1, NULL); }
+    | syscall '{' '}' { $$ = syscall_filter_create(&ctxt->arena, $1, NULL); }
+    | syscall '{' bool_expr '}'
+        { $$ = syscall_filter_create(&ctxt->arena, $1, $3); }
     ;
 
 syscall_id
@@ -295,21 +284,20 @@ syscall_id
         {
             uint64_t value = 0;
             if (lookup_const(ctxt, $1, &value) == 0) {
-                $$ = syscall_custom(value);
+                $$ = syscall_custom(&ctxt->arena, value);
             } else {
                 $$ = (struct syscall_descriptor*)
-                        syscall_lookup(ctxt->target_arch_mask, $1);
+                        syscall_lookup(&ctxt->arena, ctxt->target_arch_mask,
+                                       $1);
                     if ($$ == NULL) {
                     emit_error(@1, "Undefined syscall `%s'", $1);
-                    free($1); $1 = NULL;
                     YYERROR;
                 }
             }
-            free($1);
         }
     | SYSCALL '[' NUMBER ']'
         {
-            $$ = syscall_custom($3);
+            $$ = syscall_custom(&ctxt->arena, $3);
         }
     ;
 
@@ -318,13 +306,11 @@ syscall
         {
           $$ = $1->nr;
           register_ftrace_args(ctxt, $1);
-          syscall_descriptor_destroy(&$1);
         }
     | syscall_id '(' ')'
         {
           $$ = $1->nr;
           clean_args(ctxt);
-          syscall_descriptor_destroy(&$1);
         }
     | syscall_id '(' syscall_args ')'
         {
@@ -337,7 +323,6 @@ syscall
               }
             }
           }
-          syscall_descriptor_destroy(&$1);
         }
     ;
 
@@ -345,75 +330,83 @@ syscall_args
     : IDENTIFIER
         {
           register_first_arg(ctxt, $1, INVALID_ARG_SIZE);
-          free($1);
         }
     | syscall_args ',' IDENTIFIER
         {
           if (lookup_var(ctxt, $3) >= 0) {
             emit_error(@3, "Redefinition of argument `%s'", $3);
-            free($3); $3 = NULL;
             YYERROR;
           }
           if (register_arg(ctxt, $3, INVALID_ARG_SIZE)) {
             emit_error(@3, "Too many arguments defined for syscall");
-            free($3); $3 = NULL;
             YYERROR;
           }
-          free($3);
         }
     ;
 
 bool_expr
-    : bool_expr ',' or_bool_expr { $$ = expr_create_binary(EXPR_OR, $1, $3); }
+    : bool_expr ',' or_bool_expr
+        { $$ = expr_create_binary(&ctxt->arena, EXPR_OR, $1, $3); }
     | or_bool_expr { $$ = $1; }
     ;
 
 or_bool_expr
     : or_bool_expr LOGIC_OR and_bool_expr
-        { $$ = expr_create_binary(EXPR_OR, $1, $3); }
+        { $$ = expr_create_binary(&ctxt->arena, EXPR_OR, $1, $3); }
     | and_bool_expr { $$ = $1; }
     ;
 
 and_bool_expr
     : and_bool_expr LOGIC_AND primary_bool_expr
-        { $$ = expr_create_binary(EXPR_AND, $1, $3); }
+        { $$ = expr_create_binary(&ctxt->arena, EXPR_AND, $1, $3); }
     | primary_bool_expr { $$ = $1; }
     ;
 
 primary_bool_expr
     : '(' bool_expr ')' { $$ = $2; }
-    | '!' primary_bool_expr { $$ = expr_create_unary(EXPR_NOT, $2); }
-    | masked_op GT masked_op { $$ = expr_create_binary(EXPR_GT, $1, $3); }
-    | masked_op LT masked_op { $$ = expr_create_binary(EXPR_LT, $1, $3); }
-    | masked_op GE masked_op { $$ = expr_create_binary(EXPR_GE, $1, $3); }
-    | masked_op LE masked_op { $$ = expr_create_binary(EXPR_LE, $1, $3); }
-    | masked_op EQ masked_op { $$ = expr_create_binary(EXPR_EQ, $1, $3); }
-    | masked_op NEQ masked_op { $$ = expr_create_binary(EXPR_NEQ, $1, $3); }
+    | '!' primary_bool_expr
+        { $$ = expr_create_unary(&ctxt->arena, EXPR_NOT, $2); }
+    | masked_op GT masked_op
+        { $$ = expr_create_binary(&ctxt->arena, EXPR_GT, $1, $3); }
+    | masked_op LT masked_op
+        { $$ = expr_create_binary(&ctxt->arena, EXPR_LT, $1, $3); }
+    | masked_op GE masked_op
+        { $$ = expr_create_binary(&ctxt->arena, EXPR_GE, $1, $3); }
+    | masked_op LE masked_op
+        { $$ = expr_create_binary(&ctxt->arena, EXPR_LE, $1, $3); }
+    | masked_op EQ masked_op
+        { $$ = expr_create_binary(&ctxt->arena, EXPR_EQ, $1, $3); }
+    | masked_op NEQ masked_op
+        { $$ = expr_create_binary(&ctxt->arena, EXPR_NEQ, $1, $3); }
     ;
 
 masked_op
-    : operand BIT_AND operand { $$ = expr_create_binary(EXPR_BIT_AND, $1, $3); }
+    : operand BIT_AND operand
+        { $$ = expr_create_binary(&ctxt->arena, EXPR_BIT_AND, $1, $3); }
     | operand { $$ = $1; }
     | '(' masked_op ')' { $$ = $2; }
     ;
 
 operand
-    : NUMBER { $$ = expr_create_number($1); }
+    : NUMBER { $$ = expr_create_number(&ctxt->arena, $1); }
+    | PARAM
+        {
+          $$ = expr_create_param(&ctxt->arena, register_param(ctxt, $1));
+        }
     | IDENTIFIER
         {
           uint64_t value = 0;
           if (lookup_const(ctxt, $1, &value) == 0) {
-            $$ = expr_create_number(value);
+            $$ = expr_create_number(&ctxt->arena, value);
           } else {
             int var = lookup_var(ctxt, $1);
             if (var < 0) {
                 emit_error(@1, "Undefined argument `%s'", $1);
-                free($1); $1 = NULL;
                 YYERROR;
             }
-            $$ = expr_create_var(var, ctxt->syscall.args[var].size);
+            $$ = expr_create_var(&ctxt->arena, var,
+                                 ctxt->syscall.args[var].size);
           }
-          free($1);
         }
     ;
 
@@ -425,13 +418,11 @@ const_def
             if (value != $4) {
               emit_error(@1, "Redefinition of constant `%s' with different "
                          "value (was: %"PRIu64" is: %"PRIu64")", $3, value, $4);
-              free($3); $3 = NULL;
               YYERROR;
             }
           } else {
             register_const(ctxt, $3, $4);
           }
-          free($3);
         }
     ;
 
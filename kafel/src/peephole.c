@@ -0,0 +1,376 @@
+/*
+   Kafel - peephole optimizer
+   -----------------------------------------
+
+   Copyright 2026 The sandals authors.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+#include "peephole.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "common.h"
+
+#define MAX_JUMP UINT8_MAX
+
+// Contents of A on entry to an instruction
+#define ACC_UNSET -2    // no path seen yet
+#define ACC_UNKNOWN -1  // otherwise offset of the word loaded into A
+
+// Programs are loop-free, so instructions are processed in order; jump
+// targets are kept as absolute indices until the final compaction.
+// Removed instructions (redundant loads and dead code) stay in place and
+// fall through until then.
+struct peephole {
+  struct sock_filter *insns;
+  size_t len;
+  size_t *jt;
+  size_t *jf;
+  bool *removed;
+  bool *reloc;  // k is patched in later, its value is unknown
+  int *acc;
+  bool *reached;
+};
+
+static bool is_jump(const struct sock_filter *insn) {
+  return BPF_CLASS(insn->code) == BPF_JMP;
+}
+
+static bool is_cond_jump(const struct sock_filter *insn) {
+  return is_jump(insn) && BPF_OP(insn->code) != BPF_JA;
+}
+
+static bool is_ret(const struct sock_filter *insn) {
+  return BPF_CLASS(insn->code) == BPF_RET;
+}
+
+static bool changes_acc(const struct sock_filter *insn) {
+  switch (BPF_CLASS(insn->code)) {
+    case BPF_LD:
+    case BPF_ALU:
+      return true;
+    case BPF_MISC:
+      return BPF_MISCOP(insn->code) == BPF_TXA;
+    default:
+      return false;
+  }
+}
+
+static bool is_word_load(const struct sock_filter *insn) {
+  return insn->code == (BPF_LD | BPF_W | BPF_ABS);
+}
+
+static size_t resolve(const struct peephole *p, size_t target) {
+  while (target < p->len && p->removed[target]) {
+    ++target;
+  }
+  ASSERT(target < p->len);
+  return target;
+}
+
+static bool in_range(const struct peephole *p, size_t from, size_t target) {
+  return !is_cond_jump(&p->insns[from]) || target - from - 1 <= MAX_JUMP;
+}
+
+static void merge_acc(struct peephole *p, size_t target, int acc) {
+  ASSERT(target < p->len);
+  p->reached[target] = true;
+  if (p->acc[target] == ACC_UNSET) {
+    p->acc[target] = acc;
+  } else if (p->acc[target] != acc) {
+    p->acc[target] = ACC_UNKNOWN;
+  }
+}
+
+// Marks unreachable instructions and loads of the word already in A as
+// removed
+static bool remove_redundant(struct peephole *p) {
+  bool changed = false;
+  for (size_t i = 0; i < p->len; ++i) {
+    p->acc[i] = ACC_UNSET;
+    p->reached[i] = false;
+  }
+  p->acc[0] = ACC_UNKNOWN;
+  p->reached[0] = true;
+  for (size_t i = 0; i < p->len; ++i) {
+    struct sock_filter *insn = &p->insns[i];
+    if (!p->reached[i]) {
+      changed |= !p->removed[i];
+      p->removed[i] = true;
+      continue;
+    }
+    int acc = p->acc[i];
+    if (!p->removed[i] && is_word_load(insn) && !p->reloc[i] && acc >= 0 &&
+        (uint32_t)acc == insn->k) {
+      p->removed[i] = changed = true;
+    }
+    if (p->removed[i]) {
+      merge_acc(p, i + 1, acc);
+      continue;
+    }
+    if (changes_acc(insn)) {
+      acc = is_word_load(insn) && insn->k <= INT32_MAX ? (int)insn->k
+                                                       : ACC_UNKNOWN;
+    }
+    if (is_ret(insn)) {
+      continue;
+    }
+    if (is_jump(insn)) {
+      merge_acc(p, p->jt[i], acc);
+      if (is_cond_jump(insn)) {
+        merge_acc(p, p->jf[i], acc);
+      }
+    } else {
+      merge_acc(p, i + 1, acc);
+    }
+  }
+  return changed;
+}
+
+static bool evaluate(__u16 op, uint32_t lo, uint32_t hi, uint32_t k,
+                     bool *outcome) {
+  switch (op) {
+    case BPF_JEQ:
+      if (k < lo || k > hi) {
+        *outcome = false;
+        return true;
+      }
+      *outcome = true;
+      return lo == hi;
+    case BPF_JGE:
+      *outcome = lo >= k;
+      return lo >= k || hi < k;
+    case BPF_JGT:
+      *outcome = lo > k;
+      return lo > k || hi <= k;
+    case BPF_JSET:
+      *outcome = (lo & k) != 0;
+      return lo == hi;
+    default:
+      return false;
+  }
+}
+
+// Tells whether the outcome of jump to is known when it is reached through
+// the taken (or not taken) edge of jump from, with A unchanged in between
+static bool known_outcome(const struct peephole *p, size_t from, bool taken,
+                          size_t to, bool *outcome) {
+  const struct sock_filter *a = &p->insns[from];
+  const struct sock_filter *b = &p->insns[to];
+  if (p->reloc[from] || p->reloc[to] || !is_cond_jump(a) ||
+      !is_cond_jump(b)) {
+    return false;
+  }
+  if (a->code == b->code && (a->k == b->k || BPF_SRC(a->code) == BPF_X)) {
+    *outcome = taken;
+    return true;
+  }
+  if (BPF_SRC(a->code) != BPF_K || BPF_SRC(b->code) != BPF_K) {
+    return false;
+  }
+  // range of A on the edge
+  uint32_t lo = 0, hi = UINT32_MAX;
+  switch (BPF_OP(a->code)) {
+    case BPF_JEQ:
+      if (!taken) {
+        return false;
+      }
+      lo = hi = a->k;
+      break;
+    case BPF_JGE:
+      if (taken) {
+        lo = a->k;
+      } else if (a->k > 0) {
+        hi = a->k - 1;
+      }
+      break;
+    case BPF_JGT:
+      if (taken && a->k < UINT32_MAX) {
+        lo = a->k + 1;
+      } else if (!taken) {
+        hi = a->k;
+      }
+      break;
+    default:
+      return false;
+  }
+  return evaluate(BPF_OP(b->code), lo, hi, b->k, outcome);
+}
+
+// Follows unconditional jumps and jumps with a known outcome
+static size_t thread_edge(const struct peephole *p, size_t from, bool taken,
+                          size_t target) {
+  for (;;) {
+    size_t t = resolve(p, target);
+    const struct sock_filter *insn = &p->insns[t];
+    size_t next;
+    bool outcome;
+    if (is_jump(insn) && !is_cond_jump(insn)) {
+      next = p->jt[t];
+    } else if (is_cond_jump(&p->insns[from]) &&
+               known_outcome(p, from, taken, t, &outcome)) {
+      next = outcome ? p->jt[t] : p->jf[t];
+    } else {
+      return t;
+    }
+    next = resolve(p, next);
+    if (!in_range(p, from, next)) {
+      return t;
+    }
+    target = next;
+  }
+}
+
+// Prefers the last of identical return instructions in range
+static size_t merge_tail(const struct peephole *p, size_t from,
+                         size_t target) {
+  const struct sock_filter *ret = &p->insns[target];
+  if (!is_ret(ret)) {
+    return target;
+  }
+  size_t last = p->len - 1;
+  if (is_cond_jump(&p->insns[from]) && last - from - 1 > MAX_JUMP) {
+    last = from + 1 + MAX_JUMP;
+  }
+  for (size_t i = last; i > target; --i) {
+    const struct sock_filter *insn = &p->insns[i];
+    if (!p->removed[i] && is_ret(insn) && insn->code == ret->code &&
+        insn->k == ret->k) {
+      return i;
+    }
+  }
+  return target;
+}
+
+static bool retarget(struct peephole *p, size_t from, bool taken,
+                     size_t *target) {
+  size_t t = thread_edge(p, from, taken, *target);
+  t = merge_tail(p, from, t);
+  if (t == *target) {
+    return false;
+  }
+  *target = t;
+  return true;
+}
+
+static bool simplify_jumps(struct peephole *p) {
+  bool changed = false;
+  for (size_t i = 0; i < p->len; ++i) {
+    struct sock_filter *insn = &p->insns[i];
+    if (p->removed[i] || !is_jump(insn)) {
+      continue;
+    }
+    changed |= retarget(p, i, true, &p->jt[i]);
+    if (is_cond_jump(insn)) {
+      changed |= retarget(p, i, false, &p->jf[i]);
+      if (resolve(p, p->jt[i]) != resolve(p, p->jf[i])) {
+        continue;
+      }
+      *insn = (struct sock_filter)BPF_STMT(BPF_JMP | BPF_JA, 0);
+      p->reloc[i] = false;
+      changed = true;
+    }
+    size_t target = resolve(p, p->jt[i]);
+    if (target == resolve(p, i + 1)) {
+      p->removed[i] = changed = true;
+    } else if (is_ret(&p->insns[target])) {
+      *insn = p->insns[target];
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+static void compact(struct peephole *p, size_t *newidx) {
+  size_t len = 0;
+  for (size_t i = 0; i < p->len; ++i) {
+    newidx[i] = len;
+    if (!p->removed[i]) {
+      ++len;
+    }
+  }
+  for (size_t i = 0; i < p->len; ++i) {
+    struct sock_filter insn = p->insns[i];
+    if (p->removed[i]) {
+      continue;
+    }
+    size_t at = newidx[i];
+    if (is_cond_jump(&insn)) {
+      size_t jt = newidx[resolve(p, p->jt[i])] - at - 1;
+      size_t jf = newidx[resolve(p, p->jf[i])] - at - 1;
+      ASSERT(jt <= MAX_JUMP && jf <= MAX_JUMP);
+      insn.jt = jt;
+      insn.jf = jf;
+    } else if (is_jump(&insn)) {
+      insn.k = newidx[resolve(p, p->jt[i])] - at - 1;
+    }
+    p->insns[at] = insn;
+  }
+  p->len = len;
+}
+
+void peephole_optimize(struct arena *arena, struct sock_filter *insns,
+                       size_t *len, struct kafel_reloc *relocs,
+                       size_t *relocs_len) {
+  ASSERT(insns != NULL);
+  ASSERT(len != NULL);
+  ASSERT(*len > 0);
+  ASSERT(is_ret(&insns[*len - 1]));
+
+  size_t n = *len;
+  struct peephole p = {
+      .insns = insns,
+      .len = n,
+      .jt = arena_alloc(arena, n * sizeof(*p.jt)),
+      .jf = arena_alloc(arena, n * sizeof(*p.jf)),
+      .removed = arena_alloc(arena, n * sizeof(*p.removed)),
+      .reloc = arena_alloc(arena, n * sizeof(*p.reloc)),
+      .acc = arena_alloc(arena, n * sizeof(*p.acc)),
+      .reached = arena_alloc(arena, n * sizeof(*p.reached)),
+  };
+  for (size_t i = 0; i < n; ++i) {
+    if (is_cond_jump(&insns[i])) {
+      p.jt[i] = i + 1 + insns[i].jt;
+      p.jf[i] = i + 1 + insns[i].jf;
+    } else if (is_jump(&insns[i])) {
+      p.jt[i] = i + 1 + insns[i].k;
+    }
+  }
+  for (size_t i = 0; i < *relocs_len; ++i) {
+    p.reloc[relocs[i].insn] = true;
+  }
+
+  bool changed;
+  do {
+    changed = remove_redundant(&p);
+    changed |= simplify_jumps(&p);
+  } while (changed);
+
+  size_t *newidx = arena_alloc(arena, n * sizeof(*newidx));
+  compact(&p, newidx);
+  *len = p.len;
+
+  size_t kept = 0;
+  for (size_t i = 0; i < *relocs_len; ++i) {
+    size_t insn = relocs[i].insn;
+    if (!p.removed[insn] && p.reloc[insn]) {
+      relocs[kept] = relocs[i];
+      relocs[kept++].insn = newidx[insn];
+    }
+  }
+  *relocs_len = kept;
+}
@@ -0,0 +1,38 @@
+/*
+   Kafel - peephole optimizer
+   -----------------------------------------
+
+   Copyright 2026 The sandals authors.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+#ifndef KAFEL_PEEPHOLE_H
+#define KAFEL_PEEPHOLE_H
+
+#include <linux/filter.h>
+#include <stddef.h>
+
+#include "arena.h"
+#include "kafel.h"
+
+// Shrinks a generated program in place: drops loads of the word already in
+// A, threads jumps through jumps and comparisons with a known outcome,
+// merges identical return blocks and removes dead code.
+// relocs are updated to follow the instructions they patch.
+void peephole_optimize(struct arena *arena, struct sock_filter *insns,
+                       size_t *len, struct kafel_reloc *relocs,
+                       size_t *relocs_len);
+
+#endif /* KAFEL_PEEPHOLE_H */
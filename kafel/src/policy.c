@@ -20,14 +20,10 @@
 
 #include "policy.h"
 
-#include <stdlib.h>
-#include <string.h>
-
-#include "common.h"
-
-struct policy* policy_create(const char* name, struct entrieslist* entries) {
-  struct policy* rv = calloc(1, sizeof(*rv));
-  rv->name = strdup(name);
+struct policy* policy_create(struct arena* arena, const char* name,
+                             struct entrieslist* entries) {
+  struct policy* rv = arena_alloc(arena, sizeof(*rv));
+  rv->name = arena_strdup(arena, name);
   TAILQ_INIT(&rv->entries);
   if (entries != NULL) {
     TAILQ_CONCAT(&rv->entries, entries, entries);
@@ -35,9 +31,9 @@ struct policy* policy_create(const char* name, struct entrieslist* entries) {
   return rv;
 }
 
-struct policy_entry* policy_action_create(uint32_t action,
+struct policy_entry* policy_action_create(struct arena* arena, uint32_t action,
                                           struct filterslist* filters) {
-  struct policy_entry* rv = calloc(1, sizeof(*rv));
+  struct policy_entry* rv = arena_alloc(arena, sizeof(*rv));
   rv->type = POLICY_ACTION;
   rv->action = action;
   TAILQ_INIT(&rv->filters);
@@ -47,74 +43,17 @@ struct policy_entry* policy_action_create(uint32_t action,
   return rv;
 }
 
-struct policy_entry* policy_use_create(struct policy* used) {
-  struct policy_entry* rv = calloc(1, sizeof(*rv));
+struct policy_entry* policy_use_create(struct arena* arena,
+                                       struct policy* used) {
+  struct policy_entry* rv = arena_alloc(arena, sizeof(*rv));
   rv->type = POLICY_USE;
   rv->used = used;
   return rv;
 }
 
-static void policy_action_destroy(struct policy_entry** entry) {
-  ASSERT(entry != NULL);
-  ASSERT((*entry) != NULL);
-
-  syscall_filters_destroy(&(*entry)->filters);
-  free(*entry);
-  *entry = NULL;
-}
-
-static void policy_use_destroy(struct policy_entry** entry) {
-  ASSERT(entry != NULL);
-  ASSERT((*entry) != NULL);
-
-  free(*entry);
-  *entry = NULL;
-}
-
-void policy_entry_destroy(struct policy_entry** entry) {
-  ASSERT(entry != NULL);
-  ASSERT((*entry) != NULL);
-
-  switch ((*entry)->type) {
-    case POLICY_ACTION:
-      policy_action_destroy(entry);
-      break;
-    case POLICY_USE:
-      policy_use_destroy(entry);
-      break;
-    default:
-      ASSERT(0);  // should not happen
-  }
-}
-
-void policy_entries_destroy(struct entrieslist* entries) {
-  ASSERT(entries != NULL);
-
-  // FIXME dirty hack
-  if (!TAILQ_EMPTY(entries)) {
-    TAILQ_FIRST(entries)->entries.tqe_prev = &entries->tqh_first;
-  }
-
-  while (!TAILQ_EMPTY(entries)) {
-    struct policy_entry* entry = TAILQ_FIRST(entries);
-    TAILQ_REMOVE(entries, entry, entries);
-    policy_entry_destroy(&entry);
-  }
-}
-
-void policy_destroy(struct policy** policy) {
-  ASSERT(policy != NULL);
-  ASSERT((*policy) != NULL);
-
-  policy_entries_destroy(&(*policy)->entries);
-  free((*policy)->name);
-  free(*policy);
-  *policy = NULL;
-}
-
-struct syscall_filter* syscall_filter_create(uint32_t nr,
+struct syscall_filter* syscall_filter_create(struct arena* arena, uint32_t nr,
                                              struct expr_tree* expr) {
-  struct syscall_filter* rv = calloc(1, sizeof(*rv));
+  struct syscall_filter* rv = arena_alloc(arena, sizeof(*rv));
   rv->syscall_nr = nr;
   if (expr != NULL) {
     expr_simplify(&expr);
@@ -122,28 +61,3 @@ struct syscall_filter* syscall_filter_create(uint32_t nr,
   rv->expr = expr;
   return rv;
 }
-
-void syscall_filter_destroy(struct syscall_filter** filter) {
-  ASSERT(filter != NULL);
-  ASSERT((*filter) != NULL);
-
-  if ((*filter)->expr != NULL) {
-    expr_destroy(&(*filter)->expr);
-  }
-  free(*filter);
-}
-
-void syscall_filters_destroy(struct filterslist* filters) {
-  ASSERT(filters != NULL);
-
-  // FIXME dirty hack
-  if (!TAILQ_EMPTY(filters)) {
-    TAILQ_FIRST(filters)->filters.tqe_prev = &filters->tqh_first;
-  }
-
-  while (!TAILQ_EMPTY(filters)) {
-    struct syscall_filter* filter = TAILQ_FIRST(filters);
-    TAILQ_REMOVE(filters, filter, filters);
-    syscall_filter_destroy(&filter);
-  }
-}
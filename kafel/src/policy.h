@@ -24,6 +24,7 @@
 #include <stdint.h>
 #include <sys/queue.h>
 
+#include "arena.h"
 #include "expression.h"
 
 struct syscall_filter {
@@ -70,17 +71,14 @@ struct policy {
 
 TAILQ_HEAD(policieslist, policy);
 
-struct policy* policy_create(const char* name, struct entrieslist* entries);
-void policy_destroy(struct policy** policy);
-struct policy_entry* policy_action_create(uint32_t action,
+struct policy* policy_create(struct arena* arena, const char* name,
+                             struct entrieslist* entries);
+struct policy_entry* policy_action_create(struct arena* arena, uint32_t action,
                                           struct filterslist* filters);
-struct policy_entry* policy_use_create(struct policy* used);
-void policy_entry_destroy(struct policy_entry** entry);
-void policy_entries_destroy(struct entrieslist* entries);
+struct policy_entry* policy_use_create(struct arena* arena,
+                                       struct policy* used);
 
-struct syscall_filter* syscall_filter_create(uint32_t nr,
+struct syscall_filter* syscall_filter_create(struct arena* arena, uint32_t nr,
                                              struct expr_tree* expr);
-void syscall_filter_destroy(struct syscall_filter** filter);
-void syscall_filters_destroy(struct filterslist* filters);
 
 #endif /* KAFEL_POLICY_H */
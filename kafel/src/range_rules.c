@@ -25,40 +25,19 @@
 #include "common.h"
 #include "syscall.h"
 
-static void range_rule_deinit(struct syscall_range_rule *rule) {
-  ASSERT(rule != NULL);
-
-  while (!TAILQ_EMPTY(&rule->expr_list)) {
-    struct expression_to_action *mapping = TAILQ_FIRST(&rule->expr_list);
-    TAILQ_REMOVE(&rule->expr_list, mapping, list);
-    free(mapping);
-  }
-}
-
-struct syscall_range_rules *range_rules_create(void) {
-  struct syscall_range_rules *rv = calloc(1, sizeof(*rv));
+struct syscall_range_rules *range_rules_create(struct arena *arena) {
+  struct syscall_range_rules *rv = arena_alloc(arena, sizeof(*rv));
+  rv->arena = arena;
   rv->capacity = INITAL_RANGE_RULES_SIZE;
-  rv->data = calloc(rv->capacity, sizeof(*rv->data));
+  rv->data = arena_alloc(arena, rv->capacity * sizeof(*rv->data));
   return rv;
 }
 
-void range_rules_destroy(struct syscall_range_rules **rules) {
-  ASSERT(rules != NULL);
-  ASSERT((*rules) != NULL);
-
-  for (size_t i = 0; i < (*rules)->len; ++i) {
-    range_rule_deinit(&(*rules)->data[i]);
-  }
-  free((*rules)->data);
-  free((*rules));
-  *rules = NULL;
-}
-
-static void rule_add_expr(struct syscall_range_rule *rule,
+static void rule_add_expr(struct arena *arena, struct syscall_range_rule *rule,
                           struct expr_tree *expr, int action) {
   ASSERT(rule != NULL);
 
-  struct expression_to_action *mapping = calloc(1, sizeof(*mapping));
+  struct expression_to_action *mapping = arena_alloc(arena, sizeof(*mapping));
   mapping->expr = expr;
   mapping->action = action;
   rule->action = ACTION_CONDITIONAL;
@@ -96,11 +75,7 @@ static void grow_range_rules(struct syscall_range_rules *rules,
   if (newcapacity < rules->capacity || newbytes < oldbytes) {
     ASSERT(0);  // overflow
   }
-  struct syscall_range_rule *newdata = realloc(rules->data, newbytes);
-  if (newdata == NULL) {
-    ASSERT(0);  // OOM
-  }
-  rules->data = newdata;
+  rules->data = arena_grow(rules->arena, rules->data, oldbytes, newbytes);
   rules->capacity = newcapacity;
   fix_tailq_moving(rules);
 }
@@ -143,7 +118,7 @@ void add_policy_rules(struct syscall_range_rules *rules,
             if (filter->expr->type == EXPR_FALSE) {
               continue;
             }
-            rule_add_expr(&rule, filter->expr, entry->action);
+            rule_add_expr(rules->arena, &rule, filter->expr, entry->action);
           } else {
             rule.action = entry->action;
           }
@@ -172,14 +147,15 @@ static void sort_range_rules(struct syscall_range_rules *rules) {
   fix_tailq_moving(rules);
 }
 
-static void normalize_expr_list(struct syscall_range_rule *rule,
+static void normalize_expr_list(struct arena *arena,
+                                struct syscall_range_rule *rule,
                                 int default_action) {
   struct expr_tree *last_expr = NULL;
   if (!TAILQ_EMPTY(&rule->expr_list)) {
     last_expr = TAILQ_LAST(&rule->expr_list, expression_to_action_list)->expr;
   }
   if (last_expr != NULL) {
-    rule_add_expr(rule, NULL, default_action);
+    rule_add_expr(arena, rule, NULL, default_action);
   }
 }
 
@@ -206,15 +182,17 @@ static size_t normalize_rules_count_missing(struct syscall_range_rules *rules,
             TAILQ_CONCAT(&prev->expr_list, &cur->expr_list, list);
           }
         } else {
-          rule_add_expr(prev, NULL, cur->action);
+          struct expr_tree *last_expr =
+              TAILQ_LAST(&prev->expr_list, expression_to_action_list)->expr;
+          if (last_expr != NULL && last_expr->type != EXPR_TRUE) {
+            rule_add_expr(rules->arena, prev, NULL, cur->action);
+          }
         }
       }
-      range_rule_deinit(cur);
       continue;
     } else if (cur->first == prev->last + 1) {
       if (prev->action != ACTION_CONDITIONAL && prev->action == cur->action) {
         prev->last = cur->last;
-        range_rule_deinit(cur);
         continue;
       }
     } else {
@@ -232,7 +210,6 @@ static size_t normalize_rules_count_missing(struct syscall_range_rules *rules,
         ++to_add;
       }
     }
-    normalize_expr_list(cur, default_action);
     if (j != i) {
       struct syscall_range_rule *dst = &rules->data[j];
       *dst = *cur;
@@ -243,8 +220,12 @@ static size_t normalize_rules_count_missing(struct syscall_range_rules *rules,
   }
   rules->len = j;
 
+  // only once all rules for the same syscall are merged
+  for (size_t i = 0; i < rules->len; ++i) {
+    normalize_expr_list(rules->arena, &rules->data[i], default_action);
+  }
+
   struct syscall_range_rule *first_rule = &rules->data[0];
-  normalize_expr_list(first_rule, default_action);
   if (first_rule->first != 0) {
     if (first_rule->action == default_action) {
       first_rule->first = 0;
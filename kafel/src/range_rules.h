@@ -26,6 +26,7 @@
 #include <stdint.h>
 #include <sys/queue.h>
 
+#include "arena.h"
 #include "policy.h"
 
 #ifndef INITAL_RANGE_RULES_SIZE
@@ -49,13 +50,13 @@ struct syscall_range_rule {
 };
 
 struct syscall_range_rules {
+  struct arena *arena;
   struct syscall_range_rule *data;
   size_t len;
   size_t capacity;
 };
 
-struct syscall_range_rules *range_rules_create(void);
-void range_rules_destroy(struct syscall_range_rules **rules);
+struct syscall_range_rules *range_rules_create(struct arena *arena);
 void add_policy_rules(struct syscall_range_rules *rules, struct policy *policy);
 void normalize_rules(struct syscall_range_rules *rules, int default_action);
 
@@ -32,8 +32,8 @@
 #define EM_ARM 40
 #endif
 
-struct syscall_descriptor* syscall_custom(uint32_t nr) {
-  struct syscall_descriptor* rv = calloc(1, sizeof(*rv));
+struct syscall_descriptor* syscall_custom(struct arena* arena, uint32_t nr) {
+  struct syscall_descriptor* rv = arena_alloc(arena, sizeof(*rv));
   rv->nr = nr;
   return rv;
 }
@@ -69,21 +69,14 @@ uint32_t syscall_get_arch_mask(uint32_t arch) {
   }
 }
 
-const struct syscall_descriptor* syscall_lookup(uint32_t mask,
+const struct syscall_descriptor* syscall_lookup(struct arena* arena,
+                                                uint32_t mask,
                                                 const char* name) {
   const struct syscalldb_definition* def = syscalldb_lookup(name);
   if (def && mask & def->arch_mask) {
-    struct syscall_descriptor* rv = calloc(1, sizeof(*rv));
+    struct syscall_descriptor* rv = arena_alloc(arena, sizeof(*rv));
     syscalldb_unpack(def, mask, rv);
     return rv;
   }
   return NULL;
 }
-
-void syscall_descriptor_destroy(struct syscall_descriptor** desc) {
-  ASSERT(desc != NULL);
-  ASSERT((*desc) != NULL);
-
-  free(*desc);
-  (*desc) = NULL;
-}
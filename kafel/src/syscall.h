@@ -25,6 +25,8 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include "arena.h"
+
 #define MAX_SYSCALL_NR UINT32_MAX
 #define SYSCALL_MAX_ARGS 6
 
@@ -40,10 +42,10 @@ struct syscall_descriptor {
   struct syscall_arg args[SYSCALL_MAX_ARGS];
 };
 
-struct syscall_descriptor* syscall_custom(uint32_t nr);
+struct syscall_descriptor* syscall_custom(struct arena* arena, uint32_t nr);
 uint32_t syscall_get_arch_mask(uint32_t arch);
-const struct syscall_descriptor* syscall_lookup(uint32_t arch_mask,
+const struct syscall_descriptor* syscall_lookup(struct arena* arena,
+                                                uint32_t arch_mask,
                                                 const char* name);
-void syscall_descriptor_destroy(struct syscall_descriptor** desc);
 
 #endif /* KAFEL_SYSCALL_H */
@@ -0,0 +1,133 @@
+/*
+   Kafel - seccomp action cache tests
+   -----------------------------------------
+
+   Copyright 2026 The sandals authors.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+#include <kafel.h>
+#include <linux/audit.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "runner/emulator.h"
+#include "runner/runner.h"
+
+// x86_64 syscalls with argument dependent results in the policies below
+static const uint32_t conditional[] = {
+    8,   // lseek
+    16,  // ioctl
+    41,  // socket
+    62,  // kill
+    72,  // fcntl
+};
+
+static bool is_conditional(uint32_t nr) {
+  for (size_t i = 0; i < ARRAY_SIZE(conditional); ++i) {
+    if (conditional[i] == nr) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static char* make_policy(void) {
+  size_t size = 8192;
+  char* policy = malloc(size);
+  size_t len = snprintf(policy, size,
+                        "POLICY a {\n"
+                        "  ALLOW {\n"
+                        "    read, write, close, mmap, munmap, futex,\n"
+                        "    exit_group, clock_gettime, dup(fd) { fd == fd },\n"
+                        "    lseek(fd, offset, whence) { whence <= 2 },\n"
+                        "    fcntl(fd, cmd) { cmd == 1 || cmd == 2 ||\n"
+                        "                     cmd == 3 || cmd == 4 },\n"
+                        "    kill(pid, sig) { sig == 0 },\n"
+                        "    ioctl(fd, cmd) { cmd == 0");
+  // scattered values to get a sizable program with long jumps
+  for (int i = 1; i < 300; ++i) {
+    len += snprintf(policy + len, size - len, " || cmd == %d", i * 7);
+  }
+  snprintf(policy + len, size - len,
+           " }\n"
+           "  },\n"
+           "  ERRNO(1) { openat, socket(domain) { domain == 16 } }\n"
+           "}\n"
+           "POLICY b {\n"
+           "  ERRNO(1) { ptrace, bpf },\n"
+           "  ALLOW { mprotect(addr, len, prot) { prot == 1 }, mprotect }\n"
+           "}\n"
+           "POLICY c { USE a, USE b }\n"
+           "USE c DEFAULT KILL");
+  return policy;
+}
+
+static const struct kafel_syscall_weight weights[] = {
+    {0, 100}, {1, 90}, {202, 50}, {16, 40}, {228, 10}};
+
+static void check_action_cache(const char* policy, bool profile) {
+  const test_compile_opts_t opts = {.profile = weights,
+                                    .profile_len = ARRAY_SIZE(weights)};
+  struct sock_fprog prog;
+  CHECK(test_compile(policy, profile ? &opts : NULL, &prog) == 0,
+        "compilation failed");
+
+  int cached = 0;
+  for (uint32_t nr = 0; nr < 512; ++nr) {
+    struct seccomp_data data = {.nr = nr, .arch = AUDIT_ARCH_X86_64};
+    bool allowed = emulate_bpf(&prog, &data, NULL) == SECCOMP_RET_ALLOW;
+    bool expected = allowed && !is_conditional(nr);
+    bool actual = emulate_bpf_const_allow(&prog, nr, AUDIT_ARCH_X86_64);
+    CHECK(actual == expected, "syscall %u: %s in action cache", nr,
+          actual ? "unexpectedly" : "not");
+    cached += actual;
+    CHECK(!emulate_bpf_const_allow(&prog, nr, AUDIT_ARCH_I386),
+          "foreign arch syscall %u in action cache", nr);
+  }
+  // read, write, close, mmap, mprotect, munmap, dup, futex, clock_gettime,
+  // exit_group
+  CHECK(cached == 10, "%d syscalls in action cache", cached);
+  free(prog.filter);
+}
+
+TEST_CASE(action_cache) {
+  char* policy = make_policy();
+  check_action_cache(policy, false);
+  check_action_cache(policy, true);
+  free(policy);
+}
+
+TEST_CASE(action_cache_default_allow) {
+  struct sock_fprog prog;
+  CHECK(test_compile("POLICY a {\n"
+                     "  ERRNO(1) { ptrace, socket(domain) { domain == 16 } },\n"
+                     "  ALLOW { kill(pid, sig) { sig == 0 } }\n"
+                     "} USE a DEFAULT ALLOW",
+                     NULL, &prog) == 0,
+        "compilation failed");
+  // kill is allowed whatever the arguments
+  CHECK(emulate_bpf_const_allow(&prog, 62, AUDIT_ARCH_X86_64),
+        "kill not in action cache");
+  CHECK(!emulate_bpf_const_allow(&prog, 41, AUDIT_ARCH_X86_64),
+        "socket in action cache");
+  CHECK(!emulate_bpf_const_allow(&prog, 101, AUDIT_ARCH_X86_64),
+        "ptrace in action cache");
+  CHECK(emulate_bpf_const_allow(&prog, 0, AUDIT_ARCH_X86_64),
+        "read not in action cache");
+  free(prog.filter);
+}
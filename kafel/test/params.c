@@ -0,0 +1,163 @@
+/*
+   Kafel - policy parameter tests
+   -----------------------------------------
+
+   Copyright 2026 The sandals authors.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+#include <kafel.h>
+#include <linux/audit.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "runner/emulator.h"
+#include "runner/runner.h"
+
+#define NR_IOCTL 16
+
+// %1$s and %2$s are either parameters or their values; A is compared
+// with 32-bit arguments, B with 64-bit ones
+static const char kTemplate[] =
+    "POLICY a {\n"
+    "  ALLOW { ioctl(fd, cmd, arg) {\n"
+    "    fd <= %1$s && arg == %2$s || arg > %2$s,\n"
+    "    %1$s == cmd && fd != %1$s || (arg & 0xff) >= %1$s,\n"
+    "    %2$s == 3 && fd == 4, (cmd & %1$s) == 0x10 && arg == 1,\n"
+    "    %2$s != %1$s && fd == 5\n"
+    "  } }\n"
+    "} USE a DEFAULT KILL";
+
+static const uint64_t kProbes[] = {
+    0,           1,           2,           3,
+    4,           5,           6,           7,
+    8,           0x10,        0x11,        0xff,
+    0x100,       0xfffffffe,  0xffffffff,  0x100000000,
+    0x100000001, 0x10000000f, UINT64_MAX - 1, UINT64_MAX};
+
+static const uint64_t kValues[][2] = {{3, 0x100000000},
+                                      {0xfffffffe, 7},
+                                      {0, UINT64_MAX},
+                                      {0x10, 3},
+                                      {0xff, 0xff}};
+
+static char* instantiate(const char* a, const char* b) {
+  size_t size = sizeof(kTemplate) + 8 * (strlen(a) + strlen(b));
+  char* policy = malloc(size);
+  snprintf(policy, size, kTemplate, a, b);
+  return policy;
+}
+
+static uint32_t run(const struct sock_fprog* prog, uint64_t fd, uint64_t cmd,
+                    uint64_t arg) {
+  struct seccomp_data data = {
+      .nr = NR_IOCTL, .arch = AUDIT_ARCH_X86_64, .args = {fd, cmd, arg}};
+  return emulate_bpf(prog, &data, NULL);
+}
+
+TEST_CASE(params_match_constants) {
+  struct sock_fprog skeleton, reference;
+  kafel_ctxt_t ctxt = kafel_ctxt_create();
+  char* policy = instantiate("$A", "$B");
+  kafel_set_input_string(ctxt, policy);
+  kafel_set_target_arch(ctxt, AUDIT_ARCH_X86_64);
+  CHECK(kafel_compile(ctxt, &skeleton) == 0, "compilation failed");
+  free(policy);
+  CHECK(kafel_param_count(ctxt) == 2, "%zu parameters",
+        kafel_param_count(ctxt));
+  CHECK(strcmp(kafel_param_name(ctxt, 0), "A") == 0 &&
+            strcmp(kafel_param_name(ctxt, 1), "B") == 0,
+        "wrong parameter names");
+  size_t len;
+  const struct kafel_reloc* relocs = kafel_relocs(ctxt, &len);
+  CHECK(len > 0, "no relocations");
+  // A is compared with fd and cmd (32-bit) as well as with B
+  bool a_narrow = false, a_wide = false;
+  for (size_t i = 0; i < len; ++i) {
+    if (relocs[i].param == 0) {
+      a_narrow |= relocs[i].width == 32;
+      a_wide |= relocs[i].width == 64;
+    } else {
+      CHECK(relocs[i].width == 64, "B compared at %u bits", relocs[i].width);
+    }
+  }
+  CHECK(a_narrow && a_wide, "wrong widths for A");
+
+  // the same skeleton patched over and over
+  for (size_t i = 0; i < ARRAY_SIZE(kValues); ++i) {
+    char a[32], b[32];
+    snprintf(a, sizeof(a), "%#llx", (unsigned long long)kValues[i][0]);
+    snprintf(b, sizeof(b), "%#llx", (unsigned long long)kValues[i][1]);
+    policy = instantiate(a, b);
+    CHECK(test_compile(policy, NULL, &reference) == 0, "compilation failed");
+    free(policy);
+    kafel_apply_relocs(&skeleton, relocs, len, kValues[i]);
+    for (size_t fd = 0; fd < ARRAY_SIZE(kProbes); ++fd) {
+      for (size_t cmd = 0; cmd < ARRAY_SIZE(kProbes); ++cmd) {
+        for (size_t arg = 0; arg < ARRAY_SIZE(kProbes); ++arg) {
+          CHECK(run(&skeleton, kProbes[fd], kProbes[cmd], kProbes[arg]) ==
+                    run(&reference, kProbes[fd], kProbes[cmd], kProbes[arg]),
+                "A=%s B=%s: mismatch for (%#llx, %#llx, %#llx)", a, b,
+                (unsigned long long)kProbes[fd],
+                (unsigned long long)kProbes[cmd],
+                (unsigned long long)kProbes[arg]);
+        }
+      }
+    }
+    free(reference.filter);
+  }
+  free(skeleton.filter);
+  kafel_ctxt_destroy(&ctxt);
+}
+
+// Only the low word of a parameter is compared with a 32-bit argument,
+// the relocation tells so
+TEST_CASE(params_32bit_argument) {
+  struct sock_fprog prog;
+  kafel_ctxt_t ctxt = kafel_ctxt_create();
+  kafel_set_input_string(ctxt, "ALLOW { ioctl(fd) { fd == $FD } }");
+  kafel_set_target_arch(ctxt, AUDIT_ARCH_X86_64);
+  CHECK(kafel_compile(ctxt, &prog) == 0, "compilation failed");
+  size_t len;
+  const struct kafel_reloc* relocs = kafel_relocs(ctxt, &len);
+  CHECK(len == 1, "%zu relocations", len);
+  CHECK(relocs[0].width == 32, "compared at %u bits", relocs[0].width);
+  uint64_t value = 0x500000003;
+  kafel_apply_relocs(&prog, relocs, len, &value);
+  CHECK(run(&prog, 3, 0, 0) == SECCOMP_RET_ALLOW, "fd 3 not allowed");
+  CHECK(run(&prog, 5, 0, 0) == SECCOMP_RET_KILL, "fd 5 allowed");
+  free(prog.filter);
+  kafel_ctxt_destroy(&ctxt);
+}
+
+TEST_CASE(params_no_relocs_without_params) {
+  struct sock_fprog prog;
+  kafel_ctxt_t ctxt = kafel_ctxt_create();
+  kafel_set_input_string(ctxt, "ALLOW { ioctl(fd) { fd == 1 } }");
+  CHECK(kafel_compile(ctxt, &prog) == 0, "compilation failed");
+  size_t len = 1;
+  kafel_relocs(ctxt, &len);
+  CHECK(kafel_param_count(ctxt) == 0 && len == 0, "unexpected relocations");
+  free(prog.filter);
+  kafel_ctxt_destroy(&ctxt);
+}
+
+TEST_CASE(params_rejected_by_convenience_api) {
+  struct sock_fprog prog;
+  CHECK(kafel_compile_string("ALLOW { ioctl(fd) { fd == $FD } }", &prog) != 0,
+        "parameters silently bound to 0");
+}
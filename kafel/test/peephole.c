@@ -0,0 +1,116 @@
+/*
+   Kafel - peephole optimizer tests
+   -----------------------------------------
+
+   Copyright 2026 The sandals authors.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+#include <kafel.h>
+#include <linux/audit.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "runner/emulator.h"
+#include "runner/runner.h"
+
+#define MAX_NR 512
+
+static const char* const kPolicies[] = {
+    "ALLOW {\n"
+    "  write(fd, buf, count) { fd == 1 || fd == 2 },\n"
+    "  mmap(addr, len, prot, flags) {\n"
+    "    (prot & 4) == 0 && flags == 0x22 || flags == 0x32 && len < 0x100000\n"
+    "  },\n"
+    "  lseek(fd, off) { off > 0x100000000 && off < 0x200000000 || off == 5 },\n"
+    "  kill(pid, sig) { pid == 0 || pid > 100 && sig == 9 },\n"
+    "  futex(uaddr, op) { op == 0 || op == 1 || op == 128 || op == 129 }\n"
+    "}\n"
+    "ERRNO(1) { openat(dirfd, path, flags) { (flags & 3) != 0 } }\n"
+    "DEFAULT KILL",
+    "POLICY a { ALLOW { read { fd == 0 }, ioctl(fd, cmd) { cmd == fd } } }\n"
+    "POLICY b { TRAP(3) { read, ioctl }, ERRNO(5) { SYSCALL[500] } }\n"
+    "USE a, USE b DEFAULT LOG",
+    "ALLOW { prctl(option, a2) { option == 4 && a2 <= 1 || option != 38 } }\n"
+    "KILL { prctl { option == 38 } }\n"
+    "DEFAULT ERRNO(1)",
+};
+
+static const uint64_t kArgs[] = {0,          1,          2,    4,
+                                 5,          9,          38,   0x22,
+                                 0x32,       100,        101,  0x100000,
+                                 0xffffffff, 0x100000000, 0x100000001,
+                                 0x200000000, UINT64_MAX};
+
+static const test_compile_opts_t kNoPeephole = {.no_peephole = true};
+
+static size_t count_loads(const struct sock_fprog* prog, uint32_t offset) {
+  size_t count = 0;
+  for (size_t i = 0; i < prog->len; ++i) {
+    count += prog->filter[i].code == (BPF_LD | BPF_W | BPF_ABS) &&
+             prog->filter[i].k == offset;
+  }
+  return count;
+}
+
+TEST_CASE(peephole_preserves_behaviour) {
+  for (size_t i = 0; i < ARRAY_SIZE(kPolicies); ++i) {
+    struct sock_fprog plain, optimized;
+    CHECK(test_compile(kPolicies[i], &kNoPeephole, &plain) == 0,
+          "compilation failed");
+    CHECK(test_compile(kPolicies[i], NULL, &optimized) == 0,
+          "compilation failed");
+    CHECK(optimized.len <= plain.len, "policy %zu: %u -> %u instructions", i,
+          plain.len, optimized.len);
+    for (uint32_t nr = 0; nr < MAX_NR; ++nr) {
+      CHECK(emulate_bpf_const_allow(&plain, nr, AUDIT_ARCH_X86_64) ==
+                emulate_bpf_const_allow(&optimized, nr, AUDIT_ARCH_X86_64),
+            "policy %zu: action cache differs for syscall %u", i, nr);
+      for (size_t a = 0; a < ARRAY_SIZE(kArgs); ++a) {
+        for (size_t b = 0; b < ARRAY_SIZE(kArgs); ++b) {
+          struct seccomp_data data = {
+              .nr = nr,
+              .arch = AUDIT_ARCH_X86_64,
+              .args = {kArgs[a], kArgs[b], kArgs[b], kArgs[a]}};
+          int plain_steps, optimized_steps;
+          CHECK(emulate_bpf(&plain, &data, &plain_steps) ==
+                    emulate_bpf(&optimized, &data, &optimized_steps),
+                "policy %zu: mismatch for syscall %u", i, nr);
+          CHECK(optimized_steps <= plain_steps,
+                "policy %zu: syscall %u takes %d -> %d instructions", i, nr,
+                plain_steps, optimized_steps);
+        }
+      }
+    }
+    free(plain.filter);
+    free(optimized.filter);
+  }
+}
+
+TEST_CASE(peephole_drops_redundant_loads) {
+  static const char policy[] =
+      "ALLOW { write(fd, buf, count) { fd == 1 || fd == 2 } }";
+  const uint32_t fd_low = offsetof(struct seccomp_data, args[0]);
+  struct sock_fprog plain, optimized;
+  CHECK(test_compile(policy, &kNoPeephole, &plain) == 0, "compilation failed");
+  CHECK(test_compile(policy, NULL, &optimized) == 0, "compilation failed");
+  size_t before = count_loads(&plain, fd_low);
+  size_t after = count_loads(&optimized, fd_low);
+  free(plain.filter);
+  free(optimized.filter);
+  CHECK(before == 2 && after == 1, "fd loaded %zu -> %zu times", before,
+        after);
+}
@@ -0,0 +1,131 @@
+/*
+   Kafel - syscall profile tests
+   -----------------------------------------
+
+   Copyright 2026 The sandals authors.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+#include <kafel.h>
+#include <linux/audit.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "runner/emulator.h"
+#include "runner/runner.h"
+
+// Syscall counts of an event loop server under load (x86_64 numbers)
+static const struct kafel_syscall_weight workload[] = {
+    {0, 41000},   // read
+    {1, 38000},   // write
+    {232, 21000}, // epoll_wait
+    {202, 17500}, // futex
+    {228, 9000},  // clock_gettime
+    {9, 1200},    // mmap
+    {11, 1100},   // munmap
+    {3, 900},     // close
+    {257, 850},   // openat
+    {262, 800},   // newfstatat
+    {28, 400},    // madvise
+    {10, 300},    // mprotect
+    {20, 250},    // writev
+    {318, 60},    // getrandom
+    {14, 40},     // rt_sigprocmask
+    {39, 10},     // getpid
+    {56, 4},      // clone
+    {60, 1},      // exit
+};
+
+static const char policy[] =
+    "POLICY a {\n"
+    "  ALLOW {\n"
+    "    read, write, readv, writev, pread64, pwrite64, open, openat, close,\n"
+    "    newstat, newfstat, newlstat, newfstatat, lseek, mmap, mprotect,\n"
+    "    munmap,\n"
+    "    madvise, brk, rt_sigaction, rt_sigprocmask, rt_sigreturn, ioctl,\n"
+    "    access, pipe, pipe2, select, poll, ppoll, sched_yield, mremap,\n"
+    "    dup, dup2, dup3, nanosleep, getpid, gettid, clone, fork, vfork,\n"
+    "    execve, exit, exit_group, wait4, kill, tgkill, fcntl,\n"
+    "    flock, fsync, getcwd, chdir, rename, mkdir, rmdir, unlink,\n"
+    "    readlink, chmod, umask, gettimeofday, getrlimit, getrusage,\n"
+    "    getuid, getgid, geteuid, getegid, futex, set_tid_address,\n"
+    "    clock_gettime, clock_nanosleep, epoll_create1, epoll_ctl,\n"
+    "    epoll_wait, epoll_pwait, eventfd2, accept4, socket, connect,\n"
+    "    sendto, recvfrom, sendmsg, recvmsg, shutdown, bind, listen,\n"
+    "    getsockname, getpeername, setsockopt, getsockopt, getrandom,\n"
+    "    prlimit64\n"
+    "  }\n"
+    "} USE a DEFAULT KILL";
+
+static uint32_t run(const struct sock_fprog* prog, uint32_t nr, int* steps) {
+  struct seccomp_data data = {.nr = nr, .arch = AUDIT_ARCH_X86_64};
+  return emulate_bpf(prog, &data, steps);
+}
+
+// Average number of instructions executed per syscall of workload
+static double average_steps(const struct sock_fprog* prog) {
+  double total = 0, count = 0;
+  for (size_t i = 0; i < ARRAY_SIZE(workload); ++i) {
+    int steps;
+    run(prog, workload[i].nr, &steps);
+    total += (double)steps * workload[i].weight;
+    count += workload[i].weight;
+  }
+  return total / count;
+}
+
+TEST_CASE(syscall_profile) {
+  struct sock_fprog balanced, weighted;
+  const test_compile_opts_t opts = {.profile = workload,
+                                    .profile_len = ARRAY_SIZE(workload)};
+  CHECK(test_compile(policy, NULL, &balanced) == 0, "compilation failed");
+  CHECK(test_compile(policy, &opts, &weighted) == 0, "compilation failed");
+
+  for (uint32_t nr = 0; nr < 1024; ++nr) {
+    CHECK(run(&balanced, nr, NULL) == run(&weighted, nr, NULL),
+          "different action for syscall %u", nr);
+  }
+
+  // load arch, check arch, load syscall, at most two jumps, return
+  for (size_t i = 0; i < 2; ++i) {
+    int steps;
+    run(&weighted, workload[i].nr, &steps);
+    CHECK(steps <= 6, "syscall %u takes %d instructions", workload[i].nr,
+          steps);
+  }
+
+  double before = average_steps(&balanced), after = average_steps(&weighted);
+  fprintf(stderr,
+          "syscall_profile: %.2f -> %.2f instructions per syscall "
+          "(%u -> %u instructions total)\n",
+          before, after, balanced.len, weighted.len);
+  CHECK(after < before, "profile does not help: %.2f >= %.2f", after, before);
+
+  free(balanced.filter);
+  free(weighted.filter);
+}
+
+TEST_CASE(syscall_profile_dominant) {
+  // futex sits between rules of its own, yet is checked first
+  static const struct kafel_syscall_weight futex_only[] = {{202, 1}};
+  const test_compile_opts_t opts = {.profile = futex_only,
+                                    .profile_len = ARRAY_SIZE(futex_only)};
+  struct sock_fprog prog;
+  int steps;
+  CHECK(test_compile(policy, &opts, &prog) == 0, "compilation failed");
+  CHECK(run(&prog, 202, &steps) == SECCOMP_RET_ALLOW, "futex not allowed");
+  CHECK(steps == 5, "futex takes %d instructions", steps);
+  free(prog.filter);
+}
@@ -0,0 +1,92 @@
+/*
+   Kafel - context reuse tests
+   -----------------------------------------
+
+   Copyright 2026 The sandals authors.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+#include <kafel.h>
+#include <linux/audit.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "runner/runner.h"
+
+// A broken policy in the middle must not affect the following ones
+static const char* const kPolicies[] = {
+    "ALLOW { read, write, close } DEFAULT KILL",
+    "#define MAGIC 42\n"
+    "POLICY a { ALLOW { ioctl(fd, cmd) { cmd == MAGIC || cmd == 7 } } }\n"
+    "POLICY b { ERRNO(1) { open, openat }, USE a }\n"
+    "USE b DEFAULT ALLOW",
+    "ALLOW { undefined_syscall }",
+    "ALLOW { mmap(addr, len, prot) { prot & 4 == 0, len > $max } }",
+    "ALLOW { read { fd == 0 }, write { fd == 1 || fd == 2 } }",
+};
+
+static bool same_program(const struct sock_fprog* a,
+                         const struct sock_fprog* b) {
+  return a->len == b->len &&
+         memcmp(a->filter, b->filter, a->len * sizeof(*a->filter)) == 0;
+}
+
+TEST_CASE(reused_context_matches_fresh) {
+  kafel_ctxt_t ctxt = kafel_ctxt_create();
+  kafel_set_target_arch(ctxt, AUDIT_ARCH_X86_64);
+  for (int round = 0; round < 3; ++round) {
+    for (size_t i = 0; i < ARRAY_SIZE(kPolicies); ++i) {
+      struct sock_fprog fresh, reused;
+      int expected = test_compile(kPolicies[i], NULL, &fresh);
+      kafel_set_input_string(ctxt, kPolicies[i]);
+      int rv = kafel_compile(ctxt, &reused);
+      CHECK((rv == 0) == (expected == 0), "policy %zu: got %d, expected %d",
+            i, rv, expected);
+      if (rv != 0) {
+        CHECK(strstr(kafel_error_msg(ctxt), "undefined_syscall") != NULL,
+              "policy %zu: unexpected error `%s'", i, kafel_error_msg(ctxt));
+        continue;
+      }
+      bool same = same_program(&fresh, &reused);
+      free(fresh.filter);
+      free(reused.filter);
+      CHECK(same, "policy %zu: program differs on round %d", i, round);
+    }
+  }
+  kafel_ctxt_destroy(&ctxt);
+}
+
+TEST_CASE(reset_releases_compilation_state) {
+  kafel_ctxt_t ctxt = kafel_ctxt_create();
+  kafel_set_input_string(ctxt, kPolicies[3]);
+  struct sock_fprog prog;
+  CHECK(kafel_compile(ctxt, &prog) == 0, "compilation failed");
+  free(prog.filter);
+  CHECK(kafel_param_count(ctxt) == 1, "expected a parameter");
+
+  kafel_ctxt_reset(ctxt);
+  size_t len;
+  kafel_relocs(ctxt, &len);
+  CHECK(kafel_param_count(ctxt) == 0 && len == 0,
+        "parameters survived reset");
+
+  // input is kept
+  CHECK(kafel_compile(ctxt, &prog) == 0, "compilation after reset failed");
+  free(prog.filter);
+  CHECK(strcmp(kafel_param_name(ctxt, 0), "max") == 0,
+        "wrong parameter name");
+  kafel_ctxt_destroy(&ctxt);
+}
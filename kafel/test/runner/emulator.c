@@ -0,0 +1,219 @@
+/*
+   Kafel - BPF emulator
+   -----------------------------------------
+
+   Copyright 2026 The sandals authors.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+#include "emulator.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#ifndef SECCOMP_RET_KILL_PROCESS
+#define SECCOMP_RET_KILL_PROCESS 0x80000000U
+#endif
+
+int emulate_bpf_steps(const struct sock_fprog* prog,
+                      const struct seccomp_data* data, uint32_t* action) {
+  uint32_t a = 0, x = 0, mem[BPF_MEMWORDS] = {0};
+  int count = 0;
+
+  for (unsigned pc = 0; pc < prog->len; ++pc) {
+    const struct sock_filter* insn = &prog->filter[pc];
+    uint32_t src = BPF_SRC(insn->code) == BPF_X ? x : insn->k;
+    ++count;
+    switch (BPF_CLASS(insn->code)) {
+      case BPF_LD:
+        if (insn->code == (BPF_LD | BPF_W | BPF_ABS)) {
+          if (insn->k % 4 || insn->k + 4 > sizeof(*data)) {
+            return -1;
+          }
+          memcpy(&a, (const char*)data + insn->k, sizeof(a));
+        } else if (insn->code == (BPF_LD | BPF_IMM)) {
+          a = insn->k;
+        } else if (insn->code == (BPF_LD | BPF_MEM) && insn->k < BPF_MEMWORDS) {
+          a = mem[insn->k];
+        } else {
+          return -1;
+        }
+        break;
+      case BPF_LDX:
+        if (insn->code == (BPF_LDX | BPF_IMM)) {
+          x = insn->k;
+        } else if (insn->code == (BPF_LDX | BPF_MEM) &&
+                   insn->k < BPF_MEMWORDS) {
+          x = mem[insn->k];
+        } else {
+          return -1;
+        }
+        break;
+      case BPF_ST:
+      case BPF_STX:
+        if (insn->k >= BPF_MEMWORDS) {
+          return -1;
+        }
+        mem[insn->k] = BPF_CLASS(insn->code) == BPF_ST ? a : x;
+        break;
+      case BPF_ALU:
+        switch (BPF_OP(insn->code)) {
+          case BPF_ADD:
+            a += src;
+            break;
+          case BPF_SUB:
+            a -= src;
+            break;
+          case BPF_MUL:
+            a *= src;
+            break;
+          case BPF_DIV:
+            if (!src) {
+              return -1;
+            }
+            a /= src;
+            break;
+          case BPF_MOD:
+            if (!src) {
+              return -1;
+            }
+            a %= src;
+            break;
+          case BPF_AND:
+            a &= src;
+            break;
+          case BPF_OR:
+            a |= src;
+            break;
+          case BPF_XOR:
+            a ^= src;
+            break;
+          case BPF_LSH:
+            a = src < 32 ? a << src : 0;
+            break;
+          case BPF_RSH:
+            a = src < 32 ? a >> src : 0;
+            break;
+          case BPF_NEG:
+            a = -a;
+            break;
+          default:
+            return -1;
+        }
+        break;
+      case BPF_JMP: {
+        bool taken;
+        if (BPF_OP(insn->code) == BPF_JA) {
+          pc += insn->k;
+          break;
+        }
+        switch (BPF_OP(insn->code)) {
+          case BPF_JEQ:
+            taken = a == src;
+            break;
+          case BPF_JGT:
+            taken = a > src;
+            break;
+          case BPF_JGE:
+            taken = a >= src;
+            break;
+          case BPF_JSET:
+            taken = (a & src) != 0;
+            break;
+          default:
+            return -1;
+        }
+        pc += taken ? insn->jt : insn->jf;
+        break;
+      }
+      case BPF_RET:
+        *action = BPF_RVAL(insn->code) == BPF_A ? a : insn->k;
+        return count;
+      case BPF_MISC:
+        if (BPF_MISCOP(insn->code) == BPF_TAX) {
+          x = a;
+        } else {
+          a = x;
+        }
+        break;
+      default:
+        return -1;
+    }
+  }
+  // fell off the end
+  return -1;
+}
+
+uint32_t emulate_bpf(const struct sock_fprog* prog,
+                     const struct seccomp_data* data, int* steps) {
+  uint32_t action;
+  int count = emulate_bpf_steps(prog, data, &action);
+  if (steps != NULL) {
+    *steps = count;
+  }
+  return count < 0 ? SECCOMP_RET_KILL_PROCESS : action;
+}
+
+bool emulate_bpf_const_allow(const struct sock_fprog* prog, uint32_t nr,
+                             uint32_t arch) {
+  uint32_t a = 0;
+
+  for (unsigned pc = 0; pc < prog->len; ++pc) {
+    const struct sock_filter* insn = &prog->filter[pc];
+    bool taken;
+    switch (insn->code) {
+      case BPF_LD | BPF_W | BPF_ABS:
+        if (insn->k == offsetof(struct seccomp_data, nr)) {
+          a = nr;
+        } else if (insn->k == offsetof(struct seccomp_data, arch)) {
+          a = arch;
+        } else {
+          return false;  // argument load
+        }
+        break;
+      case BPF_RET | BPF_K:
+        return insn->k == SECCOMP_RET_ALLOW;
+      case BPF_JMP | BPF_JA:
+        pc += insn->k;
+        break;
+      case BPF_JMP | BPF_JEQ | BPF_K:
+      case BPF_JMP | BPF_JGE | BPF_K:
+      case BPF_JMP | BPF_JGT | BPF_K:
+      case BPF_JMP | BPF_JSET | BPF_K:
+        switch (BPF_OP(insn->code)) {
+          case BPF_JEQ:
+            taken = a == insn->k;
+            break;
+          case BPF_JGE:
+            taken = a >= insn->k;
+            break;
+          case BPF_JGT:
+            taken = a > insn->k;
+            break;
+          default:
+            taken = (a & insn->k) != 0;
+            break;
+        }
+        pc += taken ? insn->jt : insn->jf;
+        break;
+      case BPF_ALU | BPF_AND | BPF_K:
+        a &= insn->k;
+        break;
+      default:
+        return false;
+    }
+  }
+  return false;
+}
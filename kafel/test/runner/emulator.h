@@ -0,0 +1,50 @@
+/*
+   Kafel - BPF emulator
+   -----------------------------------------
+
+   Copyright 2026 The sandals authors.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+#ifndef KAFEL_TEST_RUNNER_EMULATOR_H_
+#define KAFEL_TEST_RUNNER_EMULATOR_H_
+
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Runs prog against data in userspace, the way the kernel would
+// Stores the seccomp action in action
+// Returns the number of executed instructions, or -1 on an invalid program
+//   (bad opcode, out of bounds jump or load, no return)
+int emulate_bpf_steps(const struct sock_fprog* prog,
+                      const struct seccomp_data* data, uint32_t* action);
+
+// Same as emulate_bpf_steps, stores the number of executed instructions in
+//   steps (if not NULL)
+// Returns the seccomp action, or SECCOMP_RET_KILL_PROCESS on an invalid
+//   program
+uint32_t emulate_bpf(const struct sock_fprog* prog,
+                     const struct seccomp_data* data, int* steps);
+
+// Mirrors the kernel's seccomp_is_const_allow(): tells whether prog
+//   provably allows syscall nr of arch regardless of its arguments, i.e.
+//   the syscall is put in the kernel's action cache (Linux 5.11+)
+// Only constant loads (nr, arch), constant jumps, AND and RET are followed
+bool emulate_bpf_const_allow(const struct sock_fprog* prog, uint32_t nr,
+                             uint32_t arch);
+
+#endif /* KAFEL_TEST_RUNNER_EMULATOR_H_ */
@@ -20,6 +20,7 @@
 
 #include "runner.h"
 
+#include <linux/audit.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -46,6 +47,20 @@ void test_failed(int line, const char* file) {
   test_case_failed_flag = true;
 }
 
+int test_compile(const char* policy, const test_compile_opts_t* opts,
+                 struct sock_fprog* prog) {
+  kafel_ctxt_t ctxt = kafel_ctxt_create();
+  kafel_set_input_string(ctxt, policy);
+  kafel_set_target_arch(ctxt, AUDIT_ARCH_X86_64);
+  if (opts != NULL) {
+    kafel_set_syscall_profile(ctxt, opts->profile, opts->profile_len);
+    kafel_set_peephole(ctxt, !opts->no_peephole);
+  }
+  int rv = kafel_compile(ctxt, prog);
+  kafel_ctxt_destroy(&ctxt);
+  return rv;
+}
+
 #define MAX_TESTS 4096
 
 test_case_def_t runner_tests[MAX_TESTS];
@@ -21,6 +21,11 @@
 #ifndef KAFEL_TEST_RUNNER_RUNNER_H_
 #define KAFEL_TEST_RUNNER_RUNNER_H_
 
+#include <kafel.h>
+#include <linux/filter.h>
+#include <stdbool.h>
+#include <stddef.h>
+
 __attribute__((format(printf, 1, 2))) void test_fail_with_message(
     const char* format, ...);
 void test_failed(int line, const char* file);
@@ -44,4 +49,26 @@ extern int runner_tests_count;
   }                                                                      \
   static void test_##test_case_name(void)
 
+#define ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
+
+#define CHECK(cond, ...)                   \
+  do {                                     \
+    if (!(cond)) {                         \
+      test_fail_with_message(__VA_ARGS__); \
+      test_failed(__LINE__, __FILE__);     \
+      return;                              \
+    }                                      \
+  } while (0)
+
+typedef struct {
+  const struct kafel_syscall_weight* profile;
+  size_t profile_len;
+  bool no_peephole;
+} test_compile_opts_t;
+
+// Compiles policy for x86-64 into prog, opts may be NULL
+// Returns kafel_compile() result
+int test_compile(const char* policy, const test_compile_opts_t* opts,
+                 struct sock_fprog* prog);
+
 #endif /* KAFEL_TEST_RUNNER_RUNNER_H_ */
@@ -0,0 +1,177 @@
+/*
+   Kafel - argument value set tests
+   -----------------------------------------
+
+   Copyright 2026 The sandals authors.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+#include <kafel.h>
+#include <linux/audit.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "runner/emulator.h"
+#include "runner/runner.h"
+
+#define NR_IOCTL 16
+#define NR_PRCTL 157
+
+#define ALLOWLIST_SIZE 200
+
+static uint64_t allowlist[ALLOWLIST_SIZE];
+
+// 100 scattered ioctl commands and a contiguous block of 100
+static void init_allowlist(void) {
+  for (int i = 0; i < 100; ++i) {
+    allowlist[i] = 0x5400 + i * 3;
+    allowlist[100 + i] = 0x8900 + i;
+  }
+}
+
+static bool in_allowlist(uint32_t value) {
+  for (size_t i = 0; i < ALLOWLIST_SIZE; ++i) {
+    if (allowlist[i] == value) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// POLICY with ALLOW { ioctl(fd, cmd, arg) { term || term ... } }, term
+// format taking a single value
+static char* allowlist_policy(const char* term) {
+  size_t size = 256 + ALLOWLIST_SIZE * (strlen(term) + 32);
+  char* policy = malloc(size);
+  size_t len = snprintf(policy, size,
+                        "POLICY a {\n"
+                        "  ALLOW { ioctl(fd, cmd, arg) {\n");
+  for (size_t i = 0; i < ALLOWLIST_SIZE; ++i) {
+    len += snprintf(policy + len, size - len, i ? " ||\n" : "");
+    len += snprintf(policy + len, size - len, term, (unsigned)allowlist[i]);
+  }
+  snprintf(policy + len, size - len, "\n  } }\n} USE a DEFAULT KILL");
+  return policy;
+}
+
+static uint32_t run(const struct sock_fprog* prog, uint32_t nr, int arg,
+                    uint64_t value, int* steps) {
+  struct seccomp_data data = {.nr = nr, .arch = AUDIT_ARCH_X86_64};
+  data.args[arg] = value;
+  return emulate_bpf(prog, &data, steps);
+}
+
+TEST_CASE(value_set_allowlist) {
+  struct sock_fprog tree, chain;
+  init_allowlist();
+  char* policy = allowlist_policy("cmd == %#x");
+  CHECK(test_compile(policy, NULL, &tree) == 0, "compilation failed");
+  free(policy);
+  // masking defeats value set detection, yielding a linear chain
+  policy = allowlist_policy("(cmd & 0xffffffff) == %#x");
+  CHECK(test_compile(policy, NULL, &chain) == 0, "compilation failed");
+  free(policy);
+
+  int tree_worst = 0, chain_worst = 0;
+  for (uint32_t cmd = 0x5300; cmd < 0x8a00; ++cmd) {
+    // high word of a 32-bit argument is ignored
+    uint64_t value = cmd | (uint64_t)0xdead << 32;
+    int steps;
+    uint32_t expected =
+        in_allowlist(cmd) ? SECCOMP_RET_ALLOW : SECCOMP_RET_KILL;
+    CHECK(run(&tree, NR_IOCTL, 1, value, &steps) == expected,
+          "wrong action for cmd %#x", cmd);
+    tree_worst = steps > tree_worst ? steps : tree_worst;
+    CHECK(run(&chain, NR_IOCTL, 1, value, &steps) == expected,
+          "wrong action for cmd %#x (chain)", cmd);
+    chain_worst = steps > chain_worst ? steps : chain_worst;
+  }
+  CHECK(run(&tree, NR_IOCTL, 1, UINT32_MAX, NULL) == SECCOMP_RET_KILL,
+        "wrong action for cmd %#x", UINT32_MAX);
+
+  fprintf(stderr,
+          "value_set_allowlist: worst case %d -> %d instructions "
+          "(%u -> %u instructions total)\n",
+          chain_worst, tree_worst, chain.len, tree.len);
+  CHECK(tree_worst * 10 < chain_worst, "%d vs %d instructions", tree_worst,
+        chain_worst);
+  CHECK(tree.len < chain.len, "%u vs %u instructions total", tree.len,
+        chain.len);
+
+  free(tree.filter);
+  free(chain.filter);
+}
+
+TEST_CASE(value_set_64bit) {
+  static const uint64_t values[] = {1, 2, 7, 0x100000001, 0x100000002,
+                                    0x100000003, 0xffffffff00000000};
+  static const uint64_t probes[] = {
+      0,           1,           2,           3,
+      7,           8,           0x100000000, 0x100000001,
+      0x100000003, 0x100000004, 0x200000001, 0xffffffff00000000,
+      0xffffffff00000001};
+  struct sock_fprog prog;
+  CHECK(test_compile("POLICY a {\n"
+                     "  ALLOW { ioctl(fd, cmd, arg) {\n"
+                     "    arg == 1 || arg == 0x100000001 || arg == 2 ||\n"
+                     "    arg == 7 || arg == 0x100000003 || fd == 5 ||\n"
+                     "    arg == 0x100000002 || arg == 0xffffffff00000000 ||\n"
+                     "    arg == 2\n"
+                     "  } }\n"
+                     "} USE a DEFAULT KILL",
+                     NULL, &prog) == 0,
+        "compilation failed");
+  for (size_t i = 0; i < ARRAY_SIZE(probes); ++i) {
+    bool allowed = false;
+    for (size_t j = 0; j < ARRAY_SIZE(values); ++j) {
+      allowed |= probes[i] == values[j];
+    }
+    CHECK(run(&prog, NR_IOCTL, 2, probes[i], NULL) ==
+              (allowed ? SECCOMP_RET_ALLOW : SECCOMP_RET_KILL),
+          "wrong action for arg %#llx", (unsigned long long)probes[i]);
+  }
+  struct seccomp_data data = {
+      .nr = NR_IOCTL, .arch = AUDIT_ARCH_X86_64, .args = {5, 0, 3}};
+  CHECK(emulate_bpf(&prog, &data, NULL) == SECCOMP_RET_ALLOW,
+        "other terms not checked");
+  free(prog.filter);
+}
+
+TEST_CASE(value_set_conjunction) {
+  struct sock_fprog prog;
+  CHECK(test_compile("POLICY a {\n"
+                     "  ERRNO(1) { prctl(option, arg2) {\n"
+                     "    option != 1 && option != 2 && option != 3 &&\n"
+                     "    arg2 != 9 && option != 4 && option != 15\n"
+                     "  } }\n"
+                     "} USE a DEFAULT ALLOW",
+                     NULL, &prog) == 0,
+        "compilation failed");
+  for (uint32_t option = 0; option < 20; ++option) {
+    for (uint64_t arg2 = 8; arg2 <= 10; ++arg2) {
+      bool denied = !(option >= 1 && option <= 4) && option != 15 && arg2 != 9;
+      struct seccomp_data data = {.nr = NR_PRCTL,
+                                  .arch = AUDIT_ARCH_X86_64,
+                                  .args = {option, arg2}};
+      CHECK(emulate_bpf(&prog, &data, NULL) ==
+                (denied ? SECCOMP_RET_ERRNO | 1 : SECCOMP_RET_ALLOW),
+            "wrong action for option %u, arg2 %llu", option,
+            (unsigned long long)arg2);
+    }
+  }
+  free(prog.filter);
+}
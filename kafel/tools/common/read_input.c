@@ -0,0 +1,38 @@
+/*
+   Kafel - tools input helper
+   -----------------------------------------
+
+   Copyright 2026 The sandals authors.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+#include "read_input.h"
+
+#include <stdlib.h>
+
+char* read_input(FILE* in) {
+  char* data = NULL;
+  size_t len = 0, capacity = 0, n;
+  do {
+    if (capacity - len < 4096) {
+      capacity = capacity ? capacity * 2 : 4096;
+      data = realloc(data, capacity);
+    }
+    n = fread(data + len, 1, capacity - len - 1, in);
+    len += n;
+  } while (n > 0);
+  data[len] = '\0';
+  return data;
+}
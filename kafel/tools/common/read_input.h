@@ -0,0 +1,29 @@
+/*
+   Kafel - tools input helper
+   -----------------------------------------
+
+   Copyright 2026 The sandals authors.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+#ifndef KAFEL_TOOLS_COMMON_READ_INPUT_H
+#define KAFEL_TOOLS_COMMON_READ_INPUT_H
+
+#include <stdio.h>
+
+// Reads in until EOF into a NULL-terminated string, caller frees it
+char* read_input(FILE* in);
+
+#endif /* KAFEL_TOOLS_COMMON_READ_INPUT_H */
@@ -0,0 +1,142 @@
+/*
+   Kafel - compile benchmark
+   -----------------------------------------
+
+   Copyright 2026 The sandals authors.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+// Measures compile throughput for each policy, creating a fresh context per
+// compilation vs reusing one context (kafel_compile resets it, keeping the
+// memory of the previous compilation).
+
+#include <kafel.h>
+#include <libgen.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../common/read_input.h"
+
+#define DEFAULT_ITERATIONS 2000
+
+static char* read_file(const char* path) {
+  FILE* f = fopen(path, "r");
+  if (f == NULL) {
+    fprintf(stderr, "Error: could not open file `%s'\n", path);
+    exit(EXIT_FAILURE);
+  }
+  char* data = read_input(f);
+  fclose(f);
+  return data;
+}
+
+static double cpu_time_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static bool compile(kafel_ctxt_t ctxt, const char* source,
+                    const char* include_path) {
+  struct sock_fprog prog;
+  kafel_set_input_string(ctxt, source);
+  if (include_path != NULL) {
+    kafel_add_include_search_path(ctxt, include_path);
+  }
+  if (kafel_compile(ctxt, &prog) != 0) {
+    return false;
+  }
+  free(prog.filter);
+  return true;
+}
+
+static void usage(const char* argv0) {
+  fprintf(stderr,
+          "Usage: %s [-n ITERATIONS] INPUT...\n"
+          "  -n  compilations per policy and mode (%d)\n",
+          argv0, DEFAULT_ITERATIONS);
+}
+
+int main(int argc, char** argv) {
+  int iterations = DEFAULT_ITERATIONS;
+  int opt;
+  while ((opt = getopt(argc, argv, "n:")) != -1) {
+    switch (opt) {
+      case 'n':
+        iterations = atoi(optarg);
+        break;
+      default: /* '?' */
+        usage(argv[0]);
+        return -1;
+    }
+  }
+  if (iterations <= 0 || argc <= optind) {
+    usage(argv[0]);
+    return -1;
+  }
+
+  printf("%-44s %10s %10s %8s\n", "policy", "fresh(us)", "reused(us)",
+         "speedup");
+  double fresh_total = 0, reused_total = 0;
+  for (int i = optind; i < argc; ++i) {
+    char* source = read_file(argv[i]);
+    char* path = strdup(argv[i]);
+    char* dir = dirname(path);
+    const char* name = strrchr(argv[i], '/');
+    name = name != NULL ? name + 1 : argv[i];
+
+    kafel_ctxt_t ctxt = kafel_ctxt_create();
+    bool ok = compile(ctxt, source, dir);
+    if (!ok) {
+      // ex: include loops in test data
+      printf("%-44s skipped, compile error\n", name);
+      kafel_ctxt_destroy(&ctxt);
+      free(path);
+      free(source);
+      continue;
+    }
+
+    double start = cpu_time_us();
+    for (int j = 0; j < iterations; ++j) {
+      kafel_ctxt_t fresh = kafel_ctxt_create();
+      compile(fresh, source, dir);
+      kafel_ctxt_destroy(&fresh);
+    }
+    double fresh = (cpu_time_us() - start) / iterations;
+
+    start = cpu_time_us();
+    for (int j = 0; j < iterations; ++j) {
+      compile(ctxt, source, NULL);
+    }
+    double reused = (cpu_time_us() - start) / iterations;
+    kafel_ctxt_destroy(&ctxt);
+
+    printf("%-44s %10.2f %10.2f %7.2fx\n", name, fresh, reused,
+           fresh / reused);
+    fresh_total += fresh;
+    reused_total += reused;
+    free(path);
+    free(source);
+  }
+  if (reused_total > 0) {
+    printf("%-44s %10.2f %10.2f %7.2fx\n", "total", fresh_total,
+           reused_total, fresh_total / reused_total);
+  }
+  return 0;
+}
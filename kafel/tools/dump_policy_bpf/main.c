@@ -23,13 +23,28 @@
 #include <stdlib.h>
 #include <unistd.h>
 
+#include "../common/read_input.h"
 #include "disasm.h"
 #include "print.h"
 
+static int compile(const char* source, int peephole, struct sock_fprog* prog) {
+  kafel_ctxt_t ctxt = kafel_ctxt_create();
+  kafel_set_input_string(ctxt, source);
+  kafel_set_peephole(ctxt, peephole);
+  int rv = kafel_compile(ctxt, prog);
+  if (rv != 0) {
+    fprintf(stderr, "Compile error\n");
+    fprintf(stderr, "\t%s", kafel_error_msg(ctxt));
+  }
+  kafel_ctxt_destroy(&ctxt);
+  return rv;
+}
+
 int main(int argc, char** argv) {
   enum mode { HUMAN_READABLE, C_SOURCE_FILE } mode = HUMAN_READABLE;
+  int peephole = 1;
   int opt;
-  while ((opt = getopt(argc, argv, "hc")) != -1) {
+  while ((opt = getopt(argc, argv, "hcu")) != -1) {
     switch (opt) {
       case 'n':
         mode = HUMAN_READABLE;
@@ -37,8 +52,11 @@ int main(int argc, char** argv) {
       case 'c':
         mode = C_SOURCE_FILE;
         break;
+      case 'u':
+        peephole = 0;
+        break;
       default: /* '?' */
-        fprintf(stderr, "Usage: %s [-hc] INPUT\n", argv[0]);
+        fprintf(stderr, "Usage: %s [-hcu] INPUT\n", argv[0]);
         return -1;
     }
   }
@@ -51,25 +69,27 @@ int main(int argc, char** argv) {
       return -1;
     }
   }
-
-  kafel_ctxt_t ctxt = kafel_ctxt_create();
-  kafel_set_input_file(ctxt, in);
-
-  struct sock_fprog prog;
-  int rv = kafel_compile(ctxt, &prog);
+  char* source = read_input(in);
   if (in != stdin) {
     fclose(in);
   }
-  if (rv != 0) {
-    fprintf(stderr, "Compile error\n");
-    fprintf(stderr, "\t%s", kafel_error_msg(ctxt));
-    kafel_ctxt_destroy(&ctxt);
+
+  // the unoptimized program is only compiled for its length
+  struct sock_fprog prog, plain;
+  if (compile(source, peephole, &prog) != 0 ||
+      compile(source, 0, &plain) != 0) {
+    free(source);
     return -1;
   }
-  kafel_ctxt_destroy(&ctxt);
+  free(source);
+  free(plain.filter);
   switch (mode) {
     case HUMAN_READABLE:
-      printf("BPF program with %d instructions\n", prog.len);
+      printf("BPF program with %d instructions", prog.len);
+      if (peephole) {
+        printf(" (%d before peephole optimization)", plain.len);
+      }
+      printf("\n");
       disasm(prog);
       break;
     case C_SOURCE_FILE:
@@ -0,0 +1,51 @@
+#!/bin/sh
+#
+#   Kafel - filter cost benchmark
+#   -----------------------------------------
+#
+#   Copyright 2026 The sandals authors.
+#
+#   Licensed under the Apache License, Version 2.0 (the "License");
+#   you may not use this file except in compliance with the License.
+#   You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+#   Unless required by applicable law or agreed to in writing, software
+#   distributed under the License is distributed on an "AS IS" BASIS,
+#   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#   See the License for the specific language governing permissions and
+#   limitations under the License.
+#
+# Prints length, average and worst case instructions per syscall for each
+# policy. Save the output and pass it as BASELINE to get deltas, ex:
+#   make bench > before.txt; (change codegen); make bench BASELINE=before.txt
+
+POLICY_COST=${POLICY_COST:-$(dirname "$0")/policy_cost}
+
+# A failing policy_cost aborts the benchmark rather than printing zeros
+results=$(
+  for policy in "$@"; do
+    out=$("$POLICY_COST" "$policy") || exit 1
+    printf '%s\n' "$out" | awk -v name="$(basename "$policy")" '
+      /^length:/ { length_ = $2 }
+      /^average:/ { average = $2 }
+      /^worst case:/ { worst = $3 }
+      END { printf "%-44s %8d %8.2f %8d\n", name, length_, average, worst }
+    '
+  done
+) || exit 1
+
+printf '%-44s %8s %8s %8s\n' policy length average worst
+printf '%s\n' "$results" | if [ -n "$BASELINE" ]; then
+  awk '
+    NR == FNR { if (FNR > 1) { len[$1] = $2; avg[$1] = $3; worst[$1] = $4 }; next }
+    !($1 in len) { print; next }
+    {
+      printf "%-44s %8d %8.2f %8d  (%+d, %+.2f, %+d)\n", $1, $2, $3, $4,
+             $2 - len[$1], $3 - avg[$1], $4 - worst[$1]
+    }
+  ' "$BASELINE" -
+else
+  cat
+fi
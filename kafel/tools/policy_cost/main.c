@@ -0,0 +1,252 @@
+/*
+   Kafel - policy cost
+   -----------------------------------------
+
+   Copyright 2026 The sandals authors.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+*/
+
+// Runs a compiled policy in userspace against every syscall number and a
+// set of argument vectors, and reports instructions executed per syscall.
+
+#include <inttypes.h>
+#include <kafel.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "runner/emulator.h"
+
+#define MAX_CONSTANTS 256
+#define DEFAULT_SYSCALLS 512
+#define DEFAULT_RANDOM_VECTORS 16
+
+struct vectors {
+  uint64_t* data;
+  size_t len;
+};
+
+static void add_vector(struct vectors* vectors, uint64_t value) {
+  vectors->data[vectors->len++] = value;
+}
+
+static uint64_t xorshift(uint64_t* state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return *state;
+}
+
+// All arguments of a vector share the same value: zero, all ones,
+// constants the program compares against (so that matching paths are
+// taken too) and pseudo-random values
+static struct vectors make_vectors(const struct sock_fprog* prog,
+                                   int random_vectors) {
+  struct vectors vectors;
+  vectors.data = calloc(2 + 2 * MAX_CONSTANTS + random_vectors,
+                        sizeof(*vectors.data));
+  vectors.len = 0;
+  add_vector(&vectors, 0);
+  add_vector(&vectors, UINT64_MAX);
+  size_t constants = 0;
+  for (size_t i = 0; i < prog->len && constants < MAX_CONSTANTS; ++i) {
+    const struct sock_filter* inst = &prog->filter[i];
+    if (BPF_CLASS(inst->code) != BPF_JMP || BPF_OP(inst->code) == BPF_JA ||
+        BPF_SRC(inst->code) != BPF_K) {
+      continue;
+    }
+    bool seen = false;
+    for (size_t j = 0; j < vectors.len; ++j) {
+      seen |= vectors.data[j] == inst->k;
+    }
+    if (!seen) {
+      add_vector(&vectors, inst->k);
+      add_vector(&vectors, (uint64_t)inst->k << 32 | inst->k);
+      ++constants;
+    }
+  }
+  uint64_t state = 0x2545f4914f6cdd1d;
+  for (int i = 0; i < random_vectors; ++i) {
+    add_vector(&vectors, xorshift(&state));
+  }
+  return vectors;
+}
+
+// Architecture the program accepts, taken from its leading arch check
+static uint32_t program_arch(const struct sock_fprog* prog) {
+  for (size_t i = 0; i + 1 < prog->len; ++i) {
+    if (prog->filter[i].code == (BPF_LD | BPF_W | BPF_ABS) &&
+        prog->filter[i].k == offsetof(struct seccomp_data, arch) &&
+        prog->filter[i + 1].code == (BPF_JMP | BPF_JEQ | BPF_K)) {
+      return prog->filter[i + 1].k;
+    }
+  }
+  return 0;
+}
+
+static struct kafel_syscall_weight* load_profile(const char* path,
+                                                 size_t* len) {
+  FILE* f = fopen(path, "r");
+  if (f == NULL) {
+    fprintf(stderr, "Error: could not open file `%s'\n", path);
+    exit(EXIT_FAILURE);
+  }
+  struct kafel_syscall_weight* profile;
+  if (kafel_read_syscall_profile(f, &profile, len) != 0) {
+    fprintf(stderr, "Error: `%s' is not a syscall profile\n", path);
+    exit(EXIT_FAILURE);
+  }
+  fclose(f);
+  return profile;
+}
+
+static void usage(const char* argv0) {
+  fprintf(stderr,
+          "Usage: %s [-v] [-n SYSCALLS] [-r VECTORS] [-p PROFILE | -w PROFILE]"
+          " INPUT\n"
+          "  -v  print cost of every syscall\n"
+          "  -n  number of syscalls to check (%d)\n"
+          "  -r  number of random argument vectors (%d)\n"
+          "  -p  compile with syscall profile, report weighted average\n"
+          "  -w  report weighted average only\n",
+          argv0, DEFAULT_SYSCALLS, DEFAULT_RANDOM_VECTORS);
+}
+
+int main(int argc, char** argv) {
+  bool verbose = false, compile_with_profile = false;
+  int syscalls = DEFAULT_SYSCALLS, random_vectors = DEFAULT_RANDOM_VECTORS;
+  struct kafel_syscall_weight* profile = NULL;
+  size_t profile_len = 0;
+  int opt;
+  while ((opt = getopt(argc, argv, "vn:r:p:w:")) != -1) {
+    switch (opt) {
+      case 'v':
+        verbose = true;
+        break;
+      case 'n':
+        syscalls = atoi(optarg);
+        break;
+      case 'r':
+        random_vectors = atoi(optarg);
+        break;
+      case 'p':
+        compile_with_profile = true;
+      // fall-through
+      case 'w':
+        free(profile);
+        profile = load_profile(optarg, &profile_len);
+        break;
+      default: /* '?' */
+        usage(argv[0]);
+        return -1;
+    }
+  }
+  if (syscalls <= 0 || random_vectors < 0) {
+    usage(argv[0]);
+    return -1;
+  }
+
+  FILE* in = stdin;
+  const char* name = "stdin";
+  if (argc > optind) {
+    name = argv[optind];
+    in = fopen(name, "r");
+    if (in == NULL) {
+      fprintf(stderr, "Error: could not open file `%s'\n", name);
+      return -1;
+    }
+  }
+
+  kafel_ctxt_t ctxt = kafel_ctxt_create();
+  kafel_set_input_file(ctxt, in);
+  if (compile_with_profile) {
+    kafel_set_syscall_profile(ctxt, profile, profile_len);
+  }
+
+  struct sock_fprog prog;
+  int rv = kafel_compile(ctxt, &prog);
+  if (in != stdin) {
+    fclose(in);
+  }
+  if (rv != 0) {
+    fprintf(stderr, "Compile error\n");
+    fprintf(stderr, "\t%s", kafel_error_msg(ctxt));
+    kafel_ctxt_destroy(&ctxt);
+    return -1;
+  }
+  kafel_ctxt_destroy(&ctxt);
+
+  struct vectors vectors = make_vectors(&prog, random_vectors);
+  struct seccomp_data data = {.arch = program_arch(&prog)};
+  double total = 0, weighted_total = 0, weight_sum = 0;
+  int worst = 0;
+  uint32_t worst_nr = 0;
+  for (int nr = 0; nr < syscalls; ++nr) {
+    int min = -1, max = 0;
+    double sum = 0;
+    uint32_t action = 0;
+    data.nr = nr;
+    for (size_t i = 0; i < vectors.len; ++i) {
+      for (int arg = 0; arg < 6; ++arg) {
+        data.args[arg] = vectors.data[i];
+      }
+      int steps = emulate_bpf_steps(&prog, &data, &action);
+      if (steps < 0) {
+        fprintf(stderr, "Invalid program (syscall %d)\n", nr);
+        return -1;
+      }
+      sum += steps;
+      min = min < 0 || steps < min ? steps : min;
+      max = steps > max ? steps : max;
+    }
+    double avg = sum / vectors.len;
+    total += avg;
+    for (size_t i = 0; i < profile_len; ++i) {
+      if (profile[i].nr == (uint32_t)nr) {
+        weighted_total += avg * profile[i].weight;
+        weight_sum += profile[i].weight;
+      }
+    }
+    if (max > worst) {
+      worst = max;
+      worst_nr = nr;
+    }
+    if (verbose) {
+      printf("syscall %d: %d/%.2f/%d instructions (min/avg/max)\n", nr, min,
+             avg, max);
+    }
+  }
+
+  printf("policy: %s\n", name);
+  printf("length: %u of %d instructions (%.1f%%)\n", prog.len, BPF_MAXINSNS,
+         100.0 * prog.len / BPF_MAXINSNS);
+  printf("checked: %d syscalls, %zu argument vectors\n", syscalls,
+         vectors.len);
+  printf("average: %.2f instructions per syscall\n", total / syscalls);
+  printf("worst case: %d instructions (syscall %" PRIu32 ")\n", worst,
+         worst_nr);
+  if (weight_sum > 0) {
+    printf("weighted average: %.2f instructions per syscall\n",
+           weighted_total / weight_sum);
+  }
+
+  free(vectors.data);
+  free(profile);
+  free(prog.filter);
+  return 0;
+}
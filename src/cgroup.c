@@ -4,16 +4,33 @@
 #include <fcntl.h>
 #include <poll.h>
 #include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/file.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/xattr.h>
+#include <time.h>
 #include <unistd.h>
 
+#ifndef SYS_pidfd_send_signal
+#define SYS_pidfd_send_signal 424
+#endif
+
 pid_t spawner_pid;
+int spawner_pidfd = -1;
 
 static char cgroup_path[PATH_MAX];
 static int cgroupevents_fd; // "cgroup.events"
+static int cgroupkill_fd = -1; // "cgroup.kill"
+static bool cgroup_pooled; // recycle instead of rmdir, locked via cgroupevents_fd
+
+enum { kCgroupPoolMax = 256 };
+static const char kCgroupXattr[] = "user.sandals";
 
 // We exit() on unrecoverable error. The only resource in need of
 // cleanup in sandals is the cgroup we've created. For simplicity, we
@@ -24,22 +41,18 @@ static int cgroupevents_fd; // "cgroup.events"
 //       or we are the spawner and aren't responsible for cleaning up)
 //   -1  rmdir cgroup (cgroup was created; fork pending or failed)
 //  pid  kill pid, rmdir cgroup
-static void cleanup_cgroup() __attribute__((destructor));
-void cleanup_cgroup() {
+//
+// Pooled cgroups are recycled rather than removed.
+static void remove_cgroup() {
     char buf[128];
     struct pollfd pollfd = {
         .fd = cgroupevents_fd,
         .events = POLLPRI
     };
-    if (!spawner_pid || !cgroup_path[0]) return;
+    struct timespec start, end;
 
-    // Pending cgroup cleanup will take a while. Close early explicitly
-    // so that a user will get the response faster.
-    // CAVEAT: sandboxed processes may not terminate yet. This might be
-    // an issue if a directory was mapped RW into the sandbox.
-    close(response_fd);
+    clock_gettime(CLOCK_MONOTONIC, &start);
 
-    if (spawner_pid != -1) kill(spawner_pid, SIGKILL);
     // wait for cgroup to be vacated and remove it
     while (rmdir(cgroup_path)==-1) {
         // read resets internal 'updates pending' flag;
@@ -52,9 +65,148 @@ void cleanup_cgroup() {
             return;
         }
     }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    log_debug("Cgroup '%s' removed in %.3fms", cgroup_path,
+        (end.tv_sec - start.tv_sec)*1e3 + (end.tv_nsec - start.tv_nsec)/1e6);
 }
 
-static const char *create_cgroup(const struct sandals_request *request)
+// Drop page cache and alike charged to the cgroup, so that the next
+// lease starts clean. Best effort.
+static void reclaim_memory() {
+    char path_buf[PATH_MAX], buf[32];
+    ssize_t rc = -1;
+    int fd;
+
+    if (snprintf(path_buf, sizeof path_buf, "%s/memory.current", cgroup_path)
+        < sizeof path_buf
+        && (fd = open(path_buf, O_RDONLY|O_CLOEXEC|O_NOCTTY)) != -1
+    ) {
+        rc = read(fd, buf, sizeof buf);
+        close(fd);
+    }
+    if (rc <= 0 || buf[0] == '0') return;
+
+    if (snprintf(path_buf, sizeof path_buf, "%s/memory.reclaim", cgroup_path)
+        < sizeof path_buf
+        && (fd = open(path_buf, O_WRONLY|O_CLOEXEC|O_NOCTTY)) != -1
+    ) {
+        // EAGAIN if failed to reclaim the full amount, that's ok
+        if (write(fd, buf, rc) == -1 && errno != EAGAIN)
+            log_error("Writing '%s': %s", path_buf, strerror(errno));
+        close(fd);
+    }
+}
+
+// Wait for pooled cgroup to be vacated; lock is released on exit.
+static void recycle_cgroup() {
+    struct pollfd pollfd = {
+        .fd = cgroupevents_fd,
+        .events = POLLPRI
+    };
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // read resets internal 'updates pending' flag
+    while (cgroup_stat(cgroupevents_fd, "populated", "cgroup.events")) {
+        if (poll(&pollfd, 1, -1) == -1 && errno != EINTR) {
+            log_error("Waiting for cgroup '%s': %s",
+                cgroup_path, strerror(errno));
+            return;
+        }
+    }
+
+    reclaim_memory();
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    log_debug("Cgroup '%s' recycled in %.3fms", cgroup_path,
+        (end.tv_sec - start.tv_sec)*1e3 + (end.tv_nsec - start.tv_nsec)/1e6);
+}
+
+static void cleanup_cgroup() __attribute__((destructor));
+void cleanup_cgroup() {
+    pid_t pid;
+    if (!spawner_pid || !cgroup_path[0]) return;
+
+    // Pending cgroup cleanup will take a while. Close early explicitly
+    // so that a user will get the response faster.
+    // CAVEAT: sandboxed processes may not terminate yet. This might be
+    // an issue if a directory was mapped RW into the sandbox.
+    close(response_fd);
+
+    // kill everything in one go (5.14+); killing the spawner (pid 1
+    // in namespace) takes down the remaining processes as well,
+    // though slower
+    if ((cgroupkill_fd == -1 || write(cgroupkill_fd, "1", 1) != 1)
+        && spawner_pid != -1
+    ) spawner_kill();
+
+    // Waiting for the kernel to tear down namespaces takes a while,
+    // do it in a detached reaper (double fork, reparented to init).
+    switch ((pid = fork())) {
+    case -1:
+        log_error("fork: %s", strerror(errno));
+        if (cgroup_pooled) recycle_cgroup(); else remove_cgroup();
+        return;
+    case 0:
+        if (fork()) _exit(EXIT_SUCCESS);
+        spawner_pid = 0; // in case we fail(), don't run cleanup again
+        // don't hold caller's stdio open; keep stderr if debugging
+        close_stray_fds_except(cgroupevents_fd);
+        close(STDIN_FILENO);
+        close(STDOUT_FILENO);
+        if (!debug_enabled) close(STDERR_FILENO);
+        if (cgroup_pooled) recycle_cgroup(); else remove_cgroup();
+        _exit(EXIT_SUCCESS);
+    default:
+        waitpid(pid, NULL, 0);
+    }
+}
+
+long long cgroup_stat(int fd, const char *key, const char *filename) {
+    char buf[4096], *p = buf;
+    size_t keylen = strlen(key);
+    ssize_t rc = pread(fd, buf, sizeof buf - 1, 0);
+    if (rc == -1)
+        fail(kStatusInternalError,
+            "Reading '%s': %s", filename, strerror(errno));
+    buf[rc] = 0;
+    while (p) {
+        if (!strncmp(p, key, keylen) && p[keylen] == ' ')
+            return strtoll(p + keylen + 1, NULL, 10);
+        if ((p = strchr(p, '\n'))) ++p;
+    }
+    return 0;
+}
+
+// Sum rbytes and wbytes across devices.
+void cgroup_io_stat(int fd, long long *rbytes, long long *wbytes) {
+    char buf[4096], *p = buf;
+    ssize_t rc = pread(fd, buf, sizeof buf - 1, 0);
+    if (rc == -1)
+        fail(kStatusInternalError, "Reading 'io.stat': %s", strerror(errno));
+    buf[rc] = 0;
+    *rbytes = *wbytes = 0;
+    // 8:0 rbytes=1459200 wbytes=314773504 rios=192 wios=353 ...
+    while ((p = strchr(p, ' '))) {
+        ++p;
+        if (!strncmp(p, "rbytes=", 7)) *rbytes += strtoll(p + 7, NULL, 10);
+        if (!strncmp(p, "wbytes=", 7)) *wbytes += strtoll(p + 7, NULL, 10);
+    }
+}
+
+// Pidfd is immune to pid reuse; matters if someone else reaps the
+// spawner (ex: a zygote is a child of the server).
+void spawner_kill() {
+    if (spawner_pidfd == -1 || syscall(
+        SYS_pidfd_send_signal, spawner_pidfd, SIGKILL, NULL, 0) == -1
+        && errno == ENOSYS
+    ) kill(spawner_pid, SIGKILL);
+}
+
+// Store the parent of the cgroup to create in cgroup_path, return length
+static size_t cgroup_parent(const struct sandals_request *request)
 {
     size_t len;
 
@@ -95,6 +247,13 @@ static const char *create_cgroup(const struct sandals_request *request)
         do --len; while (len && cgroup_path[len] != '/');
     }
 
+    return len;
+}
+
+static const char *create_cgroup(const struct sandals_request *request)
+{
+    size_t len = cgroup_parent(request);
+
     // Format cgroup_path
     if (len >= sizeof(cgroup_path)
         || len + snprintf(cgroup_path + len, sizeof(cgroup_path) - len,
@@ -111,16 +270,96 @@ static const char *create_cgroup(const struct sandals_request *request)
     return cgroup_path;
 }
 
+// FNV-1a
+static uint64_t cgroup_config_hash(const struct sandals_request *request) {
+    const char *key;
+    const jstr_token_t *value;
+    uint64_t hash = UINT64_C(0xcbf29ce484222325);
+    JSOBJECT_FOREACH(request->cgroup_config, key, value) {
+        const char *strval = jsget_str(request->json_root, value);
+        // include terminating NULs
+        for (const char *p = key; p == key || p[-1]; ++p)
+            hash = (hash ^ (unsigned char)*p) * UINT64_C(0x100000001b3);
+        for (const char *p = strval; p == strval || p[-1]; ++p)
+            hash = (hash ^ (unsigned char)*p) * UINT64_C(0x100000001b3);
+    }
+    return hash;
+}
+
+// Pooled cgroups are named after cgroupConfig hash, hence identically
+// configured. A cgroup is leased by locking cgroup.events. Returns
+// NULL if all slots are busy.
+static const char *lease_cgroup(
+    const struct sandals_request *request, bool *configured)
+{
+    size_t len = cgroup_parent(request);
+    uint64_t hash = cgroup_config_hash(request);
+
+    for (int i = 0; i < kCgroupPoolMax; ++i) {
+        int fd;
+        if (len >= sizeof(cgroup_path)
+            || len + snprintf(cgroup_path + len, sizeof(cgroup_path) - len,
+                "/sandals-pool-%016llx-%d%s", (unsigned long long)hash, i,
+                "/cgroup.events") >= sizeof cgroup_path
+        ) fail(kStatusInternalError, "Path too long");
+
+        if ((fd = open(cgroup_path, O_RDONLY|O_CLOEXEC|O_NOCTTY)) == -1) {
+            if (errno != ENOENT)
+                fail(kStatusInternalError,
+                    "Opening '%s': %s", cgroup_path, strerror(errno));
+            cgroup_path[strlen(cgroup_path) - strlen("/cgroup.events")] = 0;
+            if (mkdir(cgroup_path, 0700) == -1 && errno != EEXIST)
+                fail(kStatusInternalError,
+                    "Creating '%s': %s", cgroup_path, strerror(errno));
+            strcat(cgroup_path, "/cgroup.events");
+            fd = open_checked(cgroup_path, O_RDONLY|O_CLOEXEC|O_NOCTTY, 0);
+        }
+
+        if (flock(fd, LOCK_EX|LOCK_NB) == -1) {
+            if (errno != EWOULDBLOCK)
+                fail(kStatusInternalError,
+                    "Locking '%s': %s", cgroup_path, strerror(errno));
+            close(fd);
+            continue;
+        }
+
+        // previous user crashed and the cgroup isn't vacated yet
+        if (cgroup_stat(fd, "populated", "cgroup.events")) {
+            close(fd);
+            continue;
+        }
+
+        // leased
+        cgroup_path[strlen(cgroup_path) - strlen("/cgroup.events")] = 0;
+        cgroupevents_fd = fd;
+        cgroup_pooled = true;
+        *configured = getxattr(cgroup_path, kCgroupXattr, NULL, 0) != -1;
+
+        // enable cleanup_cgroup() destructor
+        spawner_pid = -1;
+
+        return cgroup_path;
+    }
+    return NULL;
+}
+
 void configure_cgroup(
     const struct sandals_request *request, struct cgroup_ctx *ctx) {
 
-    const char *cgroup_path;
+    const char *cgroup_path = NULL;
     const char *key;
     const jstr_token_t *value;
     int memoryevents = 0, pidevents = 0;
+    bool configured = false;
+    bool cpu_limited = request->cpu_time_limit.tv_sec != LONG_MAX;
     char path_buf[PATH_MAX];
 
-    cgroup_path = request->cgroup ? request->cgroup : create_cgroup(request);
+    if (request->cgroup)
+        cgroup_path = request->cgroup;
+    else if (request->cgroup_pool)
+        cgroup_path = lease_cgroup(request, &configured);
+    if (!cgroup_path)
+        cgroup_path = create_cgroup(request);
 
     JSOBJECT_FOREACH(request->cgroup_config, key, value) {
 
@@ -129,17 +368,29 @@ void configure_cgroup(
 
         while (*key=='/') ++key;
 
+        if (!strncmp(key, "memory.", 7)) memoryevents = 1;
+        if (!strncmp(key, "pids.", 5)) pidevents = 1;
+
+        if (configured) continue;
+
         if (snprintf(path_buf, sizeof path_buf, "%s/%s", cgroup_path, key)
         >= sizeof path_buf) fail(kStatusInternalError, "Path too long");
 
         fd = open_checked(path_buf, O_WRONLY|O_CLOEXEC|O_NOCTTY, 0),
         write_checked(fd, strval, strlen(strval), path_buf);
         close(fd);
-
-        if (!strncmp(key, "memory.", 7)) memoryevents = 1;
-        if (!strncmp(key, "pids.", 5)) pidevents = 1;
     }
 
+    // mark pooled cgroup as configured; if xattrs aren't supported
+    // we will configure it every time
+    if (cgroup_pooled && !configured)
+        setxattr(cgroup_path, kCgroupXattr, "", 0, 0);
+
+    ctx->cgroup_fd = open_checked(
+        cgroup_path, O_RDONLY|O_DIRECTORY|O_CLOEXEC, 0);
+
+    ctx->reused = request->cgroup || cgroup_pooled;
+
     // ensure we can safely append any of cgroup.procs, memory.events or
     // cgroup.events suffixes
     struct suffix { const char data[14]; };
@@ -152,11 +403,16 @@ void configure_cgroup(
     sprintf(path_buf, "%s%s", cgroup_path, SUFFIX("/cgroup.procs"));
     ctx->cgroupprocs_fd = open_checked(path_buf, O_WRONLY|O_CLOEXEC|O_NOCTTY, 0);
 
-    // open cgroup.events (iff we will have to remove the cgroup)
+    // open cgroup.events and cgroup.kill (iff we will have to remove
+    // the cgroup); cgroup.kill is missing in older kernels
     if (!request->cgroup) {
-        sprintf(path_buf, "%s%s", cgroup_path, SUFFIX("/cgroup.events"));
-        cgroupevents_fd = open_checked(
-            path_buf, O_RDONLY|O_CLOEXEC|O_NOCTTY, 0);
+        if (!cgroup_pooled) {
+            sprintf(path_buf, "%s%s", cgroup_path, SUFFIX("/cgroup.events"));
+            cgroupevents_fd = open_checked(
+                path_buf, O_RDONLY|O_CLOEXEC|O_NOCTTY, 0);
+        }
+        sprintf(path_buf, "%s%s", cgroup_path, SUFFIX("/cgroup.kill"));
+        cgroupkill_fd = open(path_buf, O_WRONLY|O_CLOEXEC|O_NOCTTY);
     }
 
     // open memory.events
@@ -164,6 +420,8 @@ void configure_cgroup(
         sprintf(path_buf, "%s%s", cgroup_path, SUFFIX("/memory.events"));
         ctx->memoryevents_fd = open_checked(
             path_buf, O_RDONLY|O_CLOEXEC|O_NOCTTY, 0);
+        if (ctx->reused) ctx->oomkill_base = cgroup_stat(
+            ctx->memoryevents_fd, "oom_kill", "memory.events");
     }
 
     // open pids.events
@@ -171,5 +429,47 @@ void configure_cgroup(
         sprintf(path_buf, "%s%s", cgroup_path, SUFFIX("/pids.events"));
         ctx->pidsevents_fd = open_checked(
             path_buf, O_RDONLY|O_CLOEXEC|O_NOCTTY, 0);
+        if (ctx->reused) ctx->pidsmax_base = cgroup_stat(
+            ctx->pidsevents_fd, "max", "pids.events");
+    }
+
+    // cpuTimeLimit is enforced against cpu.stat
+    if (cpu_limited) {
+        sprintf(path_buf, "%s%s", cgroup_path, SUFFIX("/cpu.stat"));
+        ctx->cpustat_fd = open_checked(
+            path_buf, O_RDONLY|O_CLOEXEC|O_NOCTTY, 0);
+    }
+
+    // Counters in a reused cgroup accumulate across tasks, take
+    // baseline snapshots. Memory.peak is reset via a write, the new
+    // value is only observable through the same fd (6.12+).
+    if (ctx->reused && (request->usage || cpu_limited)) {
+        int fd = ctx->cpustat_fd != -1 ? ctx->cpustat_fd : openat(
+            ctx->cgroup_fd, "cpu.stat", O_RDONLY|O_CLOEXEC|O_NOCTTY);
+        if (fd != -1) {
+            ctx->cpu_usage_base = cgroup_stat(fd, "usage_usec", "cpu.stat");
+            ctx->cpu_user_base = cgroup_stat(fd, "user_usec", "cpu.stat");
+            ctx->cpu_system_base = cgroup_stat(fd, "system_usec", "cpu.stat");
+            if (fd != ctx->cpustat_fd) close(fd);
+        }
+    }
+
+    if (ctx->reused && request->usage) {
+        int fd;
+        sprintf(path_buf, "%s%s", cgroup_path, SUFFIX("/memory.peak"));
+        if ((ctx->memorypeak_fd = open(
+                path_buf, O_RDWR|O_CLOEXEC|O_NOCTTY)) != -1
+            && write(ctx->memorypeak_fd, "reset", 5) != 5
+        ) {
+            close(ctx->memorypeak_fd);
+            ctx->memorypeak_fd = -1;
+        }
+
+        if ((fd = openat(ctx->cgroup_fd, "io.stat",
+            O_RDONLY|O_CLOEXEC|O_NOCTTY)) != -1
+        ) {
+            cgroup_io_stat(fd, &ctx->io_read_base, &ctx->io_write_base);
+            close(fd);
+        }
     }
 }
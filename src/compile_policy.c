@@ -0,0 +1,84 @@
+// sandals-compile-policy: compile a Kafel policy into a raw BPF
+// program suitable for seccompBpf request key.
+#include "seccomp.h"
+#include "kafel/include/kafel.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Syscall profile: 'NR COUNT' lines, ex: counts from 'strace -c' of
+// a representative run mapped to syscall numbers.
+static struct kafel_syscall_weight *load_profile(
+    const char *path, size_t *len) {
+
+    struct kafel_syscall_weight *profile;
+    FILE *f;
+
+    if (!(f = fopen(path, "r"))) {
+        fprintf(stderr, "Opening '%s': %s\n", path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    if (kafel_read_syscall_profile(f, &profile, len)) {
+        fprintf(stderr, "Syscall profile '%s': expecting 'NR COUNT' lines\n",
+            path);
+        exit(EXIT_FAILURE);
+    }
+    fclose(f);
+    return profile;
+}
+
+int main(int argc, char **argv) {
+    FILE *in = stdin, *out = stdout;
+    kafel_ctxt_t ctx;
+    struct sock_fprog sock_fprog;
+    struct kafel_syscall_weight *profile = NULL;
+    size_t profile_len = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "o:p:")) != -1) {
+        switch (opt) {
+        case 'p':
+            profile = load_profile(optarg, &profile_len);
+            break;
+        case 'o':
+            if (!(out = fopen(optarg, "wb"))) {
+                fprintf(stderr, "Opening '%s': %s\n", optarg, strerror(errno));
+                return EXIT_FAILURE;
+            }
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-o OUTPUT] [-p PROFILE] [POLICY]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (optind < argc && !(in = fopen(argv[optind], "r"))) {
+        fprintf(stderr, "Opening '%s': %s\n", argv[optind], strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    ctx = kafel_ctxt_create();
+    kafel_set_target_arch(ctx, SECCOMP_NATIVE_ARCH);
+    kafel_set_input_file(ctx, in);
+    kafel_set_syscall_profile(ctx, profile, profile_len);
+    if (kafel_compile(ctx, &sock_fprog)) {
+        fprintf(stderr, "Seccomp policy: %s\n", kafel_error_msg(ctx));
+        return EXIT_FAILURE;
+    }
+    // raw BPF has no room for relocations
+    if (kafel_param_count(ctx)) {
+        fprintf(stderr, "Seccomp policy: parameter '$%s' unsupported in "
+            "precompiled filters\n", kafel_param_name(ctx, 0));
+        return EXIT_FAILURE;
+    }
+
+    if (fwrite(sock_fprog.filter, sizeof(sock_fprog.filter[0]),
+            sock_fprog.len, out) != sock_fprog.len
+        || fclose(out)
+    ) {
+        fprintf(stderr, "Writing output: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -10,6 +10,7 @@ const char kStatusKilled[]         = "killed";
 const char kStatusMemoryLimit[]    = "memoryLimit";
 const char kStatusPidsLimit[]      = "pidsLimit";
 const char kStatusTimeLimit[]      = "timeLimit";
+const char kStatusCpuTimeLimit[]   = "cpuTimeLimit";
 const char kStatusOutputLimit[]    = "outputLimit";
 const char kStatusInternalError[]  = "internalError";
 const char kStatusRequestInvalid[] = "requestInvalid";
@@ -38,6 +39,22 @@ void fail(const char *status, const char *fmt, ...) {
     exit(EXIT_FAILURE);
 }
 
+bool debug_enabled;
+
+static void init_debug() __attribute__((constructor));
+void init_debug() {
+    debug_enabled = getenv("SANDALS_DEBUG") != NULL;
+}
+
+void log_debug(const char *fmt, ...) {
+    va_list ap;
+    if (!debug_enabled) return;
+    va_start(ap, fmt);
+    fprintf(stderr, "%s[%d]: ", program_invocation_short_name, getpid());
+    vfprintf(stderr, fmt, ap);
+    fputc('\n', stderr);
+}
+
 void log_error(const char *fmt, ...) {
     va_list ap;
     va_start(ap, fmt);
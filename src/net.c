@@ -6,7 +6,7 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 
-void configure_net(const struct sandals_request *request) {
+void configure_lo() {
 
     int s;
     struct ifreq ifr = { .ifr_name = "lo"};
@@ -23,6 +23,9 @@ void configure_net(const struct sandals_request *request) {
         "Enabling loopback network interface: %s", strerror(errno));
 
     close(s);
+}
+
+void configure_net(const struct sandals_request *request) {
 
     // set hostname & domainname
     if (sethostname(request->host_name, strlen(request->host_name)) == -1)
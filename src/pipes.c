@@ -1,8 +1,30 @@
 #include "sandals.h"
 #include "jshelper.h"
+#include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
+#include <unistd.h>
+
+const char kMemfdDest[] = "@memfd";
+
+// Bound for pipe buffers, 1MiB if unknown.
+int pipe_max_size() {
+    static int max_size;
+    if (!max_size) {
+        char buf[32];
+        int fd = open(
+            "/proc/sys/fs/pipe-max-size", O_RDONLY|O_CLOEXEC|O_NOCTTY);
+        ssize_t rc = fd == -1 ? -1 : read(fd, buf, sizeof buf - 1);
+        if (fd != -1) close(fd);
+        max_size = 1024*1024;
+        if (rc > 0) {
+            buf[rc] = 0;
+            if (atoi(buf) > 0) max_size = atoi(buf);
+        }
+    }
+    return max_size;
+}
 
 int pipe_count(const struct sandals_request *request) {
     const jstr_token_t *item;
@@ -18,12 +40,44 @@ int pipe_count(const struct sandals_request *request) {
     return count;
 }
 
+static void retain_init(
+    const struct sandals_request *request, const jstr_token_t *retain,
+    struct sandals_pipe *pipe) {
+
+    const char *key;
+    const jstr_token_t *value;
+
+    jsget_object(request->json_root, retain);
+    pipe->retain = true;
+    pipe->limit = 0;
+    JSOBJECT_FOREACH(retain, key, value) {
+
+        if (!strcmp(key, "head")) {
+            double v = jsget_udouble(request->json_root, value);
+            pipe->limit = v < LONG_MAX ? (long)v : LONG_MAX;
+            continue;
+        }
+
+        if (!strcmp(key, "tail")) {
+            double v = jsget_udouble(request->json_root, value);
+            if (v > kRetainTailMax)
+                jserror(request->json_root, value,
+                    "Expecting a number <= %d", kRetainTailMax);
+            pipe->retain_tail = v;
+            continue;
+        }
+
+        jsunknown(request->json_root, value);
+    }
+}
+
 static void pipe_init(
     const struct sandals_request *request, const jstr_token_t *pipedef,
     struct sandals_pipe *pipe) {
 
     const char *key;
     const jstr_token_t *value;
+    bool has_limit = false;
 
     jsget_object(request->json_root, pipedef);
     JSOBJECT_FOREACH(pipedef, key, value) {
@@ -51,6 +105,28 @@ static void pipe_init(
         if (!strcmp(key, "limit")) {
             double v = jsget_udouble(request->json_root, value);
             pipe->limit = v < LONG_MAX ? (long)v : LONG_MAX;
+            has_limit = true;
+            continue;
+        }
+
+        if (!strcmp(key, "retain")) {
+            retain_init(request, value, pipe);
+            continue;
+        }
+
+        if (!strcmp(key, "bufferSize") && pipe->type == PIPE_REGULAR) {
+            double v;
+            if (jstr_type(value) == JSTR_STRING
+                && !strcmp(jstr_value(value), "auto")
+            ) {
+                pipe->buffer_size = kPipeBufferAuto;
+                continue;
+            }
+            if (jstr_type(value) != JSTR_NUMBER
+                || !((v = strtod(jstr_value(value), NULL)) >= 1)
+            ) jserror(request->json_root, value,
+                "Expecting a positive number or \"auto\"");
+            pipe->buffer_size = v < INT_MAX ? (long)v : INT_MAX;
             continue;
         }
 
@@ -59,6 +135,15 @@ static void pipe_init(
 
     if (!pipe->dest)
         jserror(request->json_root, pipedef, "'dest' missing");
+
+    // memfd pages are charged to the supervisor's cgroup, not the task's
+    if (!strcmp(pipe->dest, kMemfdDest) && !has_limit && !pipe->retain)
+        jserror(request->json_root, pipedef,
+            "'%s' requires 'limit' or 'retain'", kMemfdDest);
+
+    if (pipe->retain && has_limit)
+        jserror(request->json_root, pipedef,
+            "'retain' and 'limit' are mutually exclusive");
 }
 
 void pipe_foreach(
@@ -5,6 +5,7 @@
 #include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/prctl.h>
 
 static const char **copy_str_array(
     const jstr_token_t *root, const jstr_token_t *array
@@ -22,10 +23,22 @@ static const char **copy_str_array(
     return vec;
 }
 
-void request_parse(struct sandals_request *request, const jstr_token_t *root) {
+static void get_timespec(
+    const jstr_token_t *root, const jstr_token_t *value,
+    struct timespec *ts
+) {
+    double v = jsget_udouble(root, value);
+    ts->tv_nsec = (long)(modf(v, &v)*1e9);
+    // time_t===long in GNU and MUSL C library
+    ts->tv_sec = v > LONG_MAX ? (time_t)LONG_MAX : (time_t)v;
+}
+
+static void request_parse_tokens(
+    struct sandals_request *request, const jstr_token_t *root) {
 
     const char *key;
     const jstr_token_t *value, *stdstreams = NULL;
+    bool has_limit = false;
 
     request->json_root = jsget_object(NULL, root);
     JSOBJECT_FOREACH(root, key, value) {
@@ -79,11 +92,49 @@ void request_parse(struct sandals_request *request, const jstr_token_t *root) {
             continue;
         }
 
+        if (!strcmp(key, "cgroupPool")) {
+            request->cgroup_pool = jsget_bool(root, value);
+            continue;
+        }
+
         if (!strcmp(key, "seccompPolicy")) {
             request->seccomp_policy = jsget_str(root, value);
             continue;
         }
 
+        if (!strcmp(key, "seccompCacheDir")) {
+            request->seccomp_cache_dir = jsget_str(root, value);
+            continue;
+        }
+
+        if (!strcmp(key, "seccompBpf")) {
+            request->seccomp_bpf = jsget_str(root, value);
+            continue;
+        }
+
+        if (!strcmp(key, "seccompParams")) {
+            request->seccomp_params = jsget_object(root, value);
+            continue;
+        }
+
+        if (!strcmp(key, "seccompSpecAllow")) {
+            request->seccomp_spec_allow = jsget_bool(root, value);
+            continue;
+        }
+
+        if (!strcmp(key, "specStoreBypass")) {
+            const char *mode = jsget_str(root, value);
+            if (!strcmp(mode, "enable"))
+                request->spec_store_bypass = PR_SPEC_ENABLE;
+            else if (!strcmp(mode, "disable"))
+                request->spec_store_bypass = PR_SPEC_DISABLE;
+            else if (!strcmp(mode, "forceDisable"))
+                request->spec_store_bypass = PR_SPEC_FORCE_DISABLE;
+            else
+                jserror(root, value, "Unknown mode '%s'", mode);
+            continue;
+        }
+
         if (!strcmp(key, "vaRandomize")) {
             request->va_randomize = jsget_bool(root, value);
             continue;
@@ -105,11 +156,12 @@ void request_parse(struct sandals_request *request, const jstr_token_t *root) {
         }
 
         if (!strcmp(key, "timeLimit")) {
-            double v = jsget_udouble(root, value);
-            request->time_limit.tv_nsec = (long)(modf(v, &v)*1e9);
-            // time_t===long in GNU and MUSL C library
-            request->time_limit.tv_sec =
-                v > LONG_MAX ? (time_t)LONG_MAX : (time_t)v;
+            get_timespec(root, value, &request->time_limit);
+            continue;
+        }
+
+        if (!strcmp(key, "cpuTimeLimit")) {
+            get_timespec(root, value, &request->cpu_time_limit);
             continue;
         }
 
@@ -128,6 +180,28 @@ void request_parse(struct sandals_request *request, const jstr_token_t *root) {
             continue;
         }
 
+        if (!strcmp(key, "ioUring")) {
+            request->io_uring = jsget_bool(root, value);
+            continue;
+        }
+
+        if (!strcmp(key, "pipeDelay")) {
+            double v = jsget_udouble(root, value);
+            if (v > 1) jserror(root, value, "Value too big");
+            request->pipe_delay_ns = (long long)(v*1e9);
+            continue;
+        }
+
+        if (!strcmp(key, "usage")) {
+            request->usage = jsget_bool(root, value);
+            continue;
+        }
+
+        if (!strcmp(key, "timings")) {
+            request->timings = jsget_bool(root, value);
+            continue;
+        }
+
         jsunknown(root, value);
     }
 
@@ -141,6 +215,7 @@ void request_parse(struct sandals_request *request, const jstr_token_t *root) {
                 double v = jsget_udouble(root, value);
                 request->stdstreams_limit =
                     v < LONG_MAX ? (long)v : LONG_MAX;
+                has_limit = true;
                 continue;
             }
             jsunknown(root, value);
@@ -148,21 +223,51 @@ void request_parse(struct sandals_request *request, const jstr_token_t *root) {
 
         if (!request->stdstreams_dest)
             jserror(root, stdstreams, "'dest' missing");
+
+        if (!strcmp(request->stdstreams_dest, kMemfdDest) && !has_limit)
+            jserror(root, stdstreams, "'%s' requires 'limit'", kMemfdDest);
     }
 
+    if (request->seccomp_policy && request->seccomp_bpf)
+        fail(kStatusRequestInvalid,
+            "'seccompPolicy' and 'seccompBpf' are mutually exclusive");
+
+    if (request->seccomp_params && !request->seccomp_policy)
+        fail(kStatusRequestInvalid,
+            "'seccompParams' requires 'seccompPolicy'");
+
     if (!request->cmd || !request->cmd[0])
         fail(kStatusRequestInvalid, "'cmd' missing or empty");
 }
 
-void request_recv(struct sandals_request *request) {
+void request_parse(struct sandals_request *request, char *buf, size_t size) {
     enum { TOKEN_MIN = 64 };
 
-    char *buf = NULL;
-    size_t size = 0, data_size = 0;
     ssize_t rc;
     jstr_parser_t parser;
     jstr_token_t *root = NULL;
     size_t token_count = 0;
+    long long start = clock_ns();
+
+    jstr_init(&parser);
+    while ((rc = jstr_parse(&parser, buf, root, token_count)) == JSTR_NOMEM) {
+        token_count = token_count ? 2*token_count : TOKEN_MIN;
+        if(!(root = realloc(root, sizeof(root[0])*token_count)))
+            fail(kStatusInternalError, "malloc");
+    }
+    if (rc < 0 || size != (size_t)rc)
+        fail(kStatusRequestInvalid, NULL);
+
+    request_parse_tokens(request, root);
+    request->recv_ns = clock_ns() - start;
+}
+
+void request_recv(struct sandals_request *request, int fd) {
+
+    char *buf = NULL;
+    size_t size = 0, data_size = 0;
+    ssize_t rc;
+    long long start = clock_ns();
 
     while (1) {
         if (size - data_size <= PIPE_BUF/2) {
@@ -170,7 +275,7 @@ void request_recv(struct sandals_request *request) {
             if (!(buf = realloc(buf, size)))
                 fail(kStatusInternalError, "malloc");
         }
-        if ((rc = read(STDIN_FILENO, buf+data_size, size-data_size-1)) < 0) {
+        if ((rc = read(fd, buf+data_size, size-data_size-1)) < 0) {
             if (errno == EINTR) continue;
             fail(kStatusInternalError,
                 "Reading request: %s", strerror(errno));
@@ -180,14 +285,6 @@ void request_recv(struct sandals_request *request) {
     }
 
     buf[data_size] = 0;
-    jstr_init(&parser);
-    while ((rc = jstr_parse(&parser, buf, root, token_count)) == JSTR_NOMEM) {
-        token_count = token_count ? 2*token_count : TOKEN_MIN;
-        if(!(root = realloc(root, sizeof(root[0])*token_count)))
-            fail(kStatusInternalError, "malloc");
-    }
-    if (rc < 0 || (size_t)data_size != rc)
-        fail(kStatusRequestInvalid, NULL);
-
-    request_parse(request, root);
+    request_parse(request, buf, data_size);
+    request->recv_ns = clock_ns() - start;
 }
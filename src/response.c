@@ -3,6 +3,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <sys/socket.h>
 
 int response_fd = STDOUT_FILENO;
 
@@ -45,7 +46,28 @@ void response_append_int(struct sandals_response *response, int value) {
     response_append_raw(response, buf);
 }
 
+void response_append_llong(
+    struct sandals_response *response, long long value) {
+    char buf[24];
+    sprintf(buf, "%lld", value);
+    response_append_raw(response, buf);
+}
+
+void response_append_double(struct sandals_response *response, double value) {
+    char buf[32];
+    snprintf(buf, sizeof buf, "%.6f", value);
+    response_append_raw(response, buf);
+}
+
 void response_send(const struct sandals_response *response) {
+    response_send_fds(response, NULL, 0);
+}
+
+// Descriptors go along with the first chunk; response_fd must be a Unix
+// domain socket if any.
+void response_send_fds(
+    const struct sandals_response *response, const int *fds, int nfds) {
+
     const char *p, *e;
     ssize_t rc;
 
@@ -53,6 +75,30 @@ void response_send(const struct sandals_response *response) {
         fail(kStatusResponseTooBig, NULL);
 
     p = response->buf; e = p + response->size;
+    while (nfds) {
+        char cmsgbuf[CMSG_SPACE(sizeof(int)*kResponseMaxFds)];
+        struct iovec iovec = { .iov_base = (void *)p, .iov_len = e - p };
+        struct msghdr msghdr = {
+            .msg_iov = &iovec,
+            .msg_iovlen = 1,
+            .msg_control = cmsgbuf,
+            .msg_controllen = CMSG_SPACE(sizeof(int)*nfds)
+        };
+        struct cmsghdr *cmsghdr = CMSG_FIRSTHDR(&msghdr);
+
+        cmsghdr->cmsg_level = SOL_SOCKET;
+        cmsghdr->cmsg_type = SCM_RIGHTS;
+        cmsghdr->cmsg_len = CMSG_LEN(sizeof(int)*nfds);
+        memcpy(CMSG_DATA(cmsghdr), fds, sizeof(int)*nfds);
+        rc = sendmsg(response_fd, &msghdr, MSG_NOSIGNAL);
+        if (rc < 0) {
+            if (errno == EINTR) continue;
+            log_error("Sending response: %s", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        p += rc;
+        nfds = 0;
+    }
     while (p != e) {
         rc = write(response_fd, p, e - p);
         if (rc < 0) {
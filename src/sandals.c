@@ -7,6 +7,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sched.h>
+#include <stdint.h>
+#include <sys/mman.h>
 #include <sys/prctl.h>
 #include <sys/socket.h>
 #include <sys/syscall.h>
@@ -22,10 +24,69 @@ static inline int myclone(int flags) {
     return syscall(SYS_clone, SIGCHLD|flags, NULL);
 }
 
-int main(int argc)
-{
-    const char *env[] = { NULL };
-    struct sandals_request request = {
+#ifndef CLONE_PIDFD
+#define CLONE_PIDFD 0x00001000
+#endif
+
+#ifndef CLONE_INTO_CGROUP
+#define CLONE_INTO_CGROUP 0x200000000ULL
+#endif
+
+#ifndef SYS_clone3
+#define SYS_clone3 435
+#endif
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+
+// Layout matches struct clone_args in linux/sched.h (CLONE_ARGS_SIZE_VER2)
+struct sandals_clone_args {
+    uint64_t flags;
+    uint64_t pidfd;
+    uint64_t child_tid;
+    uint64_t parent_tid;
+    uint64_t exit_signal;
+    uint64_t stack;
+    uint64_t stack_size;
+    uint64_t tls;
+    uint64_t set_tid;
+    uint64_t set_tid_size;
+    uint64_t cgroup;
+};
+
+enum {
+    SANDBOX_FLAGS = CLONE_NEWUSER|CLONE_NEWPID|CLONE_NEWNET
+        |CLONE_NEWUTS|CLONE_NEWNS|CLONE_NEWIPC
+};
+
+// Set if clone3() is unavailable; spawner has to join cgroup on its
+// own (same if cgroup_fd wasn't given).
+static bool legacy_clone;
+
+// Spawner is born in the target cgroup (if any) and we get a pidfd.
+// Falls back to clone() on older kernels.
+static pid_t spawner_clone(int cgroup_fd) {
+    struct sandals_clone_args args = {
+        // no CLONE_NEWCGROUP: namespace root would be OUR cgroup
+        .flags = SANDBOX_FLAGS|CLONE_PIDFD
+            |(cgroup_fd != -1 ? CLONE_INTO_CGROUP : 0),
+        .pidfd = (uintptr_t)&spawner_pidfd,
+        .exit_signal = SIGCHLD,
+        .cgroup = cgroup_fd != -1 ? cgroup_fd : 0
+    };
+    pid_t pid = syscall(SYS_clone3, &args, sizeof args);
+    if (pid != -1
+        || errno != ENOSYS && errno != E2BIG && errno != EINVAL
+    ) return pid;
+    legacy_clone = true;
+    spawner_pidfd = -1;
+    return myclone(SANDBOX_FLAGS);
+}
+
+static void request_init(struct sandals_request *request) {
+    static const char *env[] = { NULL };
+    *request = (struct sandals_request){
         .host_name        = "sandals",
         .domain_name      = "sandals",
         .chroot           = "/",
@@ -33,44 +94,169 @@ int main(int argc)
         .env              = env,
         .work_dir         = "/",
         .stdstreams_limit = LONG_MAX,
-        .time_limit       = { .tv_sec = LONG_MAX }
+        .time_limit       = { .tv_sec = LONG_MAX },
+        .cpu_time_limit   = { .tv_sec = LONG_MAX }
     };
+}
+
+static void spawner_init(int fd) {
+    response_fd = fd;
+
+    // get killed if parent dies - no signal if already dead by now
+    if (prctl(PR_SET_PDEATHSIG, SIGKILL, 0, 0, 0) == -1)
+        fail(kStatusInternalError,
+            "prctl(PR_SET_PDEATHSIG): %s", strerror(errno));
+
+    // detach from TTY
+    if (setsid() == -1)
+        fail(kStatusInternalError, "setsid: %s", strerror(errno));
+}
+
+// Zygote is a spawner cloned ahead of time. It receives a request on
+// a socket (until EOF) and responds on the same socket. Supervisor
+// moves zygote into the cgroup before sending EOF.
+pid_t zygote_create(const sigset_t *sigmask, struct sandals_zygote *zygote) {
+    struct sandals_request request;
+    int sv[2];
+    pid_t pid;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0, sv) == -1) {
+        log_error("socketpair(AF_UNIX, SOCK_STREAM): %s", strerror(errno));
+        return -1;
+    }
+
+    zygote->stats = mmap(
+        NULL, sizeof(*zygote->stats), PROT_READ|PROT_WRITE,
+        MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+    if (zygote->stats == MAP_FAILED) {
+        log_error("mmap(SHARED+ANONYMOUS): %s", strerror(errno));
+        close(sv[0]);
+        close(sv[1]);
+        return -1;
+    }
+
+    switch ((pid = myclone(SANDBOX_FLAGS))) {
+    case -1:
+        log_error("clone: %s", strerror(errno));
+        munmap(zygote->stats, sizeof(*zygote->stats));
+        close(sv[0]);
+        close(sv[1]);
+        return -1;
+    case 0:
+        sigprocmask(SIG_SETMASK, sigmask, NULL);
+        sandals_stats = zygote->stats;
+        spawner_init(sv[1]);
+        close_stray_fds_except(sv[1]);
+        spawner_prewarm();
+
+        request_init(&request);
+        request_recv(&request, sv[1]);
+
+        // start new cgroup namespace
+        if (unshare(CLONE_NEWCGROUP) == -1)
+            fail(kStatusInternalError,
+                "New cgroup namespace: %s", strerror(errno));
+
+        exit(spawner(&request));
+    }
+
+    close(sv[1]);
+    zygote->fd = sv[0];
+    return pid;
+}
+
+static int usage(const char *name) {
+    log_error("Usage: %s [--serve SOCKET [--pool N]]", name);
+    return EXIT_FAILURE;
+}
+
+int main(int argc, char **argv)
+{
+    struct sandals_request request;
+    struct sandals_zygote zygote = {};
     int spawnerout[2];
-    struct cgroup_ctx cgroup_ctx = { -1, -1, -1 };
+    long long t, cgroup_ns = 0;
+    struct cgroup_ctx cgroup_ctx = {
+        .cgroupprocs_fd = -1,
+        .memoryevents_fd = -1,
+        .pidsevents_fd = -1,
+        .cgroup_fd = -1,
+        .memorypeak_fd = -1,
+        .cpustat_fd = -1
+    };
 
     // otherwize log_error() becomes non-atomic
     setvbuf(stderr, NULL, _IOLBF, 0);
 
+    request_init(&request);
+
     if (argc>1) {
-        log_error("Does not accept arguments");
-        return EXIT_FAILURE;
+        char *end;
+        long pool_size = 0;
+
+        if (argc!=3 && argc!=5 || strcmp(argv[1], "--serve"))
+            return usage(argv[0]);
+        if (argc==5 && (strcmp(argv[3], "--pool")
+            || (pool_size = strtol(argv[4], &end, 10)) < 0
+            || pool_size > 1024 || *end || end == argv[4])
+        ) return usage(argv[0]);
+
+        serve(argv[2], pool_size, &request, &zygote);
+    } else {
+        request_recv(&request, STDIN_FILENO);
+    }
+
+    t = clock_ns();
+    if (request.cgroup_config) {
+        configure_cgroup(&request, &cgroup_ctx);
+        cgroup_ns = clock_ns() - t;
+    }
+
+    if (zygote.pid) {
+        char buf[32];
+        spawner_pid = zygote.pid;
+        sandals_stats = zygote.stats;
+        sandals_stats->timings[kTimingRequestRecv] = request.recv_ns;
+        sandals_stats->timings[kTimingConfigureCgroup] = cgroup_ns;
+        spawner_pidfd = syscall(SYS_pidfd_open, zygote.pid, 0);
+        if (request.cgroup_config) {
+            // move zygote into cgroup
+            write_checked(
+                cgroup_ctx.cgroupprocs_fd, buf,
+                sprintf(buf, "%d", (int)zygote.pid), "cgroup.procs");
+        }
+        // zygote proceeds once it sees EOF
+        if (shutdown(zygote.fd, SHUT_WR) == -1)
+            fail(kStatusInternalError, "shutdown: %s", strerror(errno));
+        signal(SIGPIPE, SIG_IGN);
+        return supervisor(&request, &cgroup_ctx, zygote.fd);
+    }
+
+    if (request.usage || request.timings) {
+        sandals_stats = stats_create();
+        sandals_stats->timings[kTimingRequestRecv] = request.recv_ns;
+        sandals_stats->timings[kTimingConfigureCgroup] = cgroup_ns;
     }
 
-    request_recv(&request);
     // Spawner writes response into this socket, MUST use blocking IO.
     if (socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0, spawnerout) == -1)
         fail(kStatusInternalError,
             "socketpair(AF_UNIX, SOCK_STREAM): %s", strerror(errno));
 
-    if (request.cgroup_config) configure_cgroup(&request, &cgroup_ctx);
-
-    switch ((spawner_pid = myclone(CLONE_NEWUSER|CLONE_NEWPID|CLONE_NEWNET
-        |CLONE_NEWUTS|CLONE_NEWNS|CLONE_NEWIPC))) {
+    // CLONE_INTO_CGROUP is only safe with a fresh cgroup. Certain
+    // kernels kill a task cloned into a cgroup that has ever seen
+    // cgroup.kill (kill_seq of the parent's cgroup is checked).
+    t = clock_ns();
+    switch ((spawner_pid = spawner_clone(
+        cgroup_ctx.reused ? -1 : cgroup_ctx.cgroup_fd))) {
     case -1:
         fail(kStatusInternalError, "clone: %s", strerror(errno));
     case 0:
-        response_fd = spawnerout[1];
+        spawner_init(spawnerout[1]);
 
-        // get killed if parent dies - no signal if already dead by now
-        if (prctl(PR_SET_PDEATHSIG, SIGKILL, 0, 0, 0) == -1)
-            fail(kStatusInternalError,
-                "prctl(PR_SET_PDEATHSIG): %s", strerror(errno));
-
-        // detach from TTY
-        if (setsid() == -1)
-            fail(kStatusInternalError, "setsid: %s", strerror(errno));
-
-        if (request.cgroup_config) {
+        if (request.cgroup_config
+            && (legacy_clone || cgroup_ctx.reused)
+        ) {
             // join cgroup
             write_checked(cgroup_ctx.cgroupprocs_fd, "0", 1, "cgroup.procs");
         }
@@ -81,6 +267,7 @@ int main(int argc)
                 "New cgroup namespace: %s", strerror(errno));
 
         close_stray_fds_except(spawnerout[1]);
+        stats_timing(kTimingClone, t);
 
         return spawner(&request);
     default:
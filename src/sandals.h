@@ -1,15 +1,24 @@
 #pragma once
 #include "jstr/jstr.h"
+#include <signal.h>
 #include <stdbool.h>
+#include <sys/resource.h>
 #include <unistd.h>
 #include <limits.h>
 
 extern pid_t spawner_pid;
+extern int spawner_pidfd; // -1 if unavailable
 extern int response_fd;
 
 void log_error(const char *fmt, ...)
     __attribute__((format(printf, 1, 2)));
 
+// Enabled by SANDALS_DEBUG environment variable.
+extern bool debug_enabled;
+
+void log_debug(const char *fmt, ...)
+    __attribute__((format(printf, 1, 2)));
+
 void fail(const char *status, const char *fmt, ...)
     __attribute__((noreturn, format(printf, 2, 3)));
 
@@ -18,6 +27,7 @@ extern const char kStatusKilled[];         // = "killed"
 extern const char kStatusMemoryLimit[];    // = "memoryLimit"
 extern const char kStatusPidsLimit[];      // = "pidsLimit"
 extern const char kStatusTimeLimit[];      // = "timeLimit"
+extern const char kStatusCpuTimeLimit[];   // = "cpuTimeLimit"
 extern const char kStatusOutputLimit[];    // = "outputLimit"
 extern const char kStatusInternalError[];  // = "internalError"
 extern const char kStatusRequestInvalid[]; // = "requestInvalid"
@@ -34,22 +44,88 @@ struct sandals_request {
     const char *cgroup;
     const char *cgroup_root;
     const jstr_token_t *cgroup_config;
+    bool cgroup_pool;
     const char *seccomp_policy;
+    const char *seccomp_cache_dir;
+    const char *seccomp_bpf;
+    const jstr_token_t *seccomp_params;
+    bool seccomp_spec_allow;
+    int spec_store_bypass; // PR_SPEC_*, 0 - keep inherited
     int va_randomize; // address space randomisation
     const char **cmd;
     const char **env;
     const char *work_dir;
     struct timespec time_limit;
+    struct timespec cpu_time_limit;
     const char *stdstreams_dest;
     long stdstreams_limit;
     const jstr_token_t *pipes;
     const jstr_token_t *copy_files;
+    bool io_uring; // supervisor event loop backend
+    long long pipe_delay_ns; // hold readable pipes back for coalescing
+    bool usage;
+    bool timings;
+    long long recv_ns; // time spent receiving and parsing the request
 
     /* for computing paths in error reporting */
     const jstr_token_t *json_root;
 };
 
-void request_recv(struct sandals_request *request);
+void request_parse(struct sandals_request *request, char *buf, size_t size);
+void request_recv(struct sandals_request *request, int fd);
+
+// Startup stages, see 'timings' in README.
+enum {
+    kTimingRequestRecv,
+    kTimingConfigureCgroup,
+    kTimingClone,
+    kTimingConfigureNet,
+    kTimingMapUserAndGroup,
+    kTimingDoMounts,
+    kTimingChroot,
+    kTimingCreatePipes,
+    kTimingSeccompCompile,
+    kTimingForkToExec,
+    kTimingTask,
+    kTimingPipeDrain,
+    kTimingCount
+};
+
+// Task statistics collected by spawner, in shared memory.
+struct sandals_stats {
+    int started; // set once 'start' is valid
+    int exited; // set once 'end' and 'rusage' are valid
+    struct timespec start;
+    struct timespec end;
+    struct rusage rusage;
+    long long timings[kTimingCount]; // ns, 0 if stage skipped
+};
+
+extern struct sandals_stats *sandals_stats; // NULL if not collected
+
+struct sandals_stats *stats_create();
+
+long long clock_ns(); // CLOCK_MONOTONIC
+
+// Record duration of a stage that began at 'since', returns current
+// time. No-op returning 0 if stats aren't collected.
+long long stats_timing(int stage, long long since);
+
+// Pre-warmed spawner, waiting for a request on a socket.
+struct sandals_zygote {
+    pid_t pid; // 0 if none
+    int fd;
+    struct sandals_stats *stats;
+};
+
+pid_t zygote_create(const sigset_t *sigmask, struct sandals_zygote *zygote);
+
+// Returns in a child process, request parsed and response_fd set
+// to the connection. If a zygote was leased from the pool, it has
+// the request already.
+void serve(
+    const char *path, int pool_size,
+    struct sandals_request *request, struct sandals_zygote *zygote);
 
 struct sandals_response {
     size_t size;
@@ -60,35 +136,65 @@ struct sandals_response {
 void response_append_raw(struct sandals_response *response, const char *str);
 void response_append_esc(struct sandals_response *response, const char *str);
 void response_append_int(struct sandals_response *response, int value);
+void response_append_llong(
+    struct sandals_response *response, long long value);
+void response_append_double(struct sandals_response *response, double value);
 void response_send(const struct sandals_response *response);
 
+enum { kResponseMaxFds = 253 }; // SCM_MAX_FD
+
+void response_send_fds(
+    const struct sandals_response *response, const int *fds, int nfds);
+
 int open_checked(const char *path, int flags, mode_t mode);
 void write_checked(int fd, const void *buf, size_t size, const char *path);
 void close_stray_fds_except(int fd);
 
+void configure_lo();
 void configure_net(const struct sandals_request *request);
 
 void do_mounts(const struct sandals_request *request);
 
 void map_user_and_group(const struct sandals_request *request);
 
+struct sock_fprog;
+// Opens seccompBpf or seccompCacheDir, -1 if none; strictly
+// before altering mounts.
+int seccomp_open(const struct sandals_request *request);
+void configure_seccomp(
+    const struct sandals_request *request, int fd,
+    struct sock_fprog *sock_fprog);
+
 enum pipe_type {
     PIPE_REGULAR,
     PIPE_COPYFILE,
     PIPE_STDSTREAMS
 };
 
+enum { kPipeBufferAuto = -1 };
+
+extern const char kMemfdDest[]; // = "@memfd"
+
+enum { kRetainTailMax = 64 << 20 };
+
 struct sandals_pipe {
     enum pipe_type type;
     const char *dest;
     const char *src;
     bool as_stdout;
     bool as_stderr;
-    long limit;
+    long limit; // retain.head if retain
+    long buffer_size; // F_SETPIPE_SZ, 0 - default, or kPipeBufferAuto
+    bool retain;
+    long retain_tail;
 };
 
 int pipe_count(const struct sandals_request *request);
 
+// /proc/sys/fs/pipe-max-size, read once (1MiB if unavailable); call
+// before altering mounts to learn the actual value.
+int pipe_max_size();
+
 void pipe_foreach(
     const struct sandals_request *request, void(*fn)(), void *userdata);
 
@@ -96,14 +202,35 @@ struct cgroup_ctx {
     int cgroupprocs_fd; // "cgroup.procs"
     int memoryevents_fd; // "memory.events"
     int pidsevents_fd; // "pids.events"
+    int cgroup_fd; // cgroup directory
+    bool reused; // pooled or existing cgroup
+    int memorypeak_fd; // "memory.peak", reused cgroup only
+    int cpustat_fd; // "cpu.stat", iff cpuTimeLimit
+    // baseline counter values, non-zero in a reused cgroup
+    long long oomkill_base;
+    long long pidsmax_base;
+    long long cpu_usage_base;
+    long long cpu_user_base;
+    long long cpu_system_base;
+    long long io_read_base;
+    long long io_write_base;
 };
 
+// Value for a key in a flat keyed cgroup file (ex: "memory.events"),
+// 0 if missing.
+long long cgroup_stat(int fd, const char *key, const char *filename);
+
+void cgroup_io_stat(int fd, long long *rbytes, long long *wbytes);
+
 void configure_cgroup(
     const struct sandals_request *request, struct cgroup_ctx *ctx);
 
+void spawner_kill();
+
 int supervisor(
     const struct sandals_request *request,
     const struct cgroup_ctx *cgroup_ctx,
     int spawnerout_fd);
 
+void spawner_prewarm();
 int spawner(const struct sandals_request *request);
@@ -0,0 +1,436 @@
+#include "sandals.h"
+#include "jshelper.h"
+#include "seccomp.h"
+#include "kafel/include/kafel.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/seccomp.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/random.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// Cached filter file layout: header, filter, relocations, parameter
+// names (NUL-terminated), policy text (to rule out hash collisions).
+struct seccomp_cache_header {
+    char magic[8];
+    uint32_t arch;
+    uint32_t version;
+    uint32_t filter_len;
+    uint32_t reloc_count;
+    uint32_t param_count;
+    uint32_t params_size;
+    uint32_t policy_size;
+};
+
+// Filter skeleton: values of $NAME placeholders are patched in per request.
+struct seccomp_template {
+    const struct kafel_reloc *relocs;
+    size_t reloc_count;
+    const char *params; // names, NUL-terminated
+    size_t param_count;
+    size_t params_size;
+};
+
+static const char kSeccompCacheMagic[8] = "sandbpf";
+
+static const char kProcOverflowuidPath[] = "/proc/sys/kernel/overflowuid";
+
+// Files owned by users unmapped in our namespace appear as owned by
+// overflowuid; learnt in seccomp_open() while /proc is still there.
+static uid_t overflow_uid = 65534;
+
+// FNV-1a
+static uint64_t hash_bytes(uint64_t hash, const void *data, size_t size) {
+    const unsigned char *p = data, *e = p + size;
+    while (p != e) hash = (hash ^ *p++) * UINT64_C(0x100000001b3);
+    return hash;
+}
+
+// Anyone able to write to the directory could plant a filter, hence it
+// must not be group or world writable.
+static int seccomp_cache_open(const char *path) {
+    struct stat st;
+    char buf[16];
+    ssize_t rc;
+    int fd, proc_fd;
+
+    if ((fd = open(path, O_RDONLY|O_DIRECTORY|O_CLOEXEC|O_NOCTTY)) == -1) {
+        if (errno == ENOENT || errno == ENOTDIR)
+            fail(kStatusRequestInvalid,
+                "seccompCacheDir: '%s': %s", path, strerror(errno));
+        fail(kStatusInternalError,
+            "Opening '%s': %s", path, strerror(errno));
+    }
+    if (fstat(fd, &st) == -1)
+        fail(kStatusInternalError, "Stat '%s': %s", path, strerror(errno));
+    if (st.st_mode & (S_IWGRP|S_IWOTH))
+        fail(kStatusRequestInvalid,
+            "seccompCacheDir: '%s' is group or world writable", path);
+
+    if ((proc_fd = open(
+        kProcOverflowuidPath, O_RDONLY|O_CLOEXEC|O_NOCTTY)) != -1
+    ) {
+        if ((rc = read(proc_fd, buf, sizeof buf - 1)) > 0) {
+            buf[rc] = 0;
+            overflow_uid = strtoul(buf, NULL, 10);
+        }
+        close(proc_fd);
+    }
+    return fd;
+}
+
+int seccomp_open(const struct sandals_request *request) {
+    if (request->seccomp_bpf)
+        return open_checked(request->seccomp_bpf,
+            O_RDONLY|O_CLOEXEC|O_NOCTTY, 0);
+    if (request->seccomp_policy && request->seccomp_cache_dir)
+        return seccomp_cache_open(request->seccomp_cache_dir);
+    return -1;
+}
+
+static void seccomp_cache_name(
+    char *buf, size_t size, const char *policy, size_t policy_size) {
+
+    uint32_t key[] = { SECCOMP_NATIVE_ARCH, KAFEL_BPF_VERSION };
+    uint64_t hash = UINT64_C(0xcbf29ce484222325);
+    hash = hash_bytes(hash, key, sizeof key);
+    hash = hash_bytes(hash, policy, policy_size);
+    snprintf(buf, size, "%016llx.bpf", (unsigned long long)hash);
+}
+
+// Filter is mapped directly from the cache file; true on success.
+static bool seccomp_cache_load(
+    int dir_fd, const char *name, const char *policy, size_t policy_size,
+    struct sock_fprog *sock_fprog, struct seccomp_template *template) {
+
+    const struct seccomp_cache_header *header;
+    const char *filter, *relocs, *params, *end;
+    struct stat st;
+    size_t param_count = 0;
+    void *p;
+    int fd;
+
+    if ((fd = openat(dir_fd, name, O_RDONLY|O_CLOEXEC|O_NOCTTY)) == -1)
+        return false;
+    if (fstat(fd, &st) == -1
+        // the filter is installed as is, only trust our own entries
+        // (uid maps are configured by now)
+        || !S_ISREG(st.st_mode) || st.st_uid != geteuid()
+        || st.st_uid == overflow_uid
+        || (size_t)st.st_size < sizeof *header
+        // writable for patching parameters in, private
+        || (p = mmap(NULL, st.st_size, PROT_READ|PROT_WRITE, MAP_PRIVATE,
+            fd, 0)) == MAP_FAILED
+    ) {
+        close(fd);
+        return false;
+    }
+    close(fd);
+
+    header = p;
+    filter = (const char *)(header + 1);
+    relocs = filter + sizeof(struct sock_filter)*header->filter_len;
+    params = relocs + sizeof(struct kafel_reloc)*header->reloc_count;
+    end = params + header->params_size;
+    if (memcmp(header->magic, kSeccompCacheMagic, sizeof header->magic)
+        || header->arch != SECCOMP_NATIVE_ARCH
+        || header->version != KAFEL_BPF_VERSION
+        || !header->filter_len || header->filter_len > BPF_MAXINSNS
+        || header->reloc_count > BPF_MAXINSNS
+        || header->params_size > (size_t)st.st_size
+        || header->policy_size != policy_size
+        || (size_t)st.st_size != (size_t)(end - (const char *)p) + policy_size
+        || memcmp(end, policy, policy_size)
+    ) {
+        munmap(p, st.st_size);
+        return false;
+    }
+
+    // entries are ours, still validate what patching relies on
+    for (const char *c = params; c != end; ++c) param_count += !*c;
+    for (size_t i = 0; i < header->reloc_count; ++i) {
+        const struct kafel_reloc *reloc =
+            (const struct kafel_reloc *)relocs + i;
+        if (reloc->insn >= header->filter_len
+            || reloc->param >= param_count || reloc->shift >= 64
+            || (reloc->width != 32 && reloc->width != 64)
+        ) param_count = SIZE_MAX;
+    }
+    if (param_count != header->param_count
+        || (header->params_size && end[-1])
+    ) {
+        munmap(p, st.st_size);
+        return false;
+    }
+
+    sock_fprog->len = header->filter_len;
+    sock_fprog->filter = (struct sock_filter *)filter;
+    template->relocs = (const struct kafel_reloc *)relocs;
+    template->reloc_count = header->reloc_count;
+    template->params = params;
+    template->param_count = param_count;
+    template->params_size = header->params_size;
+    return true;
+}
+
+// Write to a temporary file and rename; concurrent writers race
+// benignly as their output is identical. Errors are ignored.
+static void seccomp_cache_store(
+    int dir_fd, const char *name, const char *policy, size_t policy_size,
+    const struct sock_fprog *sock_fprog,
+    const struct seccomp_template *template) {
+
+    struct seccomp_cache_header header = {
+        .arch = SECCOMP_NATIVE_ARCH,
+        .version = KAFEL_BPF_VERSION,
+        .filter_len = sock_fprog->len,
+        .reloc_count = template->reloc_count,
+        .param_count = template->param_count,
+        .params_size = template->params_size,
+        .policy_size = policy_size
+    };
+    struct iovec iov[] = {
+        { &header, sizeof header },
+        { sock_fprog->filter, sizeof(struct sock_filter)*sock_fprog->len },
+        { (void *)template->relocs,
+            sizeof(struct kafel_reloc)*template->reloc_count },
+        { (void *)template->params, template->params_size },
+        { (void *)policy, policy_size }
+    };
+    size_t size = 0;
+    for (size_t i = 0; i < sizeof iov/sizeof iov[0]; ++i)
+        size += iov[i].iov_len;
+    char tmp_name[64];
+    uint64_t nonce = 0;
+    int fd;
+
+    memcpy(header.magic, kSeccompCacheMagic, sizeof header.magic);
+
+    // pid is useless for uniqueness, we are pid 1 in a namespace
+    getrandom(&nonce, sizeof nonce, GRND_NONBLOCK);
+    snprintf(tmp_name, sizeof tmp_name, ".%s.%016llx",
+        name, (unsigned long long)nonce);
+    if ((fd = openat(dir_fd, tmp_name,
+        O_WRONLY|O_CREAT|O_EXCL|O_CLOEXEC|O_NOCTTY, 0600)) == -1
+    ) return;
+    if (writev(fd, iov, sizeof iov/sizeof iov[0]) != (ssize_t)size
+        || close(fd) == -1
+        || renameat(dir_fd, tmp_name, dir_fd, name) == -1
+    ) unlinkat(dir_fd, tmp_name, 0);
+}
+
+#ifndef SECCOMP_RET_KILL_PROCESS
+#define SECCOMP_RET_KILL_PROCESS 0x80000000U
+#endif
+
+static bool is_kill(const struct sock_filter *f) {
+    uint32_t action = f->k & SECCOMP_RET_ACTION_FULL;
+    return f->code == (BPF_RET|BPF_K) && (
+        action == SECCOMP_RET_KILL_PROCESS
+        || action == SECCOMP_RET_KILL_THREAD);
+}
+
+// Precompiled filter must begin with an arch check; otherwise syscall
+// numbers of a different arch (ex: i386 on x86_64) would be filtered
+// by the native numbering.
+static const char *seccomp_bpf_check(const struct sock_fprog *sock_fprog) {
+    const struct sock_filter *f = sock_fprog->filter;
+
+    if (sock_fprog->len == 1 && is_kill(f)) return NULL; // kill everything
+
+    if (sock_fprog->len < 3
+        || f[0].code != (BPF_LD|BPF_W|BPF_ABS)
+        || f[0].k != offsetof(struct seccomp_data, arch)
+        || f[1].code != (BPF_JMP|BPF_JEQ|BPF_K)
+        || f[1].k != SECCOMP_NATIVE_ARCH
+        || 2u + f[1].jf >= sock_fprog->len
+    ) return "arch check missing";
+
+    if (!is_kill(&f[2 + f[1].jf])) return "foreign arch not killed";
+
+    return NULL;
+}
+
+static void seccomp_bpf_load(
+    const struct sandals_request *request, int fd,
+    struct sock_fprog *sock_fprog) {
+
+    struct stat st;
+    void *p;
+    const char *error;
+
+    if (fstat(fd, &st) == -1)
+        fail(kStatusInternalError,
+            "Stat '%s': %s", request->seccomp_bpf, strerror(errno));
+    if (!st.st_size || st.st_size % sizeof(struct sock_filter)
+        || st.st_size > BPF_MAXINSNS * (off_t)sizeof(struct sock_filter)
+    ) fail(kStatusRequestInvalid,
+        "Seccomp BPF '%s': invalid program length", request->seccomp_bpf);
+    if ((p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0))
+        == MAP_FAILED
+    ) fail(kStatusInternalError,
+        "mmap('%s'): %s", request->seccomp_bpf, strerror(errno));
+
+    sock_fprog->len = st.st_size / sizeof(struct sock_filter);
+    sock_fprog->filter = p;
+    if ((error = seccomp_bpf_check(sock_fprog)))
+        fail(kStatusRequestInvalid,
+            "Seccomp BPF '%s': %s", request->seccomp_bpf, error);
+}
+
+static void seccomp_template_init(
+    struct seccomp_template *template, kafel_ctxt_t ctx) {
+
+    char *params;
+
+    template->relocs = kafel_relocs(ctx, &template->reloc_count);
+    template->param_count = kafel_param_count(ctx);
+    template->params_size = 0;
+    for (size_t i = 0; i < template->param_count; ++i)
+        template->params_size += strlen(kafel_param_name(ctx, i)) + 1;
+    template->params = params = malloc(template->params_size + 1);
+    if (!params) fail(kStatusInternalError, "malloc: %s", strerror(errno));
+    for (size_t i = 0; i < template->param_count; ++i)
+        params = stpcpy(params, kafel_param_name(ctx, i)) + 1;
+}
+
+// Parameters compared with a 32-bit argument only have their low word
+// checked; a larger value would silently match as if truncated.
+static uint64_t seccomp_param_value(
+    const jstr_token_t *root, const jstr_token_t *value, unsigned width) {
+
+    const char *str = jstr_value(value);
+    char *end;
+    unsigned long long v;
+
+    errno = 0;
+    if (jstr_type(value) != JSTR_NUMBER || *str == '-'
+        || (v = strtoull(str, &end, 10), *end) || errno
+    ) jserror(root, value, "Expecting an integer in [0, 2^64)");
+    if (width < 64 && v >> width)
+        jserror(root, value, "Expecting an integer in [0, 2^%u)", width);
+    return v;
+}
+
+static unsigned seccomp_param_width(
+    const struct seccomp_template *template, size_t param) {
+
+    unsigned width = 64;
+    for (size_t i = 0; i != template->reloc_count; ++i) {
+        const struct kafel_reloc *reloc = template->relocs + i;
+        if (reloc->param == param && reloc->width < width)
+            width = reloc->width;
+    }
+    return width;
+}
+
+static bool seccomp_template_has_param(
+    const struct seccomp_template *template, const char *name) {
+
+    const char *param = template->params;
+    for (size_t i = 0; i != template->param_count; ++i) {
+        if (!strcmp(param, name)) return true;
+        param += strlen(param) + 1;
+    }
+    return false;
+}
+
+static const jstr_token_t *seccomp_params_find(
+    const jstr_token_t *params, const char *name) {
+
+    const jstr_token_t *value;
+    const char *key;
+    if (params) {
+        JSOBJECT_FOREACH(params, key, value) {
+            if (!strcmp(key, name)) return value;
+        }
+    }
+    return NULL;
+}
+
+// Patch request's seccompParams into the filter skeleton; all
+// parameters must be bound.
+static void seccomp_bind_params(
+    const struct sandals_request *request, struct sock_fprog *sock_fprog,
+    const struct seccomp_template *template) {
+
+    const jstr_token_t *root = request->json_root, *value;
+    const char *key, *param = template->params;
+    uint64_t *values;
+
+    if (request->seccomp_params) {
+        JSOBJECT_FOREACH(request->seccomp_params, key, value) {
+            if (!seccomp_template_has_param(template, key))
+                jsunknown(root, value);
+        }
+    }
+
+    if (!template->param_count) return;
+
+    values = malloc(sizeof(values[0]) * template->param_count);
+    if (!values) fail(kStatusInternalError, "malloc: %s", strerror(errno));
+    for (size_t i = 0; i != template->param_count; ++i) {
+        if (!(value = seccomp_params_find(request->seccomp_params, param)))
+            fail(kStatusRequestInvalid,
+                "Seccomp policy: parameter '$%s' missing in 'seccompParams'",
+                param);
+        values[i] = seccomp_param_value(
+            root, value, seccomp_param_width(template, i));
+        param += strlen(param) + 1;
+    }
+
+    kafel_apply_relocs(
+        sock_fprog, template->relocs, template->reloc_count, values);
+    free(values);
+}
+
+void configure_seccomp(
+    const struct sandals_request *request, int fd,
+    struct sock_fprog *sock_fprog) {
+
+    const char *policy = request->seccomp_policy;
+    int cachedir_fd = fd;
+    size_t policy_size;
+    char name[32];
+    kafel_ctxt_t ctx;
+    struct seccomp_template template;
+
+    if (request->seccomp_bpf) {
+        seccomp_bpf_load(request, fd, sock_fprog);
+        return;
+    }
+
+    if (!policy) return;
+
+    policy_size = strlen(policy);
+    if (cachedir_fd != -1) {
+        seccomp_cache_name(name, sizeof name, policy, policy_size);
+        if (seccomp_cache_load(
+            cachedir_fd, name, policy, policy_size, sock_fprog, &template)
+        ) {
+            seccomp_bind_params(request, sock_fprog, &template);
+            return;
+        }
+    }
+
+    ctx = kafel_ctxt_create();
+    kafel_set_target_arch(ctx, SECCOMP_NATIVE_ARCH);
+    kafel_set_input_string(ctx, policy);
+    if (kafel_compile(ctx, sock_fprog))
+        fail(kStatusRequestInvalid,
+            "Seccomp policy: %s", kafel_error_msg(ctx));
+    seccomp_template_init(&template, ctx);
+
+    if (cachedir_fd != -1) seccomp_cache_store(
+        cachedir_fd, name, policy, policy_size, sock_fprog, &template);
+
+    seccomp_bind_params(request, sock_fprog, &template);
+}
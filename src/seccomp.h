@@ -0,0 +1,15 @@
+#pragma once
+#include <linux/audit.h>
+
+// AUDIT_ARCH_* of the build, the only arch filters are compiled for
+#if defined(__x86_64__)
+#define SECCOMP_NATIVE_ARCH AUDIT_ARCH_X86_64
+#elif defined(__aarch64__)
+#define SECCOMP_NATIVE_ARCH AUDIT_ARCH_AARCH64
+#elif defined(__arm__)
+#define SECCOMP_NATIVE_ARCH AUDIT_ARCH_ARM
+#elif defined(__i386__)
+#define SECCOMP_NATIVE_ARCH AUDIT_ARCH_I386
+#else
+#error "Unsupported architecture"
+#endif
@@ -0,0 +1,376 @@
+#define _GNU_SOURCE
+#include "sandals.h"
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Serve mode: accept NDJSON requests on a listening Unix socket.
+//
+// Every request is handled in a child process forked from the
+// (already initialized) server; the child proceeds exactly like a
+// one-shot sandals invocation, except that the response goes to the
+// connection. Requests arriving on a connection are served one at a
+// time, in order. Clients wanting concurrency open more connections.
+//
+// Optionally, a pool of zygotes (pre-warmed spawners) is maintained.
+// A request leases a zygote if available; it is refilled in the
+// background. Hit/miss counts are logged on SIGUSR1.
+
+struct serve_conn {
+    int fd;
+    pid_t pid; // child serving the current request, 0 if idle
+    pid_t zygote_pid; // zygote leased by the child, 0 if none
+    bool eof;
+    char *buf;
+    size_t size;
+    size_t data_size;
+};
+
+enum {
+    SIGNAL_INDEX,
+    LISTEN_INDEX,
+    CONN0_INDEX
+};
+
+// Shared with request handling children.
+struct pool_stats {
+    unsigned long hits;
+    unsigned long misses;
+};
+
+//               CONN0_INDEX
+//              /
+// pollfd [..,.........]
+// conn       [.........]
+struct serve_ctx {
+    int nconn;
+    int capacity;
+    struct serve_conn *conn;
+    struct pollfd *pollfd;
+    sigset_t sigmask; // to be restored in children
+    int pool_size;
+    int npool;
+    int pool_backoff_ms; // after a failed refill, 0 if none
+    long long pool_retry_ns; // don't refill before, CLOCK_MONOTONIC
+    struct sandals_zygote *pool;
+    struct pool_stats *stats;
+};
+
+
+static int create_listener(const char *path) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    int fd;
+
+    if (strlen(path) >= sizeof addr.sun_path)
+        fail(kStatusInternalError, "Path too long");
+    strcpy(addr.sun_path, path);
+
+    if ((fd = socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0)) == -1)
+        fail(kStatusInternalError, "socket: %s", strerror(errno));
+
+    // remove stale socket, if any
+    if (unlink(path) == -1 && errno != ENOENT)
+        fail(kStatusInternalError,
+            "Removing '%s': %s", path, strerror(errno));
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof addr) == -1
+        || listen(fd, SOMAXCONN) == -1
+    ) fail(kStatusInternalError,
+        "Listening on '%s': %s", path, strerror(errno));
+
+    return fd;
+}
+
+static void conn_add(struct serve_ctx *ctx, int fd) {
+    if (ctx->nconn == ctx->capacity) {
+        ctx->capacity = ctx->capacity ? 2*ctx->capacity : 16;
+        if (!(ctx->conn = realloc(
+                ctx->conn, sizeof(ctx->conn[0])*ctx->capacity))
+            || !(ctx->pollfd = realloc(
+                ctx->pollfd,
+                sizeof(ctx->pollfd[0])*(CONN0_INDEX+ctx->capacity)))
+        ) fail(kStatusInternalError, "malloc");
+    }
+    ctx->conn[ctx->nconn++] = (struct serve_conn){ .fd = fd };
+}
+
+static void conn_remove(struct serve_ctx *ctx, int index) {
+    close(ctx->conn[index].fd);
+    free(ctx->conn[index].buf);
+    ctx->conn[index] = ctx->conn[--ctx->nconn];
+}
+
+static void conn_read(struct serve_conn *conn) {
+    ssize_t rc;
+    if (conn->size - conn->data_size <= PIPE_BUF/2) {
+        conn->size = conn->size ? 2*conn->size : PIPE_BUF;
+        if (!(conn->buf = realloc(conn->buf, conn->size)))
+            fail(kStatusInternalError, "malloc");
+    }
+    rc = read(conn->fd, conn->buf+conn->data_size,
+        conn->size-conn->data_size-1);
+    if (rc > 0) {
+        conn->data_size += rc;
+    } else if (!rc || errno != EINTR && errno != EAGAIN) {
+        if (rc) log_error("Reading request: %s", strerror(errno));
+        conn->eof = true;
+    }
+}
+
+// Zygote was cloned with default uid/gid maps. It is unusable if the
+// request wants something else.
+static bool zygote_compatible(const struct sandals_request *request) {
+    return !request->uid && !request->gid;
+}
+
+// Runs in a child process; the parent recorded the lease and will
+// kill the zygote once we are done.
+static void zygote_lease(
+    struct serve_ctx *ctx, struct sandals_zygote *zygote,
+    char *line, size_t len, struct sandals_request *request) {
+
+    bool hit = false;
+
+    // Parsing modifies the buffer, send raw request first.
+    if (zygote->pid) {
+        const char *p = line, *e = line + len;
+        while (p != e) {
+            ssize_t rc = send(zygote->fd, p, e - p, MSG_NOSIGNAL);
+            if (rc == -1 && errno == EINTR) continue;
+            if (rc <= 0) break;
+            p += rc;
+        }
+        hit = p == e;
+    }
+
+    request_parse(request, line, len);
+
+    hit = hit && zygote_compatible(request);
+    if (zygote->pid && !hit) {
+        kill(zygote->pid, SIGKILL);
+        close(zygote->fd);
+        zygote->pid = 0;
+    }
+
+    if (ctx->pool_size) __atomic_fetch_add(
+        hit ? &ctx->stats->hits : &ctx->stats->misses,
+        1, __ATOMIC_RELAXED);
+}
+
+// Start serving the next request buffered in a connection, unless busy.
+// Returns true in the child process.
+static bool conn_serve_next(
+    struct serve_ctx *ctx, int index,
+    struct sandals_request *request, struct sandals_zygote *zygote) {
+
+    struct serve_conn *conn = &ctx->conn[index];
+    char *line, *nl;
+    size_t len;
+
+    while (!conn->pid) {
+
+        if (!(nl = memchr(conn->buf, '\n', conn->data_size))) {
+            // last line might lack a terminator
+            if (!conn->eof || !conn->data_size) return false;
+            nl = conn->buf + conn->data_size++;
+        }
+
+        line = conn->buf;
+        len = nl - line;
+        *nl = 0;
+
+        // skip blank lines
+        if (strspn(line, " \t\r") != len) {
+
+            if (ctx->npool) *zygote = ctx->pool[--ctx->npool];
+
+            switch ((conn->pid = fork())) {
+            case -1:
+                log_error("fork: %s", strerror(errno));
+                if (zygote->pid) ctx->pool[ctx->npool++] = *zygote;
+                zygote->pid = 0;
+                conn->pid = 0;
+                conn->eof = true;
+                conn->data_size = 0;
+                return false;
+            case 0:
+                sigprocmask(SIG_SETMASK, &ctx->sigmask, NULL);
+                close(ctx->pollfd[SIGNAL_INDEX].fd);
+                close(ctx->pollfd[LISTEN_INDEX].fd);
+                for (int i = 0; i < ctx->nconn; ++i)
+                    if (i != index) close(ctx->conn[i].fd);
+                for (int i = 0; i < ctx->npool; ++i) {
+                    close(ctx->pool[i].fd);
+                    munmap(ctx->pool[i].stats, sizeof(*ctx->pool[i].stats));
+                }
+                response_fd = conn->fd;
+                zygote_lease(ctx, zygote, line, len, request);
+                return true;
+            default:
+                if (zygote->pid) {
+                    conn->zygote_pid = zygote->pid;
+                    close(zygote->fd);
+                    munmap(zygote->stats, sizeof(*zygote->stats));
+                    zygote->pid = 0;
+                }
+            }
+        }
+
+        conn->data_size -= len + 1;
+        memmove(conn->buf, nl + 1, conn->data_size);
+    }
+    return false;
+}
+
+static void reap(struct serve_ctx *ctx, pid_t pid) {
+    for (int i = 0; i < ctx->npool; ++i) {
+        if (ctx->pool[i].pid == pid) {
+            // zygote died prematurely
+            close(ctx->pool[i].fd);
+            munmap(ctx->pool[i].stats, sizeof(*ctx->pool[i].stats));
+            ctx->pool[i] = ctx->pool[--ctx->npool];
+            return;
+        }
+    }
+    for (int i = 0; i < ctx->nconn; ++i) {
+        if (ctx->conn[i].zygote_pid == pid) {
+            ctx->conn[i].zygote_pid = 0;
+            return;
+        }
+        if (ctx->conn[i].pid == pid) {
+            // child is done, ensure the leased zygote terminates
+            if (ctx->conn[i].zygote_pid)
+                kill(ctx->conn[i].zygote_pid, SIGKILL);
+            ctx->conn[i].pid = 0;
+            return;
+        }
+    }
+}
+
+enum {
+    kPoolBackoffMinMs = 10,
+    kPoolBackoffMaxMs = 10000
+};
+
+// Refill failures are often transient (ex: EAGAIN due to pids limit),
+// retry with exponential backoff.
+static void pool_refill(struct serve_ctx *ctx) {
+    struct sandals_zygote *zygote = &ctx->pool[ctx->npool];
+    if (ctx->npool == ctx->pool_size || clock_ns() < ctx->pool_retry_ns)
+        return;
+    if ((zygote->pid = zygote_create(&ctx->sigmask, zygote)) == -1) {
+        ctx->pool_backoff_ms = ctx->pool_backoff_ms ?
+            ctx->pool_backoff_ms*2 : kPoolBackoffMinMs;
+        if (ctx->pool_backoff_ms > kPoolBackoffMaxMs)
+            ctx->pool_backoff_ms = kPoolBackoffMaxMs;
+        ctx->pool_retry_ns = clock_ns() + ctx->pool_backoff_ms*1000000LL;
+        log_error("Failed to create zygote, retrying in %dms",
+            ctx->pool_backoff_ms);
+        return;
+    }
+    ctx->pool_backoff_ms = 0;
+    ++ctx->npool;
+}
+
+// poll() timeout: refill the pool while short
+static int pool_refill_timeout(const struct serve_ctx *ctx) {
+    long long delay_ns;
+    if (ctx->npool == ctx->pool_size) return -1;
+    delay_ns = ctx->pool_retry_ns - clock_ns();
+    return delay_ns > 0 ? (int)((delay_ns + 999999)/1000000) : 0;
+}
+
+void serve(
+    const char *path, int pool_size,
+    struct sandals_request *request, struct sandals_zygote *zygote) {
+
+    struct serve_ctx ctx = { .pool_size = pool_size };
+    sigset_t sigmask;
+    int signal_fd, listen_fd;
+
+    sigemptyset(&sigmask);
+    sigaddset(&sigmask, SIGCHLD);
+    sigaddset(&sigmask, SIGUSR1);
+    if (sigprocmask(SIG_BLOCK, &sigmask, &ctx.sigmask) == -1)
+        fail(kStatusInternalError, "sigprocmask: %s", strerror(errno));
+    if ((signal_fd = signalfd(
+        -1, &sigmask, SFD_CLOEXEC|SFD_NONBLOCK)) == -1
+    ) fail(kStatusInternalError, "signalfd: %s", strerror(errno));
+
+    listen_fd = create_listener(path);
+
+    if (!(ctx.pollfd = malloc(sizeof(ctx.pollfd[0])*CONN0_INDEX))
+        || !(ctx.pool = malloc(sizeof(ctx.pool[0])*pool_size))
+    ) fail(kStatusInternalError, "malloc");
+
+    ctx.stats = mmap(
+        NULL, sizeof(*ctx.stats), PROT_READ|PROT_WRITE,
+        MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+    if (ctx.stats == MAP_FAILED)
+        fail(kStatusInternalError,
+            "mmap(SHARED+ANONYMOUS): %s", strerror(errno));
+
+    for (;;) {
+        int npollfd = CONN0_INDEX;
+
+        ctx.pollfd[SIGNAL_INDEX] = (struct pollfd){
+            .fd = signal_fd, .events = POLLIN };
+        ctx.pollfd[LISTEN_INDEX] = (struct pollfd){
+            .fd = listen_fd, .events = POLLIN };
+        // don't read from busy connections
+        for (int i = 0; i < ctx.nconn; ++i) {
+            ctx.pollfd[npollfd++] = (struct pollfd){
+                .fd = ctx.conn[i].pid || ctx.conn[i].eof ?
+                    -1 : ctx.conn[i].fd,
+                .events = POLLIN };
+        }
+
+        if (poll(ctx.pollfd, npollfd, pool_refill_timeout(&ctx)) == -1) {
+            if (errno == EINTR) continue;
+            fail(kStatusInternalError, "poll: %s", strerror(errno));
+        }
+
+        if (ctx.pollfd[SIGNAL_INDEX].revents) {
+            struct signalfd_siginfo siginfo;
+            pid_t pid;
+            while (read(signal_fd, &siginfo, sizeof siginfo) > 0) {
+                if (siginfo.ssi_signo == SIGUSR1)
+                    log_error("Pool: %d/%d ready, %lu hits, %lu misses",
+                        ctx.npool, ctx.pool_size,
+                        __atomic_load_n(&ctx.stats->hits, __ATOMIC_RELAXED),
+                        __atomic_load_n(&ctx.stats->misses, __ATOMIC_RELAXED));
+            }
+            while ((pid = waitpid(-1, NULL, WNOHANG)) > 0)
+                reap(&ctx, pid);
+        }
+
+        for (int i = ctx.nconn; i--; ) {
+            if (ctx.pollfd[CONN0_INDEX+i].fd != -1
+                && ctx.pollfd[CONN0_INDEX+i].revents
+            ) conn_read(&ctx.conn[i]);
+        }
+
+        for (int i = ctx.nconn; i--; ) {
+            if (conn_serve_next(&ctx, i, request, zygote)) return;
+            if (ctx.conn[i].eof && !ctx.conn[i].pid) conn_remove(&ctx, i);
+        }
+
+        if (ctx.pollfd[LISTEN_INDEX].revents) {
+            int fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+            if (fd != -1) conn_add(&ctx, fd);
+            else if (errno != EINTR && errno != EAGAIN)
+                log_error("accept: %s", strerror(errno));
+        }
+
+        pool_refill(&ctx);
+    }
+}
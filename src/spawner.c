@@ -1,9 +1,9 @@
 #define _GNU_SOURCE
 #include "sandals.h"
 #include "stdstreams.h"
-#include "kafel/include/kafel.h"
 #include <errno.h>
 #include <fcntl.h>
+#include <linux/filter.h>
 #include <linux/seccomp.h>
 #include <sched.h>
 #include <signal.h>
@@ -12,14 +12,21 @@
 #include <sys/mman.h>
 #include <sys/personality.h>
 #include <sys/prctl.h>
+#include <sys/resource.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <sys/un.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 #include <arpa/inet.h>
 
+#ifndef SECCOMP_FILTER_FLAG_SPEC_ALLOW
+#define SECCOMP_FILTER_FLAG_SPEC_ALLOW (1UL << 2)
+#endif
+
 static const char signals[][10] = {
     [SIGABRT] = "SIGABRT",
     [SIGALRM] = "SIGALRM",
@@ -55,6 +62,9 @@ static const char signals[][10] = {
     [SIGXFSZ] = "SIGXFSZ"
 };
 
+struct sandals_stats *sandals_stats;
+
+static bool prewarmed;
 static int devproxyfd_fd;
 static int childstdout_fd;
 static int childstderr_fd;
@@ -153,6 +163,14 @@ static void create_pipe(
                 fail(kStatusInternalError, "fcntl(F_SETFL, O_NONBLOCK): %s",
                     strerror(errno));
         }
+        // kPipeBufferAuto is handled by supervisor; like it, stay within
+        // pipe-max-size (EPERM beyond it unless privileged)
+        if (pipe->buffer_size > 0
+            && fcntl(pipefd[0], F_SETPIPE_SZ,
+                pipe->buffer_size < pipe_max_size()
+                ? (int)pipe->buffer_size : pipe_max_size()) == -1
+        ) fail(kStatusInternalError, "fcntl(F_SETPIPE_SZ): %s",
+            strerror(errno));
         break;
 
     case PIPE_COPYFILE:
@@ -170,6 +188,14 @@ static void create_pipe(
     if (pipe->as_stderr) childstderr_fd = pipefd[1];
 }
 
+// Only read pipe-max-size if a pipe has bufferSize set, sparing the
+// syscalls otherwise.
+static void learn_pipe_max_size(
+    int index, const struct sandals_pipe *pipe, void *userdata) {
+
+    if (pipe->buffer_size > 0) pipe_max_size();
+}
+
 static void create_pipes(
     const struct sandals_request *request, struct msghdr *msghdr) {
 
@@ -193,43 +219,80 @@ static void create_pipes(
     pipe_foreach(request, create_pipe, (int*)CMSG_DATA(cmsghdr));
 }
 
-static void configure_seccomp(
-    const struct sandals_request *request, struct sock_fprog *sock_fprog) {
+struct sandals_stats *stats_create() {
+    struct sandals_stats *stats = mmap(
+        NULL, sizeof(*stats), PROT_READ|PROT_WRITE,
+        MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+    if (stats == MAP_FAILED)
+        fail(kStatusInternalError,
+            "mmap(SHARED+ANONYMOUS): %s", strerror(errno));
+    return stats;
+}
+
+long long clock_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1000000000LL + ts.tv_nsec;
+}
+
+long long stats_timing(int stage, long long since) {
+    long long now;
+    if (!sandals_stats) return 0;
+    now = clock_ns();
+    sandals_stats->timings[stage] = now - since;
+    return now;
+}
 
-    if (!request->seccomp_policy) return;
-    kafel_ctxt_t ctx = kafel_ctxt_create();
-    kafel_set_input_string(ctx, request->seccomp_policy);
-    if (kafel_compile(ctx, sock_fprog))
-        fail(kStatusRequestInvalid,
-            "Seccomp policy: %s", kafel_error_msg(ctx));
+// Do request-independent setup ahead of time, assuming default uid/gid.
+void spawner_prewarm() {
+    static const struct sandals_request request = {};
+    configure_lo();
+    map_user_and_group(&request);
+    prewarmed = true;
 }
 
 int spawner(const struct sandals_request *request) {
 
-    int devnull_fd;
+    int devnull_fd, seccomp_fd;
     struct msghdr msghdr = {};
     volatile int *exec_errno;
     struct sock_fprog sock_fprog = {};
     pid_t child_pid, pid;
     int status;
+    struct rusage rusage;
+    struct rlimit cpu_rlimit = {};
     struct sandals_response response;
+    long long t = clock_ns(), fork_time;
+    unsigned long seccomp_flags =
+        request->seccomp_spec_allow ? SECCOMP_FILTER_FLAG_SPEC_ALLOW : 0;
 
     // ifup lo
+    if (!prewarmed) configure_lo();
     configure_net(request);
+    t = stats_timing(kTimingConfigureNet, t);
 
     // open /dev/null, strictly before altering mounts
     devnull_fd = open_checked("/dev/null", O_CLOEXEC|O_RDWR|O_NOCTTY, 0);
     childstdout_fd = childstderr_fd = devnull_fd;
 
+    seccomp_fd = seccomp_open(request);
+
+    // strictly before altering mounts - /proc may disappear
+    pipe_foreach(request, learn_pipe_max_size, NULL);
+
     if (request->stdstreams_dest)
         devproxyfd_fd = open("/dev/proxyfd", O_CLOEXEC|O_WRONLY|O_NOCTTY);
 
     // strictly before altering mounts - /proc may disappear
     // + do_mounts() requires configured uid/gid maps
-    map_user_and_group(request);
+    if (!prewarmed) {
+        map_user_and_group(request);
+        t = stats_timing(kTimingMapUserAndGroup, t);
+    }
 
     // mount things
     do_mounts(request);
+    t = stats_timing(kTimingDoMounts, t);
 
     if (chroot(request->chroot)==-1)
         fail(kStatusInternalError,
@@ -247,12 +310,21 @@ int spawner(const struct sandals_request *request) {
     ) fail(kStatusInternalError,
         "personality: %s", strerror(errno));
 
+    // Speculative Store Bypass mitigation, inherited by the child;
+    // strictly before seccomp which may force-disable it otherwise
+    if (request->spec_store_bypass && prctl(
+        PR_SET_SPECULATION_CTRL, PR_SPEC_STORE_BYPASS,
+        request->spec_store_bypass, 0, 0) == -1
+    ) fail(kStatusInternalError,
+        "prctl(PR_SET_SPECULATION_CTRL): %s", strerror(errno));
+
     // chdir, beware relative paths
     if (*request->work_dir != '/' && chdir("/") == -1
         || chdir(request->work_dir) == -1
     ) fail(kStatusInternalError,
         "Setting work dir to '%s': %s",
         request->work_dir, strerror(errno));
+    t = stats_timing(kTimingChroot, t);
 
     // grab shared memory page for exec_errno
     exec_errno = mmap(
@@ -273,27 +345,62 @@ int spawner(const struct sandals_request *request) {
         if (sendmsg(response_fd, &msghdr, 0) == -1)
             fail(kStatusInternalError, "sendmsg: %s", strerror(errno));
     }
+    t = stats_timing(kTimingCreatePipes, t);
+
+    configure_seccomp(request, seccomp_fd, &sock_fprog);
+    if (seccomp_fd != -1) close(seccomp_fd);
+    if (request->seccomp_policy || request->seccomp_bpf)
+        t = stats_timing(kTimingSeccompCompile, t);
+
+    // without a cgroup, cpuTimeLimit falls back to RLIMIT_CPU; the
+    // kernel sends SIGXCPU at the soft limit and SIGKILL at the hard one
+    if (!request->cgroup_config
+        && request->cpu_time_limit.tv_sec != LONG_MAX
+    ) {
+        cpu_rlimit.rlim_cur = request->cpu_time_limit.tv_sec
+            + (request->cpu_time_limit.tv_nsec != 0);
+        if (!cpu_rlimit.rlim_cur) cpu_rlimit.rlim_cur = 1;
+        cpu_rlimit.rlim_max = cpu_rlimit.rlim_cur + 1;
+    }
 
-    configure_seccomp(request, &sock_fprog);
+    if (sandals_stats) {
+        clock_gettime(CLOCK_MONOTONIC, &sandals_stats->start);
+        __atomic_store_n(&sandals_stats->started, 1, __ATOMIC_RELEASE);
+    }
 
     // Fork child process
+    fork_time = clock_ns();
     switch ((child_pid = fork())) {
     case -1:
         fail(kStatusInternalError, "fork: %s", strerror(errno));
     case 0:
-        dup3(devnull_fd, STDIN_FILENO, 0) != -1
-        && dup3(childstdout_fd, STDOUT_FILENO, 0) != -1
-        && dup3(childstderr_fd, STDERR_FILENO, 0) != -1
-        && (!sock_fprog.len || prctl(
-            PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &sock_fprog, 0, 0) != -1)
-        && execvpe(request->cmd[0], (char **)request->cmd, (char **)request->env);
+        if (dup3(devnull_fd, STDIN_FILENO, 0) != -1
+            && dup3(childstdout_fd, STDOUT_FILENO, 0) != -1
+            && dup3(childstderr_fd, STDERR_FILENO, 0) != -1
+            && (!cpu_rlimit.rlim_cur
+                || setrlimit(RLIMIT_CPU, &cpu_rlimit) != -1)) {
+            // strictly before seccomp, the policy may ban clock_gettime
+            stats_timing(kTimingForkToExec, fork_time);
+            if (!sock_fprog.len || syscall(
+                    SYS_seccomp, SECCOMP_SET_MODE_FILTER, seccomp_flags,
+                    &sock_fprog) != -1)
+                execvpe(request->cmd[0], (char **)request->cmd, (char **)request->env);
+        }
         *exec_errno = errno;
         exit(EXIT_FAILURE);
     }
 
     // wait for the child process; we may be getting notifications
     // about other processes since we are pid 1 in a namespace
-    do pid = wait(&status); while (pid != child_pid);
+    do pid = wait4(-1, &status, 0, &rusage); while (pid != child_pid);
+    if (sandals_stats) stats_timing(kTimingTask,
+        fork_time + sandals_stats->timings[kTimingForkToExec]);
+
+    if (sandals_stats) {
+        clock_gettime(CLOCK_MONOTONIC, &sandals_stats->end);
+        getrusage(RUSAGE_CHILDREN, &sandals_stats->rusage);
+        __atomic_store_n(&sandals_stats->exited, 1, __ATOMIC_RELEASE);
+    }
 
     if (*exec_errno)
         fail(kStatusInternalError,
@@ -301,7 +408,15 @@ int spawner(const struct sandals_request *request) {
 
     response.size = 0;
     response_append_raw(&response, "{\"status\":\"");
-    if (WIFEXITED(status)) {
+    // SIGKILL is sent at the hard limit, if SIGXCPU was ignored
+    if (cpu_rlimit.rlim_cur && WIFSIGNALED(status)
+        && (WTERMSIG(status) == SIGXCPU || WTERMSIG(status) == SIGKILL
+            && rusage.ru_utime.tv_sec + rusage.ru_stime.tv_sec
+                >= (long)cpu_rlimit.rlim_cur)
+    ) {
+        response_append_esc(&response, kStatusCpuTimeLimit);
+        response_append_raw(&response, "\"}\n");
+    } else if (WIFEXITED(status)) {
         response_append_esc(&response, kStatusExited);
         response_append_raw(&response, "\",\"code\":");
         response_append_int(&response, WEXITSTATUS(status));
@@ -1,18 +1,26 @@
 #define _GNU_SOURCE
 #include "sandals.h"
 #include "stdstreams.h"
+#include "uring.h"
 #include <arpa/inet.h>
+#include <endian.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <linux/fs.h>
 #include <poll.h>
 #include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/timerfd.h>
+#include <sys/uio.h>
+#include <time.h>
 #include <sys/types.h>
 #include <sys/un.h>
 #include <unistd.h>
@@ -23,6 +31,18 @@ struct sandals_sink {
     ssize_t (*handler) (struct sandals_supervisor *, int, int);
     long limit;
     int fd;
+    ssize_t spliced; // completed io_uring splice, -1 if none
+    int capacity; // pipe buffer size, 0 if unknown
+    int full_reads; // consecutive rounds finding the pipe full
+    bool filled; // found full at least once
+    bool memfd; // dest is "@memfd"
+    off_t copied; // copyFiles: src bytes taken so far, holes included
+    bool no_copy_range; // copy_file_range() failed, using sendfile()
+    // retain: once limit (the head) is exhausted, the last ring_size
+    // bytes are kept in a ring and written out at exit
+    char *ring;
+    long ring_size, ring_pos, ring_len;
+    long long discarded;
     struct sandals_pipe pipe;
 };
 
@@ -30,6 +50,8 @@ enum {
     MEMORYEVENTS_INDEX,
     PIDSEVENTS_INDEX,
     TIMER_INDEX,
+    CPUTIMER_INDEX,
+    SPAWNER_INDEX,
     SPAWNEROUT_INDEX,
     PIPE0_INDEX
 };
@@ -41,14 +63,28 @@ enum {
 // sink            [............]
 //
 // I.e. two parallel arrays with an offset.
+//
+// With io_uring, inflight[] parallels pollfd[] and counts requests
+// pending per fd; an fd is (re)armed once it drops to zero.
 struct sandals_supervisor {
     const struct sandals_request *request;
+    const struct cgroup_ctx *cgroup_ctx;
+    long long cpu_limit_usec;
+    long ncpu;
     int exiting;
     int npipe;
     int ncopyfile;
+    int nmemfd;
     int npollfd;
+    long long pipe_delay_ns;
+    struct __kernel_timespec pipe_delay; // for io_uring
+    long long pipes_ready_ns; // held back since, 0 if not
+    long long pipe_wakeups; // do_pipes() rounds that moved data
+    long long pipe_bytes;
     struct sandals_sink *sink;
     struct pollfd *pollfd;
+    struct uring *uring; // NULL if using poll()
+    unsigned char *inflight;
     char *spawnerout_cmsgbuf;
     char *stdstreams_recvbuf;
     socklen_t stdstreams_szrecvbuf;
@@ -63,6 +99,32 @@ static ssize_t stdstreams_pipe_init(
     struct sandals_supervisor *s,
     int sink_index, int fd);
 
+static ssize_t copyfile_handler(
+    struct sandals_supervisor *s,
+    int sink_index, int fd);
+
+static ssize_t tail_pipe_handler(
+    struct sandals_supervisor *s,
+    int sink_index, int fd);
+
+// Sealed memfds are passed to the caller alongside the response, hence
+// the response must go to a Unix domain socket.
+static int memfd_create_checked(struct sandals_supervisor *s) {
+    int domain, fd;
+    socklen_t len = sizeof domain;
+
+    if (getsockopt(response_fd, SOL_SOCKET, SO_DOMAIN, &domain, &len) == -1
+        || domain != AF_UNIX
+    ) fail(kStatusRequestInvalid,
+        "'%s' requires responding via a Unix domain socket", kMemfdDest);
+    if (++s->nmemfd > kResponseMaxFds)
+        fail(kStatusRequestInvalid,
+            "Too many '%s' sinks (max %d)", kMemfdDest, kResponseMaxFds);
+    if ((fd = memfd_create("sandals", MFD_CLOEXEC|MFD_ALLOW_SEALING)) == -1)
+        fail(kStatusInternalError, "memfd_create: %s", strerror(errno));
+    return fd;
+}
+
 static void sink_init(
     int index, const struct sandals_pipe *pipe,
     struct sandals_supervisor *s) {
@@ -70,64 +132,47 @@ static void sink_init(
     struct sandals_sink *sink = &s->sink[index];
 
     sink->pipe = *pipe;
-    if (!pipe->src)
+    if (pipe->type == PIPE_STDSTREAMS)
+        sink->pipe.src = "@stdStreams";
+    else if (!pipe->src)
         sink->pipe.src = pipe->as_stdout ? "@stdout" : "@stderr";
     sink->limit = pipe->limit;
-    sink->fd = open_checked(
+    sink->spliced = -1;
+    sink->capacity = 0;
+    sink->full_reads = 0;
+    sink->filled = false;
+    sink->memfd = !strcmp(pipe->dest, kMemfdDest);
+    sink->fd = sink->memfd ? memfd_create_checked(s) : open_checked(
         pipe->dest, O_CLOEXEC|O_WRONLY|O_TRUNC|O_CREAT|O_NOCTTY, 0600);
     // We depend on fd being in blocking IO mode. This is guaranteed
     // since we are explicitly requesting this mode via open() flags
     // (even when opening /proc/self/fd/*).
 
+    sink->copied = 0;
+    sink->no_copy_range = false;
+    sink->ring = NULL;
+    sink->ring_size = pipe->retain_tail;
+    sink->ring_pos = sink->ring_len = 0;
+    sink->discarded = 0;
+
     sink->handler = pipe->type == PIPE_STDSTREAMS ?
         stdstreams_pipe_init : regular_pipe_handler;
-}
-
-static bool cgroup_counter_nonzero(
-    int fd, const char* key, const char *filename
-) {
-    char buf[128];
-    ssize_t rc, i;
-    off_t offset = 0;
-    int state = 0;
-    while ((rc = pread(fd, buf, sizeof buf, offset))) {
-
-        if (rc == -1)
+    if (pipe->type == PIPE_COPYFILE) {
+        struct stat st;
+        if (fstat(sink->fd, &st) == -1)
             fail(kStatusInternalError,
-                "Reading '%s': %s", filename, strerror(errno));
-
-        // State machine matching '\w(?P=key)[ ]*[1-9]'.
-        offset += rc; i = 0;
-        switch (state) {
-        matchmore:
-            if (++i==rc) break;
-            if (!key[state]) {
-                if (buf[i]==' ') goto matchmore;
-                return buf[i]>'0' && buf[i]<='9';
-            } else
-        default:
-            if (buf[i]==key[state]) {
-                ++state;
-                goto matchmore;
-            }
-            // fallthrough
-        skipmore:
-        case -1:
-            if (buf[i]==' ' || buf[i]=='\n') {
-                state = 0;
-                goto matchmore;
-            } else {
-                if (++i==rc) { state = -1; break; }
-                goto skipmore;
-            }
-        }
+                "Stat '%s': %s", pipe->dest, strerror(errno));
+        // copy_file_range() and friends want a regular file; others
+        // (ex: /dev/null) go through splice as before
+        if (S_ISREG(st.st_mode)) sink->handler = copyfile_handler;
     }
-    return false;
 }
 
 static int do_memoryevents(struct sandals_supervisor *s) {
     int fd = s->pollfd[MEMORYEVENTS_INDEX].fd;
-    if (fd!=-1 && cgroup_counter_nonzero(fd, "oom_kill ", "memory.events")) {
+    if (fd!=-1 && cgroup_stat(fd, "oom_kill", "memory.events")
+        > s->cgroup_ctx->oomkill_base
+    ) {
         s->response.size = 0;
         response_append_raw(&s->response, "{\"status\":\"");
         response_append_esc(&s->response, kStatusMemoryLimit);
@@ -139,7 +184,9 @@ static int do_memoryevents(struct sandals_supervisor *s) {
 
 static int do_pidsevents(struct sandals_supervisor *s) {
     int fd = s->pollfd[PIDSEVENTS_INDEX].fd;
-    if (fd!=-1 && cgroup_counter_nonzero(fd, "max ", "pids.events")) {
+    if (fd!=-1 && cgroup_stat(fd, "max", "pids.events")
+        > s->cgroup_ctx->pidsmax_base
+    ) {
         s->response.size = 0;
         response_append_raw(&s->response, "{\"status\":\"");
         response_append_esc(&s->response, kStatusPidsLimit);
@@ -149,7 +196,49 @@ static int do_pidsevents(struct sandals_supervisor *s) {
     return 0;
 }
 
-static int do_spawnerout(struct sandals_supervisor *s) {
+// Cgroup can't consume more than ncpu seconds of CPU time per second,
+// check again at the earliest moment the limit could be hit.
+static void arm_cputimer(
+    struct sandals_supervisor *s, long long remaining_usec) {
+
+    enum { kCpuTimerMinUsec = 1000 };
+    long long delay_usec = remaining_usec / s->ncpu;
+    struct itimerspec itimerspec = {};
+
+    if (delay_usec < kCpuTimerMinUsec) delay_usec = kCpuTimerMinUsec;
+    itimerspec.it_value.tv_sec = delay_usec / 1000000;
+    itimerspec.it_value.tv_nsec = delay_usec % 1000000 * 1000;
+    if (timerfd_settime(
+        s->pollfd[CPUTIMER_INDEX].fd, 0, &itimerspec, NULL) == -1
+    ) fail(kStatusInternalError, "Set timer: %s", strerror(errno));
+}
+
+static int do_cputimer(struct sandals_supervisor *s) {
+    const struct cgroup_ctx *ctx = s->cgroup_ctx;
+    uint64_t expirations;
+    long long remaining_usec;
+
+    if (read(s->pollfd[CPUTIMER_INDEX].fd,
+        &expirations, sizeof expirations) == -1 && errno != EAGAIN
+    ) fail(kStatusInternalError, "Read timer: %s", strerror(errno));
+
+    remaining_usec = s->cpu_limit_usec + ctx->cpu_usage_base
+        - cgroup_stat(ctx->cpustat_fd, "usage_usec", "cpu.stat");
+    if (remaining_usec > 0) {
+        arm_cputimer(s, remaining_usec);
+        return 0;
+    }
+
+    s->response.size = 0;
+    response_append_raw(&s->response, "{\"status\":\"");
+    response_append_esc(&s->response, kStatusCpuTimeLimit);
+    response_append_raw(&s->response, "\"}\n");
+    return -1;
+}
+
+// Once spawner has exited, the response (if any) is in the socket
+// already; EAGAIN means there's nothing more to come.
+static int do_spawnerout(struct sandals_supervisor *s, bool spawner_exited) {
     struct iovec iovec = {
         .iov_base = s->response.buf+s->response.size,
         .iov_len = (sizeof s->response.buf)-s->response.size+1
@@ -164,9 +253,11 @@ static int do_spawnerout(struct sandals_supervisor *s) {
     ssize_t rc = recvmsg(
         s->pollfd[SPAWNEROUT_INDEX].fd, &msghdr, MSG_DONTWAIT|MSG_CMSG_CLOEXEC);
     if (rc==-1) {
-        if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
-        fail(kStatusInternalError,
-            "Receiving response: %s", strerror(errno));
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+            fail(kStatusInternalError,
+                "Receiving response: %s", strerror(errno));
+        if (!spawner_exited) return 0;
+        rc = 0;
     }
     if (!rc) {
         if (!s->response.size)
@@ -184,6 +275,13 @@ static int do_spawnerout(struct sandals_supervisor *s) {
             s->pollfd[PIPE0_INDEX+i].events = POLLIN;
             s->pollfd[PIPE0_INDEX+i].revents = 0;
             s->ncopyfile += (s->sink[i].pipe.type == PIPE_COPYFILE);
+            if (s->sink[i].pipe.type == PIPE_REGULAR
+                && (s->sink[i].capacity = fcntl(fd[i], F_GETPIPE_SZ)) == -1
+            ) {
+                s->sink[i].capacity = 0;
+                if (s->sink[i].pipe.buffer_size == kPipeBufferAuto)
+                    s->sink[i].pipe.buffer_size = 0;
+            }
         }
         s->npollfd = PIPE0_INDEX + s->npipe - s->ncopyfile;
         return 0;
@@ -193,8 +291,47 @@ static int do_spawnerout(struct sandals_supervisor *s) {
     return s->response.buf[s->response.size-1] == '\n';
 }
 
+// Spawner exited (pidfd is readable); don't wait for EOF.
+static int drain_spawnerout(struct sandals_supervisor *s) {
+    while (!do_spawnerout(s, true));
+    return 1;
+}
+
+// Double an automatically sized pipe after a few consecutive rounds
+// found it full: the task is producing faster than we are draining.
+static void adapt_pipe_buffer(struct sandals_sink *sink, int fd, ssize_t rc) {
+    enum { kFullReadsToGrow = 4 };
+    long size;
+
+    if (!sink->capacity) return;
+    if (rc < sink->capacity) {
+        sink->full_reads = 0;
+        return;
+    }
+    ++sink->full_reads;
+    sink->filled = true;
+    if (sink->pipe.buffer_size != kPipeBufferAuto
+        || sink->full_reads % kFullReadsToGrow
+    ) return;
+    size = 2L*sink->capacity;
+    if (size > pipe_max_size()) size = pipe_max_size();
+    if (size <= sink->capacity
+        || (rc = fcntl(fd, F_SETPIPE_SZ, (int)size)) == -1
+    ) {
+        // ex: pipe-user-pages-soft exhausted
+        if (size > sink->capacity)
+            log_debug("Growing pipe '%s': %s",
+                sink->pipe.src, strerror(errno));
+        sink->pipe.buffer_size = 0;
+        return;
+    }
+    log_debug("Pipe '%s' grown to %zd bytes", sink->pipe.src, rc);
+    sink->capacity = rc;
+}
+
 static int do_pipes(struct sandals_supervisor *s) {
     int status = 0;
+    bool moved = false;
     for (int i = s->npollfd; --i >= PIPE0_INDEX; ) {
 
         struct sandals_sink *sink;
@@ -204,11 +341,21 @@ static int do_pipes(struct sandals_supervisor *s) {
             continue;
 
         sink = &s->sink[i-PIPE0_INDEX];
-        rc = sink->handler(s, i-PIPE0_INDEX, s->pollfd[i].fd);
+        if (sink->spliced != -1) {
+            rc = sink->spliced;
+            sink->spliced = -1;
+        } else rc = sink->handler(s, i-PIPE0_INDEX, s->pollfd[i].fd);
         if (rc < 0) continue;
 
-        if (rc && rc <= sink->limit) {
-            sink->limit -= rc;
+        if (rc > 0) {
+            s->pipe_bytes += rc;
+            moved = true;
+        }
+
+        if (rc && (rc <= sink->limit || sink->pipe.retain)) {
+            // with retain, bytes past the head went to the ring
+            sink->limit -= rc < sink->limit ? rc : sink->limit;
+            if (!s->exiting) adapt_pipe_buffer(sink, s->pollfd[i].fd, rc);
             i += s->exiting;
             // in 'exiting' mode process the same pipe until fully
             // drained or limit exceeded
@@ -224,11 +371,12 @@ static int do_pipes(struct sandals_supervisor *s) {
             }
         }
     }
+    s->pipe_wakeups += moved;
     return status;
 }
 
-static ssize_t sink_push(struct sandals_sink *sink, char *buf, ssize_t sz) {
-    char *p = buf, *e = p + (sz > sink->limit ? sink->limit : sz);
+static void sink_write(struct sandals_sink *sink, const char *p, size_t sz) {
+    const char *e = p + sz;
     while (p != e) {
         ssize_t szwr = write(sink->fd, p, e-p);
         if (szwr == -1) {
@@ -238,6 +386,46 @@ static ssize_t sink_push(struct sandals_sink *sink, char *buf, ssize_t sz) {
         }
         p += szwr;
     }
+}
+
+static char *sink_ring(struct sandals_sink *sink) {
+    if (!sink->ring && !(sink->ring = malloc(sink->ring_size)))
+        fail(kStatusInternalError, "malloc");
+    return sink->ring;
+}
+
+// Accounts for sz bytes (<= ring_size) just stored at ring_pos.
+static void ring_advance(struct sandals_sink *sink, size_t sz) {
+    if (!sz) return;
+    if (sink->ring_len + (long)sz > sink->ring_size) {
+        sink->discarded += sink->ring_len + sz - sink->ring_size;
+        sink->ring_len = sink->ring_size;
+    } else sink->ring_len += sz;
+    sink->ring_pos = (sink->ring_pos + sz) % sink->ring_size;
+}
+
+static void ring_push(struct sandals_sink *sink, const char *p, size_t sz) {
+    size_t n;
+    if (sz > (size_t)sink->ring_size) {
+        sink->discarded += sz - sink->ring_size;
+        p += sz - sink->ring_size;
+        sz = sink->ring_size;
+    }
+    if (!sz) return;
+    n = sink->ring_size - sink->ring_pos;
+    if (n > sz) n = sz;
+    memcpy(sink_ring(sink) + sink->ring_pos, p, n);
+    memcpy(sink->ring, p + n, sz - n);
+    ring_advance(sink, sz);
+}
+
+static ssize_t sink_push(struct sandals_sink *sink, char *buf, ssize_t sz) {
+    if (sz <= sink->limit) {
+        sink_write(sink, buf, sz);
+        return sz;
+    }
+    sink_write(sink, buf, sink->limit);
+    if (sink->pipe.retain) ring_push(sink, buf + sink->limit, sz - sink->limit);
     return sz;
 }
 
@@ -246,14 +434,47 @@ static ssize_t regular_pipe_no_splice_handler(
 
     ssize_t rc;
     char buf[PIPE_BUF];
+    struct sandals_sink *sink = &s->sink[sink_index];
+
+    if (!sink->limit && sink->pipe.retain) {
+        sink->handler = tail_pipe_handler;
+        return tail_pipe_handler(s, sink_index, fd);
+    }
 
     rc = read(fd, buf, sizeof buf);
     if (rc == -1) {
         if (errno==EAGAIN || errno==EWOULDBLOCK) return -1;
         fail(kStatusInternalError,
-            "Reading '%s': %s", s->sink[sink_index].pipe.src, strerror(errno));
+            "Reading '%s': %s", sink->pipe.src, strerror(errno));
+    }
+    return sink_push(sink, buf, rc);
+}
+
+// retain: the head is written, read straight into the ring.
+static ssize_t tail_pipe_handler(
+    struct sandals_supervisor *s, int sink_index, int fd) {
+
+    ssize_t rc;
+    struct sandals_sink *sink = &s->sink[sink_index];
+
+    if (sink->ring_size) {
+        struct iovec iov[2];
+        char *ring = sink_ring(sink);
+        iov[0].iov_base = ring + sink->ring_pos;
+        iov[0].iov_len = sink->ring_size - sink->ring_pos;
+        iov[1].iov_base = ring;
+        iov[1].iov_len = sink->ring_pos;
+        if ((rc = readv(fd, iov, 2)) > 0) ring_advance(sink, rc);
+    } else {
+        char buf[PIPE_BUF];
+        if ((rc = read(fd, buf, sizeof buf)) > 0) sink->discarded += rc;
+    }
+    if (rc == -1) {
+        if (errno==EAGAIN || errno==EWOULDBLOCK) return -1;
+        fail(kStatusInternalError,
+            "Reading '%s': %s", sink->pipe.src, strerror(errno));
     }
-    return sink_push(&s->sink[sink_index], buf, rc);
+    return rc;
 }
 
 static ssize_t regular_pipe_handler(
@@ -280,6 +501,97 @@ static ssize_t regular_pipe_handler(
     return rc;
 }
 
+// Copies [in, end) of src to dest, at the same offset less the bytes
+// discarded (retain).
+static void copy_extent(
+    struct sandals_sink *sink, int fd, off_t in, off_t end) {
+
+    off_t out = in - sink->discarded;
+    while (in < end) {
+        ssize_t rc;
+        if (!sink->no_copy_range) {
+            rc = copy_file_range(fd, &in, sink->fd, &out, end-in, 0);
+            if (rc == -1 && (errno == EXDEV || errno == EINVAL
+                || errno == EOPNOTSUPP || errno == ENOSYS)
+            ) {
+                // ex: src and dest on different filesystems
+                sink->no_copy_range = true;
+                continue;
+            }
+        } else {
+            if (lseek(sink->fd, out, SEEK_SET) == -1)
+                fail(kStatusInternalError,
+                    "Seeking '%s': %s", sink->pipe.dest, strerror(errno));
+            if ((rc = sendfile(sink->fd, fd, &in, end-in)) > 0) out += rc;
+        }
+        if (rc == -1) {
+            if (errno == EINTR) continue;
+            fail(kStatusInternalError,
+                "Copying '%s' to '%s': %s",
+                sink->pipe.src, sink->pipe.dest, strerror(errno));
+        }
+        if (!rc) return; // src shrunk
+    }
+}
+
+// copyFiles into a regular file. Reflinks src if it fits in the limit
+// and the filesystem can, otherwise copies data extents in the kernel
+// (copy_file_range(), or sendfile() across filesystems), skipping
+// holes. Bytes are counted against the limit holes included, exactly
+// as if read via splice. With retain, the head is copied as above, then
+// the last retain.tail bytes.
+static ssize_t copyfile_handler(
+    struct sandals_supervisor *s, int sink_index, int fd) {
+
+    struct sandals_sink *sink = &s->sink[sink_index];
+    struct stat st;
+    off_t start = sink->copied, end, pos;
+
+    if (fstat(fd, &st) == -1)
+        fail(kStatusInternalError,
+            "Stat '%s': %s", sink->pipe.src, strerror(errno));
+    if (st.st_size <= start) return 0;
+    if (sink->limit) {
+        end = st.st_size - start > sink->limit ?
+            start + sink->limit : st.st_size;
+    } else {
+        if (!sink->pipe.retain) return 1; // more data, limit exceeded
+        if (st.st_size - start > sink->ring_size) {
+            sink->discarded += st.st_size - sink->ring_size - start;
+            start = st.st_size - sink->ring_size;
+        }
+        end = st.st_size;
+    }
+
+    if (!start && end == st.st_size && ioctl(sink->fd, FICLONE, fd) == 0) {
+        sink->copied = end;
+        return end;
+    }
+
+    for (pos = start; pos < end; ) {
+        off_t data = lseek(fd, pos, SEEK_DATA), hole;
+        if (data == -1) {
+            if (errno == ENXIO) break; // only a hole remains
+            fail(kStatusInternalError,
+                "Seeking '%s': %s", sink->pipe.src, strerror(errno));
+        }
+        if (data >= end) break;
+        if ((hole = lseek(fd, data, SEEK_HOLE)) == -1)
+            fail(kStatusInternalError,
+                "Seeking '%s': %s", sink->pipe.src, strerror(errno));
+        if (hole > end) hole = end;
+        copy_extent(sink, fd, data, hole);
+        pos = hole;
+    }
+    // extend dest over a trailing hole
+    if (ftruncate(sink->fd, end - sink->discarded) == -1)
+        fail(kStatusInternalError,
+            "Truncating '%s': %s", sink->pipe.dest, strerror(errno));
+
+    sink->copied = end;
+    return end - start;
+}
+
 static ssize_t stdstreams_pipe_handler(
     struct sandals_supervisor *s, int sink_index, int fd) {
 
@@ -348,26 +660,495 @@ static ssize_t stdstreams_pipe_init(
     return stdstreams_pipe_handler(s, sink_index, fd);
 }
 
+// With pipeDelay, hold readable pipes back to let more data accumulate
+// (still watching other fds). Only pipes spliced into dest are held,
+// other handlers don't drain a pipe fully. Once a pipe was found full,
+// it isn't held any more: the task is streaming rather than chatty, and
+// holding would just stall it.
+static bool pipe_deferrable(const struct sandals_sink *sink) {
+    return sink->handler == regular_pipe_handler && sink->limit
+        && !sink->filled;
+}
+
+static bool pipes_deferrable(const struct sandals_supervisor *s) {
+    bool ready = false;
+    for (int i = PIPE0_INDEX; i < s->npollfd; ++i) {
+        if (!s->pollfd[i].revents) continue;
+        if (!pipe_deferrable(&s->sink[i-PIPE0_INDEX])) return false;
+        ready = true;
+    }
+    return ready;
+}
+
+static void poll_wait(struct sandals_supervisor *s) {
+    struct timespec timeout, *ptimeout = NULL;
+    int nfds = s->npollfd;
+    bool expired = false;
+
+    if (s->pipes_ready_ns) {
+        long long left = s->pipes_ready_ns + s->pipe_delay_ns - clock_ns();
+        if (left > 0) nfds = PIPE0_INDEX;
+        else {
+            left = 0;
+            expired = true;
+            s->pipes_ready_ns = 0;
+        }
+        timeout.tv_sec = left / 1000000000;
+        timeout.tv_nsec = left % 1000000000;
+        ptimeout = &timeout;
+        for (int i = PIPE0_INDEX; i < s->npollfd; ++i)
+            s->pollfd[i].revents = 0;
+    }
+
+    if (ppoll(s->pollfd, nfds, ptimeout, NULL) == -1 && errno != EINTR)
+        fail(kStatusInternalError, "poll: %s", strerror(errno));
+
+    if (s->pipe_delay_ns && !expired && nfds == s->npollfd
+        && pipes_deferrable(s)
+    ) {
+        s->pipes_ready_ns = clock_ns();
+        for (int i = PIPE0_INDEX; i < s->npollfd; ++i)
+            s->pollfd[i].revents = 0;
+    }
+}
+
+// io_uring backend: event sources (cgroup events, timers, spawner
+// pidfd) use multishot poll. Data streams are polled one shot and
+// re-armed after being handled, as handlers don't drain them fully.
+// If a pipe can be spliced, the poll is linked with the splice, hence
+// the data moves without waking us up in between. All (re)arming is
+// submitted in a single io_uring_enter() which also waits for
+// completions. With pipeDelay, a timeout goes in between the poll and
+// the splice (hard links proceed despite the timeout "failing").
+enum {
+    kUringPoll = 1,
+    kUringDelay,
+    kUringSplice,
+    kUringCancel
+};
+
+static uint64_t uring_data(int kind, int index) {
+    return (uint64_t)kind << 16 | index;
+}
+
+static void uring_arm(struct sandals_supervisor *s) {
+    for (int i = 0; i < s->npollfd; ++i) {
+
+        struct io_uring_sqe *sqe;
+        struct sandals_sink *sink;
+        int fd = s->pollfd[i].fd;
+
+        if (fd == -1 || s->inflight[i]) continue;
+
+        sqe = uring_sqe(s->uring);
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = fd;
+        sqe->poll32_events = s->pollfd[i].events;
+#if __BYTE_ORDER == __BIG_ENDIAN
+        sqe->poll32_events = sqe->poll32_events << 16
+            | sqe->poll32_events >> 16;
+#endif
+        sqe->user_data = uring_data(kUringPoll, i);
+        s->inflight[i] = 1;
+
+        if (i < PIPE0_INDEX) {
+            if (i != SPAWNEROUT_INDEX) sqe->len = IORING_POLL_ADD_MULTI;
+            continue;
+        }
+
+        sink = &s->sink[i-PIPE0_INDEX];
+        if (sink->handler != regular_pipe_handler || !sink->limit) continue;
+
+        sqe->flags = IOSQE_IO_LINK;
+        if (s->pipe_delay_ns && pipe_deferrable(sink)) {
+            sqe->flags = IOSQE_IO_HARDLINK;
+            sqe = uring_sqe(s->uring);
+            sqe->opcode = IORING_OP_TIMEOUT;
+            sqe->flags = IOSQE_IO_HARDLINK;
+            sqe->addr = (uintptr_t)&s->pipe_delay;
+            sqe->len = 1;
+            sqe->user_data = uring_data(kUringDelay, i);
+            s->inflight[i]++;
+        }
+        sqe = uring_sqe(s->uring);
+        sqe->opcode = IORING_OP_SPLICE;
+        sqe->splice_fd_in = fd;
+        sqe->splice_off_in = (uint64_t)-1;
+        sqe->fd = sink->fd;
+        sqe->off = (uint64_t)-1;
+        sqe->len = sink->limit < INT_MAX ? sink->limit : INT_MAX;
+        sqe->splice_flags = SPLICE_F_NONBLOCK;
+        sqe->user_data = uring_data(kUringSplice, i);
+        s->inflight[i]++;
+    }
+}
+
+static void uring_complete(
+    struct sandals_supervisor *s, const struct io_uring_cqe *cqe) {
+
+    int kind = cqe->user_data >> 16, index = cqe->user_data & 0xffff;
+    struct sandals_sink *sink;
+
+    if (kind == kUringCancel) return;
+
+    if (!(cqe->flags & IORING_CQE_F_MORE)) s->inflight[index]--;
+
+    if (kind == kUringDelay) return; // -ETIME, or cancelled
+
+    if (kind == kUringPoll) {
+        if (cqe->res < 0) {
+            if (cqe->res != -ECANCELED)
+                fail(kStatusInternalError,
+                    "io_uring poll: %s", strerror(-cqe->res));
+        } else if (!s->inflight[index] || index < PIPE0_INDEX) {
+            // unless the linked splice is pending
+            s->pollfd[index].revents |= cqe->res;
+        }
+        return;
+    }
+
+    sink = &s->sink[index-PIPE0_INDEX];
+    if (cqe->res >= 0) {
+        sink->spliced = cqe->res;
+        s->pollfd[index].revents = POLLIN;
+        return;
+    }
+    switch (-cqe->res) {
+    case EAGAIN:
+    case EINTR:
+    case ECANCELED:
+        return;
+    case EINVAL:
+        sink->handler = regular_pipe_no_splice_handler;
+        s->pollfd[index].revents = POLLIN;
+        return;
+    }
+    fail(kStatusInternalError,
+        "Splicing '%s' and '%s': %s",
+        sink->pipe.src, sink->pipe.dest, strerror(-cqe->res));
+}
+
+static void uring_reap(struct sandals_supervisor *s) {
+    const struct io_uring_cqe *cqe;
+    while ((cqe = uring_cqe(s->uring))) {
+        uring_complete(s, cqe);
+        uring_cqe_seen(s->uring);
+    }
+}
+
+static void uring_wait(struct sandals_supervisor *s) {
+    for (int i = 0; i < s->npollfd; ++i) s->pollfd[i].revents = 0;
+    uring_arm(s);
+    uring_submit_and_wait(s->uring, 1);
+    uring_reap(s);
+}
+
+// Cancel pending requests on pipes and collect the outcome, leaving
+// pipes to do_pipes() in 'exiting' mode.
+static void uring_cancel(struct sandals_supervisor *s) {
+    bool pending = false;
+    for (int i = PIPE0_INDEX; i < s->npollfd; ++i) {
+        static const int kinds[] = {
+            kUringPoll, kUringDelay, kUringSplice
+        };
+        if (!s->inflight[i]) continue;
+        pending = true;
+        for (size_t k = 0; k < sizeof kinds / sizeof kinds[0]; ++k) {
+            struct io_uring_sqe *sqe = uring_sqe(s->uring);
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->addr = uring_data(kinds[k], i);
+            sqe->user_data = uring_data(kUringCancel, i);
+        }
+    }
+    while (pending) {
+        uring_submit_and_wait(s->uring, 1);
+        uring_reap(s);
+        pending = false;
+        for (int i = PIPE0_INDEX; i < s->npollfd; ++i)
+            pending |= s->inflight[i] != 0;
+    }
+}
+
+static void usage_key(struct sandals_response *r, int *n, const char *key) {
+    response_append_raw(r, (*n)++ ? ",\"" : "\"");
+    response_append_raw(r, key);
+    response_append_raw(r, "\":");
+}
+
+static double seconds_elapsed(
+    const struct timespec *end, const struct timespec *start) {
+    return end->tv_sec - start->tv_sec + (end->tv_nsec - start->tv_nsec)/1e9;
+}
+
+// Single value cgroup file (ex: "memory.peak"), -1 if unavailable.
+static long long cgroup_value(int dir_fd, int fd, const char *filename) {
+    char buf[32];
+    ssize_t rc;
+    bool close_fd = fd == -1;
+    if (close_fd && (fd = openat(
+        dir_fd, filename, O_RDONLY|O_CLOEXEC|O_NOCTTY)) == -1
+    ) return -1;
+    rc = pread(fd, buf, sizeof buf - 1, 0);
+    if (close_fd) close(fd);
+    if (rc <= 0) return -1;
+    buf[rc] = 0;
+    return strtoll(buf, NULL, 10);
+}
+
+static void do_usage_cgroup(
+    struct sandals_supervisor *s, int *n) {
+
+    struct sandals_response *r = &s->response;
+    const struct cgroup_ctx *ctx = s->cgroup_ctx;
+    long long v, rbytes, wbytes;
+    int fd;
+
+    if ((fd = openat(ctx->cgroup_fd, "cpu.stat",
+        O_RDONLY|O_CLOEXEC|O_NOCTTY)) != -1
+    ) {
+        usage_key(r, n, "cpuUsage");
+        response_append_double(r, (cgroup_stat(
+            fd, "usage_usec", "cpu.stat") - ctx->cpu_usage_base)/1e6);
+        usage_key(r, n, "cpuUser");
+        response_append_double(r, (cgroup_stat(
+            fd, "user_usec", "cpu.stat") - ctx->cpu_user_base)/1e6);
+        usage_key(r, n, "cpuSystem");
+        response_append_double(r, (cgroup_stat(
+            fd, "system_usec", "cpu.stat") - ctx->cpu_system_base)/1e6);
+        close(fd);
+    }
+
+    // peak values can't be baselined; reset memory.peak if reused
+    if ((ctx->memorypeak_fd != -1 || !ctx->reused)
+        && (v = cgroup_value(
+            ctx->cgroup_fd, ctx->memorypeak_fd, "memory.peak")) != -1
+    ) {
+        usage_key(r, n, "memoryPeak");
+        response_append_llong(r, v);
+    }
+
+    if (!ctx->reused
+        && (v = cgroup_value(ctx->cgroup_fd, -1, "pids.peak")) != -1
+    ) {
+        usage_key(r, n, "pidsPeak");
+        response_append_llong(r, v);
+    }
+
+    if ((fd = openat(ctx->cgroup_fd, "io.stat",
+        O_RDONLY|O_CLOEXEC|O_NOCTTY)) != -1
+    ) {
+        cgroup_io_stat(fd, &rbytes, &wbytes);
+        usage_key(r, n, "ioReadBytes");
+        response_append_llong(r, rbytes - ctx->io_read_base);
+        usage_key(r, n, "ioWriteBytes");
+        response_append_llong(r, wbytes - ctx->io_write_base);
+        close(fd);
+    }
+}
+
+// Append "usage" object to the response.
+static void do_usage(struct sandals_supervisor *s) {
+    struct sandals_response *r = &s->response;
+    const struct sandals_stats *stats = sandals_stats;
+    int n = 0;
+
+    if (r->size < 2 || r->size > sizeof r->buf
+        || memcmp(r->buf + r->size - 2, "}\n", 2)
+    ) return;
+
+    r->size -= 2;
+    response_append_raw(r, ",\"usage\":{");
+
+    if (stats && __atomic_load_n(&stats->started, __ATOMIC_ACQUIRE)) {
+        const struct rusage *ru = &stats->rusage;
+        struct timespec now;
+
+        if (!__atomic_load_n(&stats->exited, __ATOMIC_ACQUIRE)) {
+            // killed, rusage unavailable
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            usage_key(r, &n, "wallTime");
+            response_append_double(r, seconds_elapsed(&now, &stats->start));
+        } else {
+            usage_key(r, &n, "wallTime");
+            response_append_double(
+                r, seconds_elapsed(&stats->end, &stats->start));
+            usage_key(r, &n, "maxRss");
+            response_append_llong(r, ru->ru_maxrss*1024LL);
+            usage_key(r, &n, "minorFaults");
+            response_append_llong(r, ru->ru_minflt);
+            usage_key(r, &n, "majorFaults");
+            response_append_llong(r, ru->ru_majflt);
+            usage_key(r, &n, "voluntaryCtxSwitches");
+            response_append_llong(r, ru->ru_nvcsw);
+            usage_key(r, &n, "involuntaryCtxSwitches");
+            response_append_llong(r, ru->ru_nivcsw);
+        }
+    }
+
+    if (s->cgroup_ctx->cgroup_fd != -1) do_usage_cgroup(s, &n);
+
+    if (s->npipe) {
+        usage_key(r, &n, "pipeWakeups");
+        response_append_llong(r, s->pipe_wakeups);
+        usage_key(r, &n, "pipeBytes");
+        response_append_llong(r, s->pipe_bytes);
+    }
+
+    if (s->request->io_uring) {
+        usage_key(r, &n, "ioUring");
+        response_append_raw(r, s->uring ? "true" : "false");
+    }
+
+    response_append_raw(r, "}}\n");
+}
+
+// Write out retain rings and append "discarded" object to the response.
+static void do_retained(struct sandals_supervisor *s) {
+    struct sandals_response *r = &s->response;
+    int n = 0;
+
+    for (int i = 0; i < s->npipe; ++i) {
+        struct sandals_sink *sink = &s->sink[i];
+        long start;
+        if (!sink->ring_len) continue;
+        start = (sink->ring_pos - sink->ring_len + sink->ring_size)
+            % sink->ring_size;
+        if (start + sink->ring_len > sink->ring_size) {
+            sink_write(sink, sink->ring + start, sink->ring_size - start);
+            sink_write(sink, sink->ring, sink->ring_pos);
+        } else sink_write(sink, sink->ring + start, sink->ring_len);
+    }
+
+    if (r->size < 2 || r->size > sizeof r->buf
+        || memcmp(r->buf + r->size - 2, "}\n", 2)
+    ) return;
+
+    for (int i = 0; i < s->npipe; ++i) {
+        const struct sandals_sink *sink = &s->sink[i];
+        if (!sink->pipe.retain) continue;
+        if (!n++) {
+            r->size -= 2;
+            response_append_raw(r, ",\"discarded\":{\"");
+        } else response_append_raw(r, ",\"");
+        response_append_esc(r, sink->pipe.src);
+        response_append_raw(r, "\":");
+        response_append_llong(r, sink->discarded);
+    }
+    if (n) response_append_raw(r, "}}\n");
+}
+
+// Seal memfds and append "memfds" array to the response; returns fds
+// to send, in the order of sinks.
+static int do_memfds(struct sandals_supervisor *s, int *fds) {
+    struct sandals_response *r = &s->response;
+    int n = 0;
+
+    for (int i = 0; i < s->npipe; ++i) {
+        const struct sandals_sink *sink = &s->sink[i];
+        if (!sink->memfd) continue;
+        if (fcntl(sink->fd, F_ADD_SEALS,
+            F_SEAL_SHRINK|F_SEAL_GROW|F_SEAL_WRITE|F_SEAL_SEAL) == -1
+        ) fail(kStatusInternalError, "Sealing memfd: %s", strerror(errno));
+        // offset is shared with the caller's descriptor
+        if (lseek(sink->fd, 0, SEEK_SET) == -1)
+            fail(kStatusInternalError, "lseek: %s", strerror(errno));
+        fds[n++] = sink->fd;
+    }
+
+    if (r->size < 2 || r->size > sizeof r->buf
+        || memcmp(r->buf + r->size - 2, "}\n", 2)
+    ) return n;
+
+    r->size -= 2;
+    response_append_raw(r, ",\"memfds\":[");
+    for (int i = 0, j = 0; i < s->npipe; ++i) {
+        if (!s->sink[i].memfd) continue;
+        response_append_raw(r, j++ ? ",\"" : "\"");
+        response_append_esc(r, s->sink[i].pipe.src);
+        response_append_raw(r, "\"");
+    }
+    response_append_raw(r, "]}\n");
+    return n;
+}
+
+// Append "timings" object to the response.
+static void do_timings(struct sandals_supervisor *s) {
+    static const char *const keys[kTimingCount] = {
+        [kTimingRequestRecv] = "requestRecv",
+        [kTimingConfigureCgroup] = "configureCgroup",
+        [kTimingClone] = "clone",
+        [kTimingConfigureNet] = "configureNet",
+        [kTimingMapUserAndGroup] = "mapUserAndGroup",
+        [kTimingDoMounts] = "doMounts",
+        [kTimingChroot] = "chroot",
+        [kTimingCreatePipes] = "createPipes",
+        [kTimingSeccompCompile] = "seccompCompile",
+        [kTimingForkToExec] = "forkToExec",
+        [kTimingTask] = "task",
+        [kTimingPipeDrain] = "pipeDrain"
+    };
+    struct sandals_response *r = &s->response;
+    int n = 0;
+
+    if (!sandals_stats || r->size < 2 || r->size > sizeof r->buf
+        || memcmp(r->buf + r->size - 2, "}\n", 2)
+    ) return;
+
+    r->size -= 2;
+    response_append_raw(r, ",\"timings\":{");
+    for (int i = 0; i < kTimingCount; ++i) {
+        long long v = __atomic_load_n(
+            &sandals_stats->timings[i], __ATOMIC_RELAXED);
+        if (!v) continue;
+        usage_key(r, &n, keys[i]);
+        response_append_llong(r, v);
+    }
+    response_append_raw(r, "}}\n");
+}
+
 int supervisor(
     const struct sandals_request *request,
     const struct cgroup_ctx *cgroup_ctx,
     int spawnerout_fd) {
 
     struct sandals_supervisor s; // no initializer - large embedded buffers
+    struct uring uring;
     int timer_fd;
+    long long drain_start;
     struct itimerspec itimerspec = { .it_value = request->time_limit };
 
     s.exiting = 0;
     s.request = request;
+    s.cgroup_ctx = cgroup_ctx;
     s.npipe = pipe_count(request);
     s.ncopyfile = 0;
+    s.nmemfd = 0;
     s.npollfd = PIPE0_INDEX;
+    s.pipe_delay_ns = request->pipe_delay_ns;
+    s.pipe_delay.tv_sec = s.pipe_delay_ns / 1000000000;
+    s.pipe_delay.tv_nsec = s.pipe_delay_ns % 1000000000;
+    s.pipes_ready_ns = 0;
+    s.pipe_wakeups = 0;
+    s.pipe_bytes = 0;
     if (!(s.sink = malloc(sizeof(struct sandals_sink)*s.npipe
         +sizeof(struct pollfd)*(PIPE0_INDEX+s.npipe)
-        +CMSG_SPACE(sizeof(int)*s.npipe))
+        +CMSG_SPACE(sizeof(int)*s.npipe)
+        +PIPE0_INDEX+s.npipe)
     )) fail(kStatusInternalError, "malloc");
     s.pollfd = (struct pollfd *)(s.sink+s.npipe);
     s.spawnerout_cmsgbuf = (void *)(s.pollfd+PIPE0_INDEX+s.npipe);
+    s.inflight = (unsigned char *)s.spawnerout_cmsgbuf
+        +CMSG_SPACE(sizeof(int)*s.npipe);
+    memset(s.inflight, 0, PIPE0_INDEX+s.npipe);
+    s.uring = NULL;
+    if (request->io_uring) {
+        // room for arming and cancelling every fd in a single batch
+        if (uring_init(&uring, 4*(PIPE0_INDEX+s.npipe)) == 0)
+            s.uring = &uring;
+        else
+            log_debug("io_uring unavailable, using poll: %s",
+                strerror(errno));
+    }
     s.stdstreams_recvbuf = NULL;
     s.stdstreams_szrecvbuf = 0;
     s.response.size = 0;
@@ -377,12 +1158,16 @@ int supervisor(
     // reopened (but pipes can!)
     pipe_foreach(request, sink_init, &s);
 
-    if ((timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC)) == -1)
-        fail(kStatusInternalError, "Create timer: %s", strerror(errno));
-    if (!itimerspec.it_value.tv_nsec)
-        itimerspec.it_value.tv_nsec = 1; // zero timeout disables timer
-    if (timerfd_settime(timer_fd, 0, &itimerspec, NULL) == -1)
-        fail(kStatusInternalError, "Set timer: %s", strerror(errno));
+    // no timer if unlimited; poll ignores negative fds
+    timer_fd = -1;
+    if (request->time_limit.tv_sec != LONG_MAX) {
+        if ((timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC)) == -1)
+            fail(kStatusInternalError, "Create timer: %s", strerror(errno));
+        if (!itimerspec.it_value.tv_nsec)
+            itimerspec.it_value.tv_nsec = 1; // zero timeout disables timer
+        if (timerfd_settime(timer_fd, 0, &itimerspec, NULL) == -1)
+            fail(kStatusInternalError, "Set timer: %s", strerror(errno));
+    }
 
     s.pollfd[MEMORYEVENTS_INDEX].fd = cgroup_ctx->memoryevents_fd;
     s.pollfd[MEMORYEVENTS_INDEX].events = POLLPRI;
@@ -390,12 +1175,24 @@ int supervisor(
     s.pollfd[PIDSEVENTS_INDEX].events = POLLPRI;
     s.pollfd[TIMER_INDEX].fd = timer_fd;
     s.pollfd[TIMER_INDEX].events = POLLIN;
+    s.pollfd[CPUTIMER_INDEX].fd = -1;
+    s.pollfd[CPUTIMER_INDEX].events = POLLIN;
+    if (cgroup_ctx->cpustat_fd != -1) {
+        s.cpu_limit_usec = request->cpu_time_limit.tv_sec*1000000LL
+            + request->cpu_time_limit.tv_nsec/1000;
+        if ((s.ncpu = sysconf(_SC_NPROCESSORS_ONLN)) < 1) s.ncpu = 1;
+        if ((s.pollfd[CPUTIMER_INDEX].fd = timerfd_create(
+            CLOCK_MONOTONIC, TFD_CLOEXEC|TFD_NONBLOCK)) == -1
+        ) fail(kStatusInternalError, "Create timer: %s", strerror(errno));
+        arm_cputimer(&s, s.cpu_limit_usec);
+    }
+    s.pollfd[SPAWNER_INDEX].fd = spawner_pidfd;
+    s.pollfd[SPAWNER_INDEX].events = POLLIN;
     s.pollfd[SPAWNEROUT_INDEX].fd = spawnerout_fd;
     s.pollfd[SPAWNEROUT_INDEX].events = POLLIN;
 
     for (;;) {
-        if (poll(s.pollfd, s.npollfd, -1) == -1 && errno != EINTR)
-            fail(kStatusInternalError, "poll: %s", strerror(errno));
+        if (s.uring) uring_wait(&s); else poll_wait(&s);
 
         if (s.pollfd[MEMORYEVENTS_INDEX].revents && do_memoryevents(&s)) break;
 
@@ -409,7 +1206,11 @@ int supervisor(
             break;
         }
 
-        if (s.pollfd[SPAWNEROUT_INDEX].revents && do_spawnerout(&s)) {
+        if (s.pollfd[CPUTIMER_INDEX].revents && do_cputimer(&s)) break;
+
+        if (s.pollfd[SPAWNEROUT_INDEX].revents && do_spawnerout(&s, false)
+            || s.pollfd[SPAWNER_INDEX].revents && drain_spawnerout(&s)
+        ) {
             // Cgroup event notifications are asynchronous;
             // ex: when pids.max limit is hit, a job is queued to
             // wake up pollers. Luckily, the state reported through
@@ -422,10 +1223,22 @@ int supervisor(
         if (do_pipes(&s)) break;
     }
 
-    kill(spawner_pid, SIGKILL); spawner_pid = -1;
+    spawner_kill(); spawner_pid = -1;
     s.exiting = 1;
+    drain_start = clock_ns();
+    if (s.uring) {
+        uring_cancel(&s);
+        uring_destroy(s.uring);
+    }
     s.npollfd += s.ncopyfile; // finally process copyfile pipes
     do_pipes(&s);
-    response_send(&s.response);
+    do_retained(&s);
+    stats_timing(kTimingPipeDrain, drain_start);
+    if (request->usage) do_usage(&s);
+    if (request->timings) do_timings(&s);
+    if (s.nmemfd) {
+        int fds[kResponseMaxFds];
+        response_send_fds(&s.response, fds, do_memfds(&s, fds));
+    } else response_send(&s.response);
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,156 @@
+#define _GNU_SOURCE
+#include "sandals.h"
+#include "uring.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static const unsigned char kRequiredOps[] = {
+    IORING_OP_POLL_ADD, IORING_OP_TIMEOUT, IORING_OP_SPLICE,
+    IORING_OP_ASYNC_CANCEL
+};
+
+static int probe_ops(int fd) {
+    enum { kProbeOps = 256 };
+    struct io_uring_probe *probe;
+    int rc = -1;
+
+    if (!(probe = calloc(1,
+        sizeof(*probe) + kProbeOps*sizeof(struct io_uring_probe_op)))
+    ) fail(kStatusInternalError, "malloc");
+    if (syscall(__NR_io_uring_register,
+        fd, IORING_REGISTER_PROBE, probe, kProbeOps) == 0
+    ) {
+        rc = 0;
+        for (size_t i = 0; i < sizeof kRequiredOps; ++i) {
+            unsigned op = kRequiredOps[i];
+            if (op > probe->last_op
+                || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)
+            ) {
+                errno = EOPNOTSUPP;
+                rc = -1;
+            }
+        }
+    }
+    free(probe);
+    return rc;
+}
+
+int uring_init(struct uring *ring, unsigned entries) {
+    struct io_uring_params p;
+    int fd;
+
+    memset(&p, 0, sizeof p);
+    memset(ring, 0, sizeof *ring);
+    ring->fd = -1;
+    if ((fd = syscall(__NR_io_uring_setup, entries, &p)) == -1) return -1;
+    ring->fd = fd;
+    if (!(p.features & IORING_FEAT_NODROP) || probe_ops(fd) == -1) {
+        if (!(p.features & IORING_FEAT_NODROP)) errno = EOPNOTSUPP;
+        goto fail;
+    }
+
+    ring->sq_ring_size = p.sq_off.array + p.sq_entries*sizeof(unsigned);
+    ring->cq_ring_size =
+        p.cq_off.cqes + p.cq_entries*sizeof(struct io_uring_cqe);
+    ring->sqes_size = p.sq_entries*sizeof(struct io_uring_sqe);
+    if ((ring->sq_ring = mmap(
+        NULL, ring->sq_ring_size, PROT_READ|PROT_WRITE,
+        MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_SQ_RING)) == MAP_FAILED
+    ) {
+        ring->sq_ring = NULL;
+        goto fail;
+    }
+    if ((ring->cq_ring = mmap(
+        NULL, ring->cq_ring_size, PROT_READ|PROT_WRITE,
+        MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_CQ_RING)) == MAP_FAILED
+    ) {
+        ring->cq_ring = NULL;
+        goto fail;
+    }
+    if ((ring->sqes = mmap(
+        NULL, ring->sqes_size, PROT_READ|PROT_WRITE,
+        MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_SQES)) == MAP_FAILED
+    ) {
+        ring->sqes = NULL;
+        goto fail;
+    }
+
+    ring->sq_entries = p.sq_entries;
+    ring->sq_head = (unsigned *)((char *)ring->sq_ring + p.sq_off.head);
+    ring->sq_tail = (unsigned *)((char *)ring->sq_ring + p.sq_off.tail);
+    ring->sq_mask = (unsigned *)((char *)ring->sq_ring + p.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)((char *)ring->sq_ring + p.sq_off.array);
+    ring->cq_head = (unsigned *)((char *)ring->cq_ring + p.cq_off.head);
+    ring->cq_tail = (unsigned *)((char *)ring->cq_ring + p.cq_off.tail);
+    ring->cq_mask = (unsigned *)((char *)ring->cq_ring + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(
+        (char *)ring->cq_ring + p.cq_off.cqes);
+    return 0;
+fail:
+    {
+        int saved_errno = errno;
+        uring_destroy(ring);
+        errno = saved_errno;
+    }
+    return -1;
+}
+
+void uring_destroy(struct uring *ring) {
+    if (ring->sqes) munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring) munmap(ring->cq_ring, ring->cq_ring_size);
+    if (ring->sq_ring) munmap(ring->sq_ring, ring->sq_ring_size);
+    if (ring->fd != -1) close(ring->fd);
+    memset(ring, 0, sizeof *ring);
+    ring->fd = -1;
+}
+
+struct io_uring_sqe *uring_sqe(struct uring *ring) {
+    unsigned tail = *ring->sq_tail, index;
+    struct io_uring_sqe *sqe;
+
+    if (tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE)
+        == ring->sq_entries
+    ) {
+        uring_submit_and_wait(ring, 0);
+        tail = *ring->sq_tail;
+    }
+    index = tail & *ring->sq_mask;
+    sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof *sqe);
+    ring->sq_array[index] = index;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ring->sq_pending++;
+    return sqe;
+}
+
+void uring_submit_and_wait(struct uring *ring, unsigned wait_nr) {
+    unsigned flags = wait_nr ? IORING_ENTER_GETEVENTS : 0;
+    while (ring->sq_pending || wait_nr) {
+        long rc = syscall(
+            __NR_io_uring_enter, ring->fd, ring->sq_pending, wait_nr, flags,
+            NULL, 0);
+        if (rc == -1) {
+            if (errno == EINTR) continue;
+            // CQ overflown, reap completions first
+            if (errno == EBUSY && wait_nr) return;
+            fail(kStatusInternalError, "io_uring_enter: %s", strerror(errno));
+        }
+        ring->sq_pending -= rc;
+        return;
+    }
+}
+
+struct io_uring_cqe *uring_cqe(struct uring *ring) {
+    unsigned head = *ring->cq_head;
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+        return NULL;
+    return &ring->cqes[head & *ring->cq_mask];
+}
+
+void uring_cqe_seen(struct uring *ring) {
+    __atomic_store_n(ring->cq_head, *ring->cq_head + 1, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <linux/io_uring.h>
+#include <stdint.h>
+
+// Minimal io_uring wrapper (no liburing dependency).
+struct uring {
+    int fd;
+    unsigned sq_entries;
+    unsigned sq_pending; // queued but not yet submitted
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+    void *sq_ring, *cq_ring;
+    size_t sq_ring_size, cq_ring_size, sqes_size;
+};
+
+// -1 if io_uring is unavailable (ex: disabled by sysctl or seccomp,
+// or lacking an opcode we need), errno is set.
+int uring_init(struct uring *ring, unsigned entries);
+void uring_destroy(struct uring *ring);
+
+// Zeroed SQE; submits queued entries first if the SQ is full.
+struct io_uring_sqe *uring_sqe(struct uring *ring);
+
+// Submits queued entries and waits for at least wait_nr completions.
+void uring_submit_and_wait(struct uring *ring, unsigned wait_nr);
+
+// NULL if the CQ is empty; uring_cqe_seen() releases the entry.
+struct io_uring_cqe *uring_cqe(struct uring *ring);
+void uring_cqe_seen(struct uring *ring);
@@ -0,0 +1,10 @@
+const { test, exited, cpuTimeLimit } = require('./harness');
+
+test('cpuTimeLimit', ()=>{
+    cpuTimeLimit({cmd:['sh', '-c', 'while :; do :; done'], cpuTimeLimit:1});
+});
+
+test('cpuTimeLimitIdle', ()=>{
+    // sleeping doesn't consume CPU time
+    exited({cmd:['sleep', '1.5'], cpuTimeLimit:1}, 0);
+});
@@ -54,6 +54,12 @@ function timeLimit(request) {
     return r;
 }
 
+function cpuTimeLimit(request) {
+    const r = sandals(request);
+    if (r.status != 'cpuTimeLimit') assert.fail(r);
+    return r;
+}
+
 function memoryLimit(request) {
     const r = sandals(request);
     if (r.status != 'memoryLimit') assert.fail(r);
@@ -136,6 +142,7 @@ module.exports = {
     exited,
     killed,
     timeLimit,
+    cpuTimeLimit,
     memoryLimit,
     pidsLimit,
     outputLimit,
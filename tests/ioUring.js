@@ -0,0 +1,94 @@
+const assert = require('assert');
+const crypto = require('crypto');
+const { spawnSync } = require('child_process');
+const {
+    test, requestInvalid, exited, timeLimit, outputLimit, TmpFile
+} = require('./harness');
+
+// Falls back to poll() if io_uring is unavailable, hence most of these
+// pass either way; ioUringBackend checks which backend actually ran.
+
+// io_uring_setup(1, &params) on the host: true/false, undefined if
+// python3 is missing
+function ioUringAvailable() {
+    const r = spawnSync('python3', ['-c', [
+        'import ctypes',
+        'libc = ctypes.CDLL(None, use_errno=True)',
+        'exit(0 if libc.syscall(425, 1, ctypes.create_string_buffer(120)) >= 0 else 1)',
+    ].join('\n')]);
+    return r.status === 0 ? true : r.status === 1 ? false : undefined;
+}
+
+test('ioUringBackend', ()=>{
+    const available = ioUringAvailable();
+    const r = exited({ioUring: true, usage: true, cmd: ['true']}, 0);
+    assert.equal(typeof r.usage.ioUring, 'boolean');
+    if (available !== undefined) assert.equal(r.usage.ioUring, available);
+    assert.ok(!('ioUring' in exited({usage: true, cmd: ['true']}, 0).usage));
+});
+
+test('ioUringInvalid', ()=>{
+    requestInvalid({cmd:['id'], ioUring:42}, /^ioUring: /);
+    requestInvalid({cmd:['id'], ioUring:'true'}, /^ioUring: /);
+});
+
+test('ioUringPipes', ()=>{
+    for (let k of ['pipes', 'copyFiles']) {
+        const o1 = new TmpFile();
+        const o2 = new TmpFile();
+        exited({
+            ioUring: true,
+            mounts: [{type: 'tmpfs', dest: '/tmp'}],
+            [k]: [
+                {dest: o1, src: '/tmp/o1'},
+                {dest: o2, src: '/tmp/o2'},
+            ],
+            cmd: ['sh', '-c', [
+                'echo -n "Hello, "> /tmp/o1',
+                'echo world! > /tmp/o2',
+            ].join(';')]
+        }, 0);
+        assert.equal(o1.read(), 'Hello, ');
+        assert.equal(o2.read(), 'world!\n');
+    }
+});
+
+test('ioUringStream', ()=>{
+    // several sinks at once, data must arrive intact and in order
+    const size = 8 << 20;
+    const data = crypto.randomBytes(size);
+    const input = new TmpFile(data);
+    const out = new TmpFile();
+    const err = new TmpFile();
+    exited({
+        ioUring: true,
+        pipes: [
+            {dest: out, stdout: true},
+            {dest: err, stderr: true}
+        ],
+        cmd: ['sh', '-c', `cat ${input.toJSON()} & cat ${input.toJSON()} >&2; wait`]
+    }, 0);
+    assert.ok(data.equals(out.readFileSync()));
+    assert.ok(data.equals(err.readFileSync()));
+});
+
+test('ioUringLimit', ()=>{
+    const output = new TmpFile();
+    outputLimit({
+        ioUring: true,
+        cmd: ['yes'],
+        pipes: [{dest: output, stdout: true, limit: 10}]
+    });
+    assert.equal(output.read(), 'y\ny\ny\ny\ny\n');
+});
+
+test('ioUringTimeLimit', ()=>{
+    const output = new TmpFile();
+    timeLimit({
+        ioUring: true,
+        cmd: ['sh', '-c', 'echo ok; exec sleep 10'],
+        timeLimit: 0.2,
+        pipes: [{dest: output, stdout: true}]
+    });
+    assert.equal(output.read(), 'ok\n');
+});
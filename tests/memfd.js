@@ -0,0 +1,91 @@
+const assert = require('assert');
+const { spawnSync } = require('child_process');
+const { test, requestInvalid, TmpFile, SANDALS } = require('./harness');
+
+// Node can't receive SCM_RIGHTS; a python helper runs sandals with
+// stdout connected to a Unix socket and dumps the received memfds.
+const HELPER = `
+import fcntl, json, os, socket, subprocess, sys
+a, b = socket.socketpair()
+p = subprocess.Popen([sys.argv[1]], stdin=subprocess.PIPE, stdout=b.fileno())
+b.close()
+p.stdin.write(sys.stdin.buffer.read())
+p.stdin.close()
+data, fds = b'', []
+while True:
+    msg, f, flags, addr = socket.recv_fds(a, 65536, 256)
+    if not msg: break
+    data += msg
+    fds += f
+p.wait()
+print(json.dumps({'response': json.loads(data), 'memfds': [{
+    'data': os.read(fd, 1 << 20).decode(),
+    'seals': fcntl.fcntl(fd, 1034) # F_GET_SEALS
+} for fd in fds]}))
+`;
+
+function memfdRequest(request) {
+    const r = spawnSync(
+        'python3', ['-c', HELPER, SANDALS],
+        {input: JSON.stringify(request), encoding: 'utf8'});
+    if (r.status !== 0) assert.fail(r.stderr);
+    return JSON.parse(r.stdout);
+}
+
+// F_SEAL_SEAL|F_SEAL_SHRINK|F_SEAL_GROW|F_SEAL_WRITE
+const SEALED = 15;
+
+test('memfdUnbounded', ()=>{
+    // memfd pages are charged to the supervisor, not the task's cgroup
+    for (const k of ['pipes', 'copyFiles']) requestInvalid({
+        cmd: ['true'], [k]: [{stdout: true, src: '/x', dest: '@memfd'}]
+    }, new RegExp(`^${k}\\[0\\]: '@memfd' requires 'limit' or 'retain'`));
+    requestInvalid({cmd: ['true'], stdStreams: {dest: '@memfd'}},
+        /^stdStreams: '@memfd' requires 'limit'/);
+});
+
+if (spawnSync('python3', ['-c', 'import socket; socket.recv_fds']).status) {
+    console.log('python3 3.9+ not found, skipping');
+    return;
+}
+
+test('memfd', ()=>{
+    const output = new TmpFile();
+    const {response, memfds} = memfdRequest({
+        cmd: ['sh', '-c', 'echo out; echo err >&2; echo -n file > /tmp/f'],
+        mounts: [{type: 'tmpfs', dest: '/tmp'}],
+        pipes: [
+            {stdout: true, dest: '@memfd', limit: 1024},
+            {stderr: true, dest: output}
+        ],
+        copyFiles: [{src: '/tmp/f', dest: '@memfd', limit: 1024}]
+    });
+    assert.deepEqual(response,
+        {status: 'exited', code: 0, memfds: ['@stdout', '/tmp/f']});
+    assert.deepEqual(memfds, [
+        {data: 'out\n', seals: SEALED},
+        {data: 'file', seals: SEALED}
+    ]);
+    assert.equal(output.read(), 'err\n');
+});
+
+test('memfdOutputLimit', ()=>{
+    const {response, memfds} = memfdRequest({
+        cmd: ['yes'],
+        pipes: [{stdout: true, dest: '@memfd', limit: 10}]
+    });
+    assert.deepEqual(response, {status: 'outputLimit', memfds: ['@stdout']});
+    assert.deepEqual(memfds, [{data: 'y\ny\ny\ny\ny\n', seals: SEALED}]);
+});
+
+test('memfdNotASocket', ()=>{
+    // response goes to a pipe, memfds cannot be passed
+    const r = spawnSync(
+        'sh', ['-c', `"${SANDALS}" | cat`],
+        {input: JSON.stringify({
+            cmd: ['true'], pipes: [{stdout: true, dest: '@memfd', limit: 1}]
+        }), encoding: 'utf8'});
+    const response = JSON.parse(r.stdout);
+    assert.equal(response.status, 'requestInvalid');
+    assert.match(response.description, /Unix domain socket/);
+});
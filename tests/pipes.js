@@ -1,6 +1,9 @@
 const assert = require('assert');
+const fs = require('fs');
+const os = require('os');
 const {
-    test, requestInvalid, exited, internalError, outputLimit, TmpFile
+    test, testAtExit, requestInvalid, exited, internalError, outputLimit,
+    TmpFile
 } = require('./harness');
 
 test('pipesInvalid', ()=>{
@@ -73,3 +76,204 @@ test('copyFilesLimit', ()=>{
     });
     assert.equal(output.read(), '0123');
 });
+
+// Sparse src: 4MiB hole, 'x\n', hole up to 16MiB.
+const kSparse = [
+    'truncate -s 16M /tmp/f',
+    'echo x | dd of=/tmp/f bs=1M seek=4 conv=notrunc status=none'
+].join(';');
+
+function checkSparse(output, size) {
+    const data = output.readFileSync();
+    assert.equal(data.length, size);
+    assert.equal(data.subarray(4 << 20).toString().replace(/\0+$/, ''), 'x\n');
+    assert.ok(data.subarray(0, 4 << 20).every(b=>b === 0));
+    // holes survived
+    assert.ok(fs.fstatSync(output.fd).blocks * 512 < 1 << 20);
+}
+
+test('copyFilesSparse', ()=>{
+    // src in tmpfs, dest on a different filesystem
+    const output = new TmpFile();
+    exited({
+        cmd: ['sh', '-c', kSparse],
+        mounts: [{type: 'tmpfs', dest: '/tmp'}],
+        copyFiles: [{src: '/tmp/f', dest: output}]
+    }, 0);
+    checkSparse(output, 16 << 20);
+});
+
+test('copyFilesSameFilesystem', ()=>{
+    // src and dest on the same filesystem, copy_file_range() or reflink
+    const dir = fs.mkdtempSync(os.tmpdir() + '/sandals-');
+    testAtExit(()=>fs.rmSync(dir, {recursive: true, force: true}));
+    fs.chmodSync(dir, 0o777);
+    const output = new TmpFile();
+    exited({
+        cmd: ['sh', '-c', kSparse],
+        mounts: [{type: 'bind', src: dir, dest: '/tmp'}],
+        copyFiles: [{src: '/tmp/f', dest: output}]
+    }, 0);
+    checkSparse(output, 16 << 20);
+});
+
+test('copyFilesSparseLimit', ()=>{
+    // limit counts holes; exactly at the limit is fine, past it isn't
+    let output = new TmpFile();
+    exited({
+        cmd: ['sh', '-c', kSparse],
+        mounts: [{type: 'tmpfs', dest: '/tmp'}],
+        copyFiles: [{src: '/tmp/f', dest: output, limit: 16 << 20}]
+    }, 0);
+    checkSparse(output, 16 << 20);
+
+    output = new TmpFile();
+    outputLimit({
+        cmd: ['sh', '-c', kSparse],
+        mounts: [{type: 'tmpfs', dest: '/tmp'}],
+        copyFiles: [{src: '/tmp/f', dest: output, limit: 8 << 20}]
+    });
+    checkSparse(output, 8 << 20);
+
+    output = new TmpFile();
+    outputLimit({
+        cmd: ['sh', '-c', kSparse],
+        mounts: [{type: 'tmpfs', dest: '/tmp'}],
+        copyFiles: [{src: '/tmp/f', dest: output, limit: 1 << 20}]
+    });
+    assert.ok(output.readFileSync().equals(Buffer.alloc(1 << 20)));
+});
+
+test('pipesBufferSizeInvalid', ()=>{
+    const dest = new TmpFile();
+    for (const bufferSize of [0, -1, 'big', true, null]) requestInvalid(
+        {cmd:['id'], pipes:[{stdout: true, dest, bufferSize}]},
+        /^pipes\[0\]\.bufferSize: /
+    );
+    requestInvalid(
+        {cmd:['id'], copyFiles:[{src: '/x', dest, bufferSize: 65536}]},
+        /^copyFiles\[0\]\.bufferSize: /
+    );
+    requestInvalid({cmd:['id'], pipeDelay: -1}, /^pipeDelay: /);
+    requestInvalid({cmd:['id'], pipeDelay: 2}, /^pipeDelay: /);
+});
+
+test('pipesWakeups', ()=>{
+    const output = new TmpFile();
+    const u = exited({
+        cmd: ['head', '-c', '1000', '/dev/zero'],
+        pipes: [{dest: output, stdout: true}],
+        usage: true
+    }, 0).usage;
+    assert.equal(u.pipeBytes, 1000);
+    if (!(u.pipeWakeups >= 1)) assert.fail(JSON.stringify(u));
+    assert.equal(exited({cmd: ['true'], usage: true}, 0).usage.pipeBytes,
+        undefined);
+});
+
+test('pipesDelay', ()=>{
+    // chatty task, output held back and collected in a few wakeups
+    for (const ioUring of [false, true]) {
+        const output = new TmpFile();
+        const u = exited({
+            ioUring, pipeDelay: 0.2, usage: true,
+            cmd: ['sh', '-c', 'for i in 1 2 3 4 5 6 7 8; do echo $i; sleep 0.01; done'],
+            pipes: [{dest: output, stdout: true}]
+        }, 0).usage;
+        assert.equal(output.read(), '1\n2\n3\n4\n5\n6\n7\n8\n');
+        if (!(u.pipeWakeups < 8)) assert.fail(JSON.stringify(u));
+    }
+});
+
+test('pipesBufferSize', ()=>{
+    // fits in the buffer, hence collected at once
+    const output = new TmpFile();
+    const u = exited({
+        pipeDelay: 0.2, usage: true,
+        cmd: ['head', '-c', '262144', '/dev/zero'],
+        pipes: [{dest: output, stdout: true, bufferSize: 262144}]
+    }, 0).usage;
+    assert.equal(output.readFileSync().length, 262144);
+    if (!(u.pipeWakeups <= 2)) assert.fail(JSON.stringify(u));
+
+    // beyond pipe-max-size, capped rather than failing
+    const big = new TmpFile();
+    exited({
+        cmd: ['echo', 'ok'],
+        pipes: [{dest: big, stdout: true, bufferSize: 1 << 30}]
+    }, 0);
+    assert.equal(big.read(), 'ok\n');
+
+    for (const ioUring of [false, true]) {
+        const output = new TmpFile();
+        exited({
+            ioUring,
+            cmd: ['head', '-c', '16777216', '/dev/zero'],
+            pipes: [{dest: output, stdout: true, bufferSize: 'auto'}]
+        }, 0);
+        assert.equal(output.readFileSync().length, 16777216);
+    }
+});
+
+test('retainInvalid', ()=>{
+    const dest = new TmpFile();
+    for (const retain of [42, true, null, [], {head: -1}, {tail: 'x'},
+        {tail: 1e9}, {middle: 1}]
+    ) requestInvalid(
+        {cmd:['id'], pipes:[{stdout: true, dest, retain}]},
+        /^pipes\[0\]\.retain/
+    );
+    requestInvalid(
+        {cmd:['id'], pipes:[{stdout: true, dest, retain: {}, limit: 1}]},
+        /^pipes\[0\]: 'retain' and 'limit' are mutually exclusive/
+    );
+    requestInvalid(
+        {cmd:['id'], stdStreams:{dest, retain: {}}},
+        /^stdStreams\.retain/
+    );
+});
+
+test('retain', ()=>{
+    // task runs to completion, keeping the head and the tail
+    const seq = Array.from({length: 100000}, (_, i)=>`${i + 1}\n`).join('');
+    const cmd = ['seq', '100000'];
+    for (const [head, tail] of [[10, 12], [0, 7], [6, 0], [0, 0],
+        [seq.length, 5], [10, seq.length], [100, 65537]]
+    ) {
+        const expected = seq.length > head + tail
+            ? seq.slice(0, head) + seq.slice(seq.length - tail) : seq;
+        const discarded = seq.length - expected.length;
+        for (const ioUring of [false, true]) {
+            const output = new TmpFile();
+            const r = exited({
+                cmd, ioUring,
+                pipes: [{stdout: true, dest: output, retain: {head, tail}}]
+            }, 0);
+            assert.equal(output.read(), expected);
+            assert.deepEqual(r.discarded, {'@stdout': discarded});
+        }
+        const output = new TmpFile();
+        const r = exited({
+            cmd,
+            mounts: [{type: 'tmpfs', dest: '/tmp'}],
+            copyFiles: [{
+                src: '/tmp/output', stdout: true, dest: output,
+                retain: {head, tail}
+            }]
+        }, 0);
+        assert.equal(output.read(), expected);
+        assert.deepEqual(r.discarded, {'/tmp/output': discarded});
+    }
+});
+
+test('retainSparse', ()=>{
+    // copyFiles skips to the tail without reading the middle
+    const output = new TmpFile();
+    const r = exited({
+        cmd: ['sh', '-c', kSparse + '; echo y >> /tmp/f'],
+        mounts: [{type: 'tmpfs', dest: '/tmp'}],
+        copyFiles: [{src: '/tmp/f', dest: output, retain: {head: 3, tail: 2}}]
+    }, 0);
+    assert.ok(output.readFileSync().equals(Buffer.from('\0\0\0y\n')));
+    assert.deepEqual(r.discarded, {'/tmp/f': (16 << 20) + 2 - 5});
+});
@@ -12,6 +12,15 @@ require('./mounts');
 // require('./workDir');
 // require('./timeLimit');
 require('./pipes');
+require('./ioUring');
+require('./memfd');
+require('./usage');
+require('./cpuTimeLimit');
+require('./timings');
+require('./seccompCache');
+require('./seccompBpf');
+require('./seccompParams');
+require('./specStoreBypass');
 // require('./stdStreams');
 
 require('./security');
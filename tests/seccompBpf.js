@@ -0,0 +1,40 @@
+const assert = require('assert');
+const { spawnSync } = require('child_process');
+const {
+    PROJECT_ROOT, test, exited, requestInvalid, TmpFile
+} = require('./harness');
+
+const COMPILE_POLICY = PROJECT_ROOT + '/sandals-compile-policy';
+
+function compilePolicy(policy) {
+    const output = new TmpFile();
+    const r = spawnSync(
+        COMPILE_POLICY, ['-o', output.toJSON()], {input: policy});
+    assert.equal(r.status, 0, r.stderr && r.stderr.toString());
+    return output;
+}
+
+test('seccompBpf', ()=>{
+    const bpf = compilePolicy(
+        'POLICY p { ERRNO(1) { ptrace } } USE p DEFAULT ALLOW');
+    assert.equal(bpf.readFileSync().length % 8, 0);
+    exited({cmd: ['true'], seccompBpf: bpf}, 0);
+});
+
+test('seccompBpfInvalid', ()=>{
+    requestInvalid(
+        {cmd: ['true'], seccompBpf: new TmpFile('')},
+        /invalid program length/);
+    requestInvalid(
+        {cmd: ['true'], seccompBpf: new TmpFile(Buffer.from('1234567'))},
+        /invalid program length/);
+    // BPF_RET|BPF_K SECCOMP_RET_ALLOW, no arch check
+    requestInvalid(
+        {cmd: ['true'], seccompBpf: new TmpFile(
+            Buffer.from([6, 0, 0, 0, 0, 0, 0xff, 0x7f]))},
+        /arch check missing/);
+    requestInvalid({
+        cmd: ['true'], seccompBpf: new TmpFile(''),
+        seccompPolicy: 'USE nothing DEFAULT ALLOW'
+    }, /mutually exclusive/);
+});
@@ -0,0 +1,67 @@
+const assert = require('assert');
+const fs = require('fs');
+const os = require('os');
+const {
+    test, exited, requestInvalid, testAtExit
+} = require('./harness');
+
+const POLICY = 'POLICY p { ERRNO(1) { ptrace } } USE p DEFAULT ALLOW';
+
+test('seccompCache', ()=>{
+    const dir = fs.mkdtempSync(os.tmpdir() + '/sandals-seccomp-');
+    testAtExit(()=>fs.rmSync(dir, {recursive: true, force: true}));
+    const request = {
+        cmd: ['true'], seccompPolicy: POLICY, seccompCacheDir: dir
+    };
+
+    exited(request, 0);
+    const files = fs.readdirSync(dir);
+    assert.equal(files.length, 1);
+    assert.match(files[0], /^[0-9a-f]{16}\.bpf$/);
+    assert.equal(fs.statSync(`${dir}/${files[0]}`).mode & 0o777, 0o600);
+    const blob = fs.readFileSync(`${dir}/${files[0]}`);
+
+    // hit, cache file unchanged
+    exited(request, 0);
+    assert.deepEqual(fs.readdirSync(dir), files);
+    assert.deepEqual(fs.readFileSync(`${dir}/${files[0]}`), blob);
+
+    // corrupted entry is replaced
+    fs.writeFileSync(`${dir}/${files[0]}`, 'garbage');
+    exited(request, 0);
+    assert.deepEqual(fs.readFileSync(`${dir}/${files[0]}`), blob);
+
+    // different policy, different entry
+    exited({...request, seccompPolicy: POLICY + ' '}, 0);
+    assert.equal(fs.readdirSync(dir).length, 2);
+});
+
+test('seccompCacheMissingDir', ()=>{
+    requestInvalid({
+        cmd: ['true'], seccompPolicy: POLICY,
+        seccompCacheDir: '/no-such-file-or-dir'
+    }, /^seccompCacheDir: /);
+});
+
+test('seccompCacheUntrusted', ()=>{
+    const dir = fs.mkdtempSync(os.tmpdir() + '/sandals-seccomp-');
+    testAtExit(()=>fs.rmSync(dir, {recursive: true, force: true}));
+    const request = {
+        cmd: ['true'], seccompPolicy: POLICY, seccompCacheDir: dir
+    };
+
+    // others could plant entries
+    for (const mode of [0o770, 0o777, 0o1777]) {
+        fs.chmodSync(dir, mode);
+        requestInvalid(request, /^seccompCacheDir: .* writable/);
+    }
+    fs.chmodSync(dir, 0o700);
+
+    // entry owned by someone else is ignored and replaced
+    if (process.getuid() !== 0) return;
+    exited(request, 0);
+    const [name] = fs.readdirSync(dir);
+    fs.chownSync(`${dir}/${name}`, 12345, 12345);
+    exited(request, 0);
+    assert.equal(fs.statSync(`${dir}/${name}`).uid, 0);
+});
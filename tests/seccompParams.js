@@ -0,0 +1,50 @@
+const assert = require('assert');
+const fs = require('fs');
+const os = require('os');
+const { test, exited, requestInvalid, testAtExit } = require('./harness');
+
+const POLICY =
+    'POLICY p { ERRNO(1) { kill(pid, sig) { sig == $SIG } } } ' +
+    'USE p DEFAULT ALLOW';
+
+// exits with 1 if kill(0) is denied
+const CMD = ['sh', '-c', 'kill -0 $$'];
+
+test('seccompParams', ()=>{
+    exited({cmd: CMD, seccompPolicy: POLICY, seccompParams: {SIG: 0}}, 1);
+    exited({cmd: CMD, seccompPolicy: POLICY, seccompParams: {SIG: 15}}, 0);
+    exited({
+        cmd: CMD, seccompPolicy: POLICY, seccompParams: {SIG: 4294967295}
+    }, 0);
+});
+
+test('seccompParamsCache', ()=>{
+    const dir = fs.mkdtempSync(os.tmpdir() + '/sandals-seccomp-');
+    testAtExit(()=>fs.rmSync(dir, {recursive: true, force: true}));
+    const request = {cmd: CMD, seccompPolicy: POLICY, seccompCacheDir: dir};
+
+    // the same entry serves any parameter values
+    exited({...request, seccompParams: {SIG: 0}}, 1);
+    const files = fs.readdirSync(dir);
+    exited({...request, seccompParams: {SIG: 15}}, 0);
+    exited({...request, seccompParams: {SIG: 0}}, 1);
+    assert.deepEqual(fs.readdirSync(dir), files);
+});
+
+test('seccompParamsInvalid', ()=>{
+    requestInvalid({cmd: CMD, seccompPolicy: POLICY}, /'\$SIG' missing/);
+    requestInvalid({
+        cmd: CMD, seccompPolicy: POLICY, seccompParams: {SIG: 0, FOO: 1}
+    }, /Unknown key/);
+    requestInvalid({
+        cmd: CMD, seccompPolicy: POLICY, seccompParams: {SIG: -1}
+    }, /integer/);
+    requestInvalid({
+        cmd: CMD, seccompPolicy: POLICY, seccompParams: {SIG: 1.5}
+    }, /integer/);
+    // sig is 32-bit, the high word would be silently ignored
+    requestInvalid({
+        cmd: CMD, seccompPolicy: POLICY, seccompParams: {SIG: 4294967296}
+    }, /\[0, 2\^32\)/);
+    requestInvalid({cmd: CMD, seccompParams: {}}, /requires 'seccompPolicy'/);
+});
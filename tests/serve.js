@@ -0,0 +1,95 @@
+// Serve mode: requests are NDJSON lines sent over a Unix socket.
+const {spawn} = require('child_process');
+const {connect} = require('net');
+const {tmpdir} = require('os');
+const path = require('path');
+const assert = require('assert');
+
+const {SANDALS} = require('./harness');
+
+const socketPath = path.join(tmpdir(), `sandals-serve-${process.pid}.sock`);
+
+function request(lines, count) {
+    return new Promise((resolve, reject)=>{
+        const socket = connect(socketPath, ()=>socket.end(lines));
+        const output = [];
+        socket.on('data', data=>output.push(data));
+        socket.on('error', reject);
+        socket.on('close', ()=>{
+            const responses = Buffer.concat(output).toString('utf8')
+                .split('\n').filter(line=>line).map(line=>JSON.parse(line));
+            assert.equal(responses.length, count);
+            resolve(responses);
+        });
+    });
+}
+
+async function waitForSocket() {
+    for (let i = 0; i < 100; ++i) {
+        try { return await request('', 0); }
+        catch (e) { await new Promise(resolve=>setTimeout(resolve, 50)); }
+    }
+    assert.fail('sandals --serve did not start');
+}
+
+async function testServe(args) {
+    const server = spawn(
+        SANDALS, ['--serve', socketPath, ...args],
+        {stdio: ['ignore', 'ignore', 'pipe']});
+    const serverStderr = [];
+    server.stderr.on('data', data=>serverStderr.push(data));
+    try {
+        await waitForSocket();
+
+        // several requests on a single connection, answered in order
+        const responses = await request([
+            JSON.stringify({cmd: ['true']}),
+            '',
+            JSON.stringify({cmd: ['false']}),
+            '{',
+            JSON.stringify({cmd: ['sh', '-c', 'exit 7']}) // no trailing newline
+        ].join('\n'), 4);
+        assert.deepEqual(responses, [
+            {status: 'exited', code: 0},
+            {status: 'exited', code: 1},
+            {status: 'requestInvalid'},
+            {status: 'exited', code: 7}
+        ]);
+
+        // concurrent connections
+        const results = await Promise.all(Array.from({length: 8}, (_, i)=>
+            request(JSON.stringify({cmd: ['sh', '-c', `exit ${i}`]})+'\n', 1)));
+        results.forEach(([response], i)=>
+            assert.deepEqual(response, {status: 'exited', code: i}));
+
+        // request-specific settings apply to a pre-warmed spawner as well
+        const [[uid], [hostName]] = await Promise.all([
+            request(JSON.stringify(
+                {cmd: ['sh', '-c', 'exit $(id -u)'], uid: 42})+'\n', 1),
+            request(JSON.stringify(
+                {cmd: ['sh', '-c', 'test $(hostname) = xyz'],
+                 hostName: 'xyz'})+'\n', 1)
+        ]);
+        assert.deepEqual(uid, {status: 'exited', code: 42});
+        assert.deepEqual(hostName, {status: 'exited', code: 0});
+
+        if (args.length) {
+            server.kill('SIGUSR1');
+            await new Promise(resolve=>setTimeout(resolve, 100));
+            const log = Buffer.concat(serverStderr).toString('utf8');
+            const m = /(\d+) hits, (\d+) misses/.exec(log);
+            assert(m, log);
+            assert.equal(+m[1] + +m[2], 13);
+            assert(+m[1] > 0 && +m[2] > 0, log); // uid: 42 is a miss
+        }
+    } finally {
+        server.kill();
+    }
+}
+
+testServe([]).then(()=>testServe(['--pool', '2'])).then(()=>{
+    process.exit();
+}, e=>{
+    console.error(e);
+    process.exit(1);
+});
@@ -0,0 +1,40 @@
+const fs = require('fs');
+const { test, exited, requestInvalid } = require('./harness');
+
+const POLICY = 'POLICY p { ERRNO(1) { ptrace } } USE p DEFAULT ALLOW';
+
+// Per-thread control is only available if the kernel runs in 'prctl'
+// or 'seccomp' mode (spec_store_bypass_disable=).
+function controllable() {
+    const m = fs.readFileSync('/proc/self/status', 'utf8')
+        .match(/^Speculation_Store_Bypass:\s*(.*)$/m);
+    return m && m[1].startsWith('thread');
+}
+
+function ssb(request, state) {
+    return exited({
+        mounts: [{type: 'proc', dest: '/proc'}],
+        cmd: [
+            'grep', '-q', `^Speculation_Store_Bypass:.${state}$`,
+            '/proc/self/status'
+        ],
+        ...request
+    }, 0);
+}
+
+test('specStoreBypass', ()=>{
+    if (!controllable()) return;
+    ssb({specStoreBypass: 'disable'}, 'thread mitigated');
+    ssb({specStoreBypass: 'enable'}, 'thread vulnerable');
+    ssb({specStoreBypass: 'forceDisable'}, 'thread force mitigated');
+    ssb({
+        specStoreBypass: 'enable', seccompPolicy: POLICY,
+        seccompSpecAllow: true
+    }, 'thread vulnerable');
+});
+
+test('specStoreBypassInvalid', ()=>{
+    requestInvalid({cmd: ['true'], specStoreBypass: 'off'},
+        /Unknown mode 'off'/);
+    requestInvalid({cmd: ['true'], seccompSpecAllow: 1});
+});
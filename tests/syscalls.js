@@ -0,0 +1,56 @@
+// Syscall budget of reference requests, counted with strace -f -c
+// (sandals and the task combined). Fails if a count exceeds the budget;
+// budgets are measured counts plus a call or two of slack for timing
+// dependent polls, lower them when the startup path gets leaner.
+const assert = require('assert');
+const { spawnSync } = require('child_process');
+const { SANDALS, TmpFile, test, getInfo } = require('./harness');
+
+const references = [
+    {
+        name: 'bare',
+        budget: 110, // 109
+        request: {cmd: ['/bin/true']}
+    },
+    {
+        name: 'pipes+timeLimit',
+        budget: 121, // 119-120
+        request: {
+            cmd: ['/bin/true'], timeLimit: 1,
+            pipes: [{stdout: true, dest: '/dev/null'}]
+        }
+    },
+    {
+        name: 'mounts+copyFiles',
+        budget: 120, // 118-119
+        request: {
+            cmd: ['/bin/true'],
+            mounts: [{type: 'tmpfs', dest: '/tmp'}],
+            copyFiles: [{src: '/tmp/x', dest: '/dev/null'}]
+        }
+    }
+];
+
+if (spawnSync('strace', ['-V']).error) {
+    console.log('strace not found, skipping');
+    process.exit(0);
+}
+
+for (const {name, budget, request} of references) test(name, ()=>{
+    const output = new TmpFile();
+    const r = spawnSync(
+        'strace', ['-f', '-c', '-o', output.toJSON(), SANDALS],
+        {input: JSON.stringify(request)});
+    const response = JSON.parse(r.stdout.toString('utf8'));
+    if (response.status !== 'exited' || response.code !== 0)
+        assert.fail(JSON.stringify(response));
+    // % time  seconds  usecs/call  calls  [errors]  total
+    const total = output.read().trim().split('\n').pop().trim().split(/\s+/);
+    const calls = +total[3];
+    console.log(`${name}: ${calls} syscalls, budget ${budget}`);
+    if (!(calls <= budget)) assert.fail(`${calls} > ${budget}`);
+});
+
+const { testsTotal, testsSucceeded } = getInfo();
+console.log(`${testsSucceeded}/${testsTotal}`);
+process.exit(testsTotal === testsSucceeded ? 0 : 1);
@@ -0,0 +1,16 @@
+const assert = require('assert');
+const { test, exited } = require('./harness');
+
+test('timings', ()=>{
+    assert.equal(exited({cmd:['true']}, 0).timings, undefined);
+
+    const t = exited({cmd:['sleep', '0.1'], timings: true}, 0).timings;
+    for (const key of [
+        'requestRecv', 'clone', 'configureNet', 'mapUserAndGroup',
+        'doMounts', 'chroot', 'createPipes', 'forkToExec', 'task'
+    ]) if (!(t[key] > 0)) assert.fail(JSON.stringify(t));
+    if (!(t.task >= 1e8)) assert.fail(JSON.stringify(t));
+    // no cgroup, no seccomp policy
+    if (t.configureCgroup !== undefined || t.seccompCompile !== undefined)
+        assert.fail(JSON.stringify(t));
+});
@@ -0,0 +1,20 @@
+const assert = require('assert');
+const { test, exited, timeLimit } = require('./harness');
+
+test('usage', ()=>{
+    assert.equal(exited({cmd:['true']}, 0).usage, undefined);
+    assert.equal(exited({cmd:['true'], usage: false}, 0).usage, undefined);
+
+    const u = exited({cmd:['sh', '-c', 'sleep 0.1'], usage: true}, 0).usage;
+    if (!(u.wallTime >= 0.1 && u.wallTime < 10)) assert.fail(JSON.stringify(u));
+    if (!(u.maxRss > 0)) assert.fail(JSON.stringify(u));
+    for (const key of [
+        'minorFaults', 'majorFaults',
+        'voluntaryCtxSwitches', 'involuntaryCtxSwitches'
+    ]) if (typeof(u[key]) !== 'number') assert.fail(JSON.stringify(u));
+
+    // killed by supervisor, rusage unavailable
+    const t = timeLimit({cmd:['sleep', '1'], timeLimit:0.1, usage: true}).usage;
+    if (!(t.wallTime > 0) || t.maxRss !== undefined)
+        assert.fail(JSON.stringify(t));
+});